@@ -0,0 +1,171 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Measures what qbreakpad_setAnnotation() costs while many threads update the
+// table at once. Every thread sets a value in a tight loop; the per-thread mean
+// cost of one update is reported, and the slowest of every 16th update, timed on
+// its own: an update that had to wait for a preempted writer of the same key shows
+// up there. Two key layouts are run: "spread", where the threads update different
+// keys (at most 48, so some share), and "shared", where every thread updates the
+// same key and competes for its value buffers.
+//
+//     annotationbench --threads 1,8,64
+
+#include "qbreakpad.h"
+
+#include <QList>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    QList<int> threadCounts = {1, 64};
+    int iterations = 1000000;
+};
+
+constexpr int kSpreadKeys = 48;
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    bool ok = true;
+    for (int i = 1; ok && (i < argc); ++i) {
+        const bool hasValue = (i + 1) < argc;
+        if ((strcmp(argv[i], "--threads") == 0) && hasValue) {
+            options.threadCounts.clear();
+            for (char *value = strtok(argv[++i], ","); value; value = strtok(nullptr, ",")) {
+                const int threads = atoi(value);
+                ok = ok && (threads > 0);
+                options.threadCounts.append(threads);
+            }
+        } else if ((strcmp(argv[i], "--iterations") == 0) && hasValue) {
+            options.iterations = atoi(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || options.threadCounts.isEmpty() || (options.iterations <= 0)) {
+        fprintf(stderr, "Usage: %s [--threads N,...] [--iterations N]\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+void runScenario(const char *layout, int threadCount, int iterations, bool shared)
+{
+    std::atomic<int> ready = 0;
+    std::atomic<bool> start = false;
+    std::atomic<int> failures = 0;
+    std::vector<double> costs(size_t(threadCount), 0.0);
+    std::vector<double> worst(size_t(threadCount), 0.0);
+    std::vector<std::thread> threads;
+    threads.reserve(size_t(threadCount));
+    for (int t = 0; t != threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            char key[32] = {};
+            snprintf(key, sizeof(key), shared ? "request-id" : "request-id-%d", t % kSpreadKeys);
+            // A realistic value, changing on every update.
+            char value[64] = {};
+            snprintf(value, sizeof(value), "tenant-%d/00000000-0000-0000-0000-000000000000", t);
+            char *counter = value + strlen(value) - 8;
+            ready.fetch_add(1);
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            std::chrono::steady_clock::duration slowest = {};
+            const auto begin = std::chrono::steady_clock::now();
+            for (int i = 0; i != iterations; ++i) {
+                counter[i & 7] = char('0' + (i & 7));
+                const bool timed = (i & 15) == 0;
+                const auto updateBegin = timed ? std::chrono::steady_clock::now()
+                                               : std::chrono::steady_clock::time_point();
+                if (!qbreakpad_setAnnotation(key, value)) {
+                    failures.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (timed) {
+                    slowest = std::max(slowest, std::chrono::steady_clock::now() - updateBegin);
+                }
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - begin;
+            costs[size_t(t)] = double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+                               / iterations;
+            worst[size_t(t)] = double(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(slowest).count());
+        });
+    }
+    while (ready.load() != threadCount) {
+        std::this_thread::yield();
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const auto printStats = [](const char *name, std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        const auto percentile = [&values](int p) {
+            return values.at(std::min(values.size() - 1, (values.size() * size_t(p)) / 100));
+        };
+        printf("  %-22s min=%.1fns p50=%.1fns p95=%.1fns max=%.1fns\n",
+               name,
+               values.front(),
+               percentile(50),
+               percentile(95),
+               values.back());
+    };
+    printf("layout=%s threads=%d iterations=%d\n", layout, threadCount, iterations);
+    printStats("update-cost", costs);
+    printStats("worst-update", worst);
+    printf("  %-22s %.1fM/s\n", "throughput", (double(threadCount) * iterations) / seconds / 1e6);
+    if (failures.load() != 0) {
+        printf("  %-22s %d\n", "table-full", failures.load());
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options = {};
+    if (!parseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+    for (const int threads : std::as_const(options.threadCounts)) {
+        runScenario("spread", threads, options.iterations, false);
+    }
+    for (const int threads : std::as_const(options.threadCounts)) {
+        runScenario("shared", threads, options.iterations, true);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,660 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Forks a process per iteration, faults it with the QBreakpad handler installed and
+// measures the crash path: fault to dump complete (the dump file's last write),
+// fault to crash reporter running, dump size, and the peak RSS of the crashed
+// process together with how much of it the handler added. The reporter is this
+// executable again, started with --reporter-stamp.
+//
+// Fault kinds, thread counts, heap sizes and module counts take comma separated
+// lists; every combination is run and reported on its own line block. How dump
+// time scales with the thread count, with and without a thread capture policy:
+//
+//     crashbench --threads 0,100,1000,4000
+//     crashbench --threads 0,100,1000,4000 --max-threads 16 --thread-pattern 'idle-1?'
+//
+// Whether the crashes that leave the handler nothing to work with still get a dump:
+// a stack overflow on a secondary thread, and a crash after malloc() ran out of
+// address space. Compare fault-to-dump's n with and without the reserves:
+//
+//     crashbench --fault thread-stack-overflow,malloc-exhaustion
+//     crashbench --fault thread-stack-overflow,malloc-exhaustion --alt-stack-kb 256
+//                --emergency-reserve-kb 16384
+//
+// What writing into a pre-allocated dump slot saves over creating the dump file in
+// the crash handler, most visible with --work-dir on a slow or network file system:
+//
+//     crashbench --heap-mb 1024 --dump-slots 2 --slot-kb 65536
+//
+// Whether a crash still gets a dump once the pool has run dry and dumps go back to
+// files the handler creates itself; fails when one does not:
+//
+//     crashbench --dump-slots 2 --drain-slots
+
+#include "qbreakpad.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+enum class Fault { Segv, Abort, StackOverflow, ThreadStackOverflow, MallocExhaustion, WriteDump };
+
+struct Options
+{
+    int iterations = 20;
+    QList<Fault> faults = {Fault::Segv};
+    QList<int> threadCounts = {0};
+    QList<int> heapMegabytes = {0};
+    QList<int> moduleCounts = {0};
+    int maxCapturedThreads = -1;
+    QStringList threadNamePatterns = {};
+    int stackLimitKilobytes = 0;
+    int emergencyReserveKilobytes = 0;
+    int alternateStackKilobytes = 0;
+    int dumpSlots = 0;
+    int slotKilobytes = 0;
+    bool drainSlots = false;
+    bool corruptHeap = false;
+    bool reporterDaemon = false;
+    QString workDir = QDir::tempPath() + QStringLiteral("/qbreakpad-crashbench");
+};
+
+struct Scenario
+{
+    Fault fault = Fault::Segv;
+    int threads = 0;
+    int heapMegabytes = 0;
+    int modules = 0;
+};
+
+struct SharedState
+{
+    qint64 faultNs;
+    qint64 faultRealtimeNs;
+    qint64 highWaterMarkKb;
+};
+
+const char *faultName(Fault fault)
+{
+    switch (fault) {
+    case Fault::Segv:
+        return "segv";
+    case Fault::Abort:
+        return "abort";
+    case Fault::StackOverflow:
+        return "stack-overflow";
+    case Fault::ThreadStackOverflow:
+        return "thread-stack-overflow";
+    case Fault::MallocExhaustion:
+        return "malloc-exhaustion";
+    case Fault::WriteDump:
+        return "write-dump";
+    }
+    return "unknown";
+}
+
+qint64 clockNs(clockid_t clock)
+{
+    timespec ts = {};
+    clock_gettime(clock, &ts);
+    return (qint64(ts.tv_sec) * 1000000000) + ts.tv_nsec;
+}
+
+qint64 monotonicNs()
+{
+    return clockNs(CLOCK_MONOTONIC);
+}
+
+QString selfExecutablePath()
+{
+    char buffer[4096] = {};
+    const ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+    return (length > 0) ? QString::fromLocal8Bit(buffer, length) : QString();
+}
+
+int runReporter(const char *stampFile, int channelFd)
+{
+    if (channelFd != -1) {
+        // Daemon mode: block until the crashed process hands over its dump.
+        char message[8192] = {};
+        if (recv(channelFd, message, sizeof(message) - 1, 0) <= 0) {
+            return EXIT_FAILURE;
+        }
+    }
+    const qint64 now = monotonicNs();
+    FILE *file = fopen(stampFile, "w");
+    if (!file) {
+        return EXIT_FAILURE;
+    }
+    fprintf(file, "%lld\n", static_cast<long long>(now));
+    fclose(file);
+    return EXIT_SUCCESS;
+}
+
+qint64 readStamp(const QString &path, int timeoutMs)
+{
+    const QByteArray fileName = QFile::encodeName(path);
+    for (int waited = 0; waited < timeoutMs; waited += 5) {
+        if (FILE *file = fopen(fileName.constData(), "r")) {
+            long long value = 0;
+            const bool ok = (fscanf(file, "%lld", &value) == 1);
+            fclose(file);
+            if (ok) {
+                return value;
+            }
+        }
+        usleep(5000);
+    }
+    return -1;
+}
+
+// VmHWM of the calling process, in kilobytes like ru_maxrss.
+qint64 highWaterMarkKb()
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return 0;
+    }
+    char line[256] = {};
+    long long value = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "VmHWM: %lld kB", &value) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+void touchHeap(int megabytes)
+{
+    for (int i = 0; i != megabytes; ++i) {
+        auto block = static_cast<char *>(malloc(1024 * 1024));
+        memset(block, 0x5a, 1024 * 1024);
+    }
+}
+
+void *idleThread(void *argument)
+{
+    Q_UNUSED(argument)
+    // Some stack for the dumper to copy, then sleep until the process dies.
+    volatile char stack[16 * 1024];
+    memset(const_cast<char *>(stack), 0x33, sizeof(stack));
+    for (;;) {
+        pause();
+    }
+    return nullptr;
+}
+
+// Named idle-0, idle-1, ... for --thread-pattern.
+void startThreads(int count)
+{
+    for (int i = 0; i != count; ++i) {
+        pthread_t thread = {};
+        pthread_attr_t attributes = {};
+        pthread_attr_init(&attributes);
+        pthread_attr_setstacksize(&attributes, 256 * 1024);
+        if (pthread_create(&thread, &attributes, idleThread, nullptr) == 0) {
+            char name[16] = {};
+            snprintf(name, sizeof(name), "idle-%d", i);
+            pthread_setname_np(thread, name);
+        }
+        pthread_attr_destroy(&attributes);
+    }
+}
+
+// Breakpad lists every executable file mapping as a module, and reads the build
+// id of each from its ELF headers. Copies of this executable are real ELF files
+// with a build id, which is all a module needs to look like a shared library.
+void mapModules(const QString &moduleDir, int count)
+{
+    for (int i = 0; i != count; ++i) {
+        const QByteArray path = QFile::encodeName(moduleDir + QStringLiteral("/module-")
+                                                  + QString::number(i) + QStringLiteral(".so"));
+        const int fd = open(path.constData(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            continue;
+        }
+        struct stat st = {};
+        if (fstat(fd, &st) == 0) {
+            mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+    }
+}
+
+bool prepareModules(const QString &moduleDir, int count)
+{
+    QDir().mkpath(moduleDir);
+    const QString source = selfExecutablePath();
+    for (int i = 0; i != count; ++i) {
+        const QString target = moduleDir + QStringLiteral("/module-") + QString::number(i)
+                               + QStringLiteral(".so");
+        if (!QFileInfo::exists(target) && !QFile::copy(source, target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+[[gnu::noinline]] int overflowStack(int depth)
+{
+    volatile char frame[4096];
+    frame[0] = char(depth);
+    return overflowStack(depth + 1) + frame[0];
+}
+
+void *overflowThreadStack(void *argument)
+{
+    Q_UNUSED(argument)
+    // Without the pthread_create() hook, threads ask for their stack themselves.
+    qbreakpad_installAlternateSignalStack();
+    overflowStack(0);
+    return nullptr;
+}
+
+// Caps the address space a little above what is mapped now and allocates until
+// malloc() fails, which is where an out-of-memory crash leaves its handler.
+void exhaustHeap()
+{
+    long long pages = 0;
+    if (FILE *file = fopen("/proc/self/statm", "r")) {
+        if (fscanf(file, "%lld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(file);
+    }
+    rlimit limit = {};
+    getrlimit(RLIMIT_AS, &limit);
+    limit.rlim_cur = rlim_t(pages * sysconf(_SC_PAGESIZE)) + (64 * 1024 * 1024);
+    setrlimit(RLIMIT_AS, &limit);
+    for (size_t size = 1024 * 1024; size >= 64;) {
+        if (!malloc(size)) {
+            size /= 2;
+        }
+    }
+}
+
+// Slot files are named after the pid and a running number; taking the names that
+// come after the first fill keeps the pool from making new slots.
+void blockDumpSlots(const QString &dumpDir, int count)
+{
+    QDir().mkpath(dumpDir);
+    for (int i = count; i != (3 * count) + 8; ++i) {
+        QFile file(dumpDir + QStringLiteral("/.qbreakpad-slot-") + QString::number(getpid())
+                   + QStringLiteral("-") + QString::number(i));
+        file.open(QIODevice::WriteOnly);
+    }
+}
+
+// Every slot goes to a requested dump; those are removed again so that only the
+// crash can leave a dump behind.
+void drainDumpSlots(const QString &dumpDir, int count)
+{
+    for (int i = 0; i != count; ++i) {
+        qbreakpad_writeMiniDump();
+    }
+    QDir dir(dumpDir);
+    for (const QString &fileName : dir.entryList({QStringLiteral("*.dmp*")}, QDir::Files)) {
+        dir.remove(fileName);
+    }
+}
+
+[[noreturn]] void crashChild(const Options &options,
+                             const Scenario &scenario,
+                             const QString &dumpDir,
+                             const QString &moduleDir,
+                             const QString &stampFile,
+                             SharedState *shared)
+{
+    touchHeap(scenario.heapMegabytes);
+    startThreads(scenario.threads);
+    mapModules(moduleDir, scenario.modules);
+    qbreakpad_setMaxCapturedThreads(options.maxCapturedThreads);
+    qbreakpad_setCapturedThreadNamePatterns(options.threadNamePatterns);
+    qbreakpad_setThreadStackCaptureLimit(qint64(options.stackLimitKilobytes) * 1024);
+    qbreakpad_setEmergencyMemoryReserve(qint64(options.emergencyReserveKilobytes) * 1024);
+    qbreakpad_setAlternateSignalStackSize(qint64(options.alternateStackKilobytes) * 1024);
+    qbreakpad_setDumpSlotPool(options.dumpSlots, qint64(options.slotKilobytes) * 1024);
+    if (options.drainSlots) {
+        blockDumpSlots(dumpDir, options.dumpSlots);
+    }
+    qbreakpad_initCrashHandler(dumpDir);
+    if (options.drainSlots) {
+        drainDumpSlots(dumpDir, options.dumpSlots);
+    }
+    // After the drain, whose dumps must not start the reporter.
+    qbreakpad_setReporterPath(selfExecutablePath());
+    qbreakpad_setReporterCommonArguments({QStringLiteral("--reporter-stamp"), stampFile});
+    qbreakpad_setReporterDaemonEnabled(options.reporterDaemon);
+    if (options.corruptHeap) {
+        // Trash the malloc chunk header in front of a live block. Anything that
+        // allocates from now on (QProcess, QString, ...) is likely to abort or hang.
+        auto block = static_cast<size_t *>(malloc(64));
+        block[-1] = ~size_t(0);
+        block[-2] = ~size_t(0);
+    }
+    if (scenario.fault == Fault::MallocExhaustion) {
+        exhaustHeap();
+    }
+    shared->highWaterMarkKb = highWaterMarkKb();
+    shared->faultRealtimeNs = clockNs(CLOCK_REALTIME);
+    shared->faultNs = monotonicNs();
+    switch (scenario.fault) {
+    case Fault::Segv:
+        *static_cast<volatile int *>(nullptr) = 0;
+        break;
+    case Fault::Abort:
+        abort();
+    case Fault::StackOverflow:
+        overflowStack(0);
+        break;
+    case Fault::ThreadStackOverflow: {
+        pthread_t thread = {};
+        if (pthread_create(&thread, nullptr, overflowThreadStack, nullptr) == 0) {
+            pthread_join(thread, nullptr);
+        }
+        break;
+    }
+    case Fault::MallocExhaustion:
+        // What an unchecked allocation, or std::bad_alloc, ends in.
+        abort();
+    case Fault::WriteDump:
+        qbreakpad_writeMiniDump();
+        _exit(EXIT_SUCCESS);
+    }
+    _exit(EXIT_FAILURE);
+}
+
+QFileInfo findDump(const QString &dumpDir)
+{
+    const QFileInfoList entries = QDir(dumpDir).entryInfoList(
+        {QStringLiteral("*.dmp"), QStringLiteral("*.dmp.zst")}, QDir::Files, QDir::Time);
+    return entries.isEmpty() ? QFileInfo() : entries.first();
+}
+
+void printStats(const char *name, QList<qint64> samples, int expected, double scale, const char *unit)
+{
+    if (samples.isEmpty()) {
+        printf("  %-22s no samples (0/%d)\n", name, expected);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto percentile = [&samples, scale](int p) {
+        return samples.at(std::min<qsizetype>(samples.size() - 1, (samples.size() * p) / 100)) / scale;
+    };
+    printf("  %-22s n=%d/%d min=%.1f%s p50=%.1f%s p95=%.1f%s max=%.1f%s\n",
+           name,
+           int(samples.size()),
+           expected,
+           samples.first() / scale,
+           unit,
+           percentile(50),
+           unit,
+           percentile(95),
+           unit,
+           samples.last() / scale,
+           unit);
+}
+
+template<typename T, typename Parse>
+bool parseList(const char *text, QList<T> &values, Parse parse)
+{
+    values.clear();
+    for (const QByteArray &item : QByteArray(text).split(',')) {
+        T value = {};
+        if (!parse(item, value)) {
+            return false;
+        }
+        values.append(value);
+    }
+    return !values.isEmpty();
+}
+
+bool parseInt(const QByteArray &text, int &value)
+{
+    bool ok = false;
+    value = text.toInt(&ok);
+    return ok && (value >= 0);
+}
+
+bool parseFault(const QByteArray &text, Fault &value)
+{
+    for (const Fault fault : {Fault::Segv,
+                              Fault::Abort,
+                              Fault::StackOverflow,
+                              Fault::ThreadStackOverflow,
+                              Fault::MallocExhaustion,
+                              Fault::WriteDump}) {
+        if (text == faultName(fault)) {
+            value = fault;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    bool ok = true;
+    for (int i = 1; ok && (i < argc); ++i) {
+        const QByteArray argument = argv[i];
+        const bool hasValue = (i + 1) < argc;
+        if ((argument == "--iterations") && hasValue) {
+            options.iterations = atoi(argv[++i]);
+        } else if ((argument == "--fault") && hasValue) {
+            ok = parseList(argv[++i], options.faults, parseFault);
+        } else if ((argument == "--threads") && hasValue) {
+            ok = parseList(argv[++i], options.threadCounts, parseInt);
+        } else if ((argument == "--heap-mb") && hasValue) {
+            ok = parseList(argv[++i], options.heapMegabytes, parseInt);
+        } else if ((argument == "--modules") && hasValue) {
+            ok = parseList(argv[++i], options.moduleCounts, parseInt);
+        } else if ((argument == "--max-threads") && hasValue) {
+            options.maxCapturedThreads = atoi(argv[++i]);
+        } else if ((argument == "--thread-pattern") && hasValue) {
+            options.threadNamePatterns.append(QString::fromLocal8Bit(argv[++i]));
+        } else if ((argument == "--stack-limit-kb") && hasValue) {
+            options.stackLimitKilobytes = atoi(argv[++i]);
+        } else if ((argument == "--emergency-reserve-kb") && hasValue) {
+            options.emergencyReserveKilobytes = atoi(argv[++i]);
+        } else if ((argument == "--alt-stack-kb") && hasValue) {
+            options.alternateStackKilobytes = atoi(argv[++i]);
+        } else if ((argument == "--dump-slots") && hasValue) {
+            options.dumpSlots = atoi(argv[++i]);
+        } else if ((argument == "--slot-kb") && hasValue) {
+            options.slotKilobytes = atoi(argv[++i]);
+        } else if (argument == "--drain-slots") {
+            options.drainSlots = true;
+        } else if (argument == "--corrupt-heap") {
+            options.corruptHeap = true;
+        } else if (argument == "--daemon") {
+            options.reporterDaemon = true;
+        } else if ((argument == "--work-dir") && hasValue) {
+            options.workDir = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr,
+                "Usage: %s [--iterations N]\n"
+                "       [--fault segv,abort,stack-overflow,thread-stack-overflow,malloc-exhaustion,"
+                "write-dump]\n"
+                "       [--threads N,...] [--heap-mb N,...] [--modules N,...]\n"
+                "       [--max-threads N] [--thread-pattern GLOB] [--stack-limit-kb N]\n"
+                "       [--emergency-reserve-kb N] [--alt-stack-kb N] [--dump-slots N] [--slot-kb N]\n"
+                "       [--drain-slots] [--corrupt-heap] [--daemon] [--work-dir DIR]\n",
+                argv[0]);
+        return false;
+    }
+    if (options.drainSlots && (options.dumpSlots <= 0)) {
+        fprintf(stderr, "--drain-slots needs --dump-slots\n");
+        return false;
+    }
+    return options.iterations > 0;
+}
+
+bool runScenario(const Options &options, const Scenario &scenario, SharedState *shared)
+{
+    const QString moduleDir = options.workDir + QStringLiteral("/modules");
+    if (!prepareModules(moduleDir, scenario.modules)) {
+        fprintf(stderr, "Failed to create the modules in %s\n", qPrintable(moduleDir));
+        return false;
+    }
+
+    QList<qint64> dumpLatencies = {};
+    QList<qint64> reporterLatencies = {};
+    QList<qint64> dumpSizes = {};
+    QList<qint64> peakRss = {};
+    QList<qint64> handlerRss = {};
+    for (int i = 0; i != options.iterations; ++i) {
+        const QString runDir = options.workDir + QStringLiteral("/run-") + QString::number(i);
+        QDir(runDir).removeRecursively();
+        QDir().mkpath(runDir);
+        const QString stampFile = runDir + QStringLiteral("/reporter.stamp");
+        memset(shared, 0, sizeof(SharedState));
+
+        const pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return false;
+        }
+        if (pid == 0) {
+            crashChild(options, scenario, runDir, moduleDir, stampFile, shared);
+        }
+        int status = 0;
+        rusage usage = {};
+        while ((wait4(pid, &status, 0, &usage) == -1) && (errno == EINTR)) {
+        }
+
+        const qint64 reporterNs = readStamp(stampFile, 10000);
+        if ((reporterNs > 0) && (shared->faultNs > 0)) {
+            reporterLatencies.append(reporterNs - shared->faultNs);
+        }
+        const QFileInfo dump = findDump(runDir);
+        if (dump.exists() && (shared->faultRealtimeNs > 0)) {
+            struct stat st = {};
+            if (stat(QFile::encodeName(dump.absoluteFilePath()).constData(), &st) == 0) {
+                dumpLatencies.append((qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec)
+                                     - shared->faultRealtimeNs);
+            }
+            dumpSizes.append(dump.size());
+        }
+        peakRss.append(usage.ru_maxrss);
+        if (shared->highWaterMarkKb > 0) {
+            handlerRss.append(std::max<qint64>(0, usage.ru_maxrss - shared->highWaterMarkKb));
+        }
+    }
+
+    printf("fault=%s threads=%d heap=%dMB modules=%d max-threads=%d stack-limit=%dKB iterations=%d"
+           " emergency-reserve=%dKB alt-stack=%dKB dump-slots=%d slot=%dKB drain-slots=%s"
+           " corrupt-heap=%s daemon=%s\n",
+           faultName(scenario.fault),
+           scenario.threads,
+           scenario.heapMegabytes,
+           scenario.modules,
+           options.maxCapturedThreads,
+           options.stackLimitKilobytes,
+           options.iterations,
+           options.emergencyReserveKilobytes,
+           options.alternateStackKilobytes,
+           options.dumpSlots,
+           options.slotKilobytes,
+           options.drainSlots ? "yes" : "no",
+           options.corruptHeap ? "yes" : "no",
+           options.reporterDaemon ? "yes" : "no");
+    printStats("fault-to-dump", dumpLatencies, options.iterations, 1000.0, "us");
+    printStats("fault-to-reporter", reporterLatencies, options.iterations, 1000.0, "us");
+    printStats("dump-size", dumpSizes, options.iterations, 1024.0, "KB");
+    printStats("peak-rss", peakRss, options.iterations, 1024.0, "MB");
+    printStats("handler-rss", handlerRss, options.iterations, 1.0, "KB");
+    fflush(stdout);
+    if (options.drainSlots && (dumpSizes.size() != options.iterations)) {
+        fprintf(stderr,
+                "%d of %d crashes left no dump after the slot pool ran dry\n",
+                options.iterations - int(dumpSizes.size()),
+                options.iterations);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if ((argc >= 3) && (strcmp(argv[1], "--reporter-stamp") == 0)) {
+        const bool daemon = (argc >= 5) && (strcmp(argv[3], "--crash-channel-fd") == 0);
+        return runReporter(argv[2], daemon ? atoi(argv[4]) : -1);
+    }
+
+    Options options = {};
+    if (!parseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+
+    auto shared = static_cast<SharedState *>(
+        mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    for (const Fault fault : std::as_const(options.faults)) {
+        for (const int threads : std::as_const(options.threadCounts)) {
+            for (const int heapMegabytes : std::as_const(options.heapMegabytes)) {
+                for (const int modules : std::as_const(options.moduleCounts)) {
+                    ok = ok && runScenario(options, {fault, threads, heapMegabytes, modules}, shared);
+                }
+            }
+        }
+    }
+    munmap(shared, sizeof(SharedState));
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
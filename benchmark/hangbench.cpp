@@ -0,0 +1,207 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Measures what watching a thread with qbreakpad_watchThread() costs, and how
+// late a stall is noticed. "steady" bounces events through a worker's event loop
+// one at a time, so every event is a full pass of the loop and a heartbeat, the
+// most a watched thread ever pays; it runs unwatched and watched in turn and
+// reports the round trip per event. "stall" then blocks the watched worker once
+// and reports when the hang dump appeared in the dump directory.
+//
+//     hangbench --events 200000 --threshold 200 --stall-ms 1000
+
+#include "qbreakpad.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QList>
+#include <QMetaObject>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    int events = 200000;
+    int rounds = 5;
+    int threshold = 200;
+    int stallMilliseconds = 1000;
+    QString workDir = QDir::tempPath() + QStringLiteral("/qbreakpad-hangbench");
+};
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    bool ok = true;
+    for (int i = 1; ok && (i < argc); ++i) {
+        const bool hasValue = (i + 1) < argc;
+        if ((strcmp(argv[i], "--events") == 0) && hasValue) {
+            options.events = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--rounds") == 0) && hasValue) {
+            options.rounds = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--threshold") == 0) && hasValue) {
+            options.threshold = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--stall-ms") == 0) && hasValue) {
+            options.stallMilliseconds = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--work-dir") == 0) && hasValue) {
+            options.workDir = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || (options.events <= 0) || (options.rounds <= 0) || (options.threshold <= 0)
+        || (options.stallMilliseconds < 0)) {
+        fprintf(stderr,
+                "Usage: %s [--events N] [--rounds N] [--threshold MS] [--stall-ms MS]"
+                " [--work-dir DIR]\n",
+                argv[0]);
+        return false;
+    }
+    return true;
+}
+
+// Posts one event at a time and spins until the worker has run it, so the worker
+// blocks and wakes up for every event. Returns the mean round trip.
+double bounceEvents(QObject *target, int events)
+{
+    std::atomic<int> handled = 0;
+    const auto begin = Clock::now();
+    for (int i = 0; i != events; ++i) {
+        QMetaObject::invokeMethod(
+            target,
+            [&handled]() { handled.fetch_add(1, std::memory_order_release); },
+            Qt::QueuedConnection);
+        while (handled.load(std::memory_order_acquire) != (i + 1)) {
+        }
+    }
+    const auto elapsed = Clock::now() - begin;
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / events;
+}
+
+void runSteady(const Options &options, QThread *worker, QObject *target)
+{
+    QList<double> unwatched;
+    QList<double> watched;
+    for (int round = 0; round != options.rounds; ++round) {
+        qbreakpad_watchThread(worker, 0);
+        unwatched.append(bounceEvents(target, options.events));
+        qbreakpad_watchThread(worker, options.threshold);
+        watched.append(bounceEvents(target, options.events));
+    }
+    std::sort(unwatched.begin(), unwatched.end());
+    std::sort(watched.begin(), watched.end());
+    const double base = unwatched.at(unwatched.size() / 2);
+    const double cost = watched.at(watched.size() / 2);
+    printf("scenario=steady events=%d rounds=%d threshold=%dms\n",
+           options.events,
+           options.rounds,
+           options.threshold);
+    printf("  %-14s min=%.1fns p50=%.1fns\n", "unwatched", unwatched.first(), base);
+    printf("  %-14s min=%.1fns p50=%.1fns\n", "watched", watched.first(), cost);
+    printf("  %-14s %+.1fns (%+.2f%%)\n", "overhead", cost - base, ((cost - base) * 100.0) / base);
+}
+
+int countDumps(const QString &workDir)
+{
+    return QDir(workDir).entryList({QStringLiteral("*.dmp")}, QDir::Files).size();
+}
+
+bool runStall(const Options &options, QThread *worker, QObject *target)
+{
+    qbreakpad_watchThread(worker, options.threshold);
+    // Let the watchdog see the worker alive first.
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.threshold));
+    const int dumps = countDumps(options.workDir);
+    std::atomic<bool> done = false;
+    const int stall = options.stallMilliseconds;
+    const auto begin = Clock::now();
+    QMetaObject::invokeMethod(
+        target,
+        [&done, stall]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(stall));
+            done.store(true);
+        },
+        Qt::QueuedConnection);
+    qint64 detectedMs = -1;
+    while (!done.load()) {
+        if ((detectedMs == -1) && (countDumps(options.workDir) > dumps)) {
+            detectedMs = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin)
+                             .count();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // The dump may still be in progress when the stall ends.
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.threshold));
+    const int written = countDumps(options.workDir) - dumps;
+    printf("scenario=stall stall=%dms threshold=%dms\n", options.stallMilliseconds, options.threshold);
+    printf("  %-14s %d\n", "hang-dumps", written);
+    if (detectedMs != -1) {
+        printf("  %-14s %lldms\n", "detected-after", static_cast<long long>(detectedMs));
+    }
+    // A stall shorter than the threshold must not be dumped, a longer one exactly once.
+    return written == ((options.stallMilliseconds > options.threshold) ? 1 : 0);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    Options options = {};
+    if (!parseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+    QDir(options.workDir).removeRecursively();
+    QDir().mkpath(options.workDir);
+    qbreakpad_initCrashHandler(options.workDir);
+    qbreakpad_setHangDumpInterval(0);
+
+    QThread worker;
+    worker.setObjectName(QStringLiteral("hangbench worker"));
+    worker.start();
+    QObject target;
+    target.moveToThread(&worker);
+
+    runSteady(options, &worker, &target);
+    const bool ok = runStall(options, &worker, &target);
+    if (!ok) {
+        fprintf(stderr, "Unexpected number of hang dumps\n");
+    }
+
+    qbreakpad_watchThread(&worker, 0);
+    worker.quit();
+    worker.wait();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,286 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Compares how long a live dump stalls the process: qbreakpad_writeMiniDump(),
+// which suspends every thread while the dump is written, against
+// qbreakpad_writeSnapshotDump(), which only stops them for the fork(). Reported are
+// the stall of the calling thread, the longest gap a busy "serving" thread saw,
+// the time until the dump file was complete, and its size. For snapshots the part
+// of the stall spent signalling the other threads and waiting for them to stop is
+// reported on its own, as thread-freeze: a thread that blocks the signal makes it
+// the full 200 ms timeout. The heap is touched in full, so fork() has real page
+// tables to copy.
+//
+//     snapshotbench --heap-mb 4096 --threads 32
+
+#include "qbreakpad.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QFileInfo>
+#include <QList>
+#include <QString>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    int iterations = 5;
+    int heapMegabytes = 4096;
+    int threads = 16;
+    QString workDir = QDir::tempPath() + QStringLiteral("/qbreakpad-snapshotbench");
+};
+
+struct Sample
+{
+    qint64 stallUs = 0;
+    qint64 freezeUs = 0;
+    qint64 maxGapUs = 0;
+    qint64 completeUs = 0;
+    qint64 dumpBytes = 0;
+};
+
+// Stands in for a thread serving requests: records the longest time between two
+// iterations of a short busy loop.
+class Ticker
+{
+public:
+    Ticker()
+        : m_thread([this]() { run(); })
+    {}
+
+    ~Ticker()
+    {
+        m_stop.store(true);
+        m_thread.join();
+    }
+
+    void reset() { m_maxGapNs.store(0); }
+    qint64 maxGapUs() const { return m_maxGapNs.load() / 1000; }
+
+private:
+    void run()
+    {
+        auto last = Clock::now();
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            const auto now = Clock::now();
+            const qint64 gap = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+            if (gap > m_maxGapNs.load(std::memory_order_relaxed)) {
+                m_maxGapNs.store(gap, std::memory_order_relaxed);
+            }
+            last = now;
+        }
+    }
+
+    std::atomic<bool> m_stop = false;
+    std::atomic<qint64> m_maxGapNs = 0;
+    std::thread m_thread;
+};
+
+struct Completion
+{
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done = false;
+    bool succeeded = false;
+    QString filePath = {};
+    Clock::time_point time = {};
+};
+
+void onDumpWritten(bool succeeded, const QString &filePath, void *context)
+{
+    auto completion = static_cast<Completion *>(context);
+    const std::lock_guard<std::mutex> locker(completion->mutex);
+    completion->done = true;
+    completion->succeeded = succeeded;
+    completion->filePath = filePath;
+    completion->time = Clock::now();
+    completion->condition.notify_all();
+}
+
+qint64 elapsedUs(Clock::time_point begin, Clock::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+}
+
+bool runOnce(bool snapshot, Ticker &ticker, Sample *sample)
+{
+    ticker.reset();
+    Completion completion;
+    const auto begin = Clock::now();
+    bool ok = false;
+    if (snapshot) {
+        ok = qbreakpad_writeSnapshotDump(onDumpWritten, &completion);
+    } else {
+        ok = qbreakpad_writeMiniDump();
+    }
+    const auto returned = Clock::now();
+    if (!ok) {
+        return false;
+    }
+    sample->stallUs = elapsedUs(begin, returned);
+    if (snapshot) {
+        sample->freezeUs = qbreakpad_lastSnapshotFreezeTime();
+        std::unique_lock<std::mutex> locker(completion.mutex);
+        completion.condition.wait(locker, [&completion]() { return completion.done; });
+        if (!completion.succeeded) {
+            return false;
+        }
+        sample->completeUs = elapsedUs(begin, completion.time);
+        sample->dumpBytes = QFileInfo(completion.filePath).size();
+    } else {
+        sample->completeUs = sample->stallUs;
+    }
+    // Let the ticker run again before reading it.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    sample->maxGapUs = ticker.maxGapUs();
+    return true;
+}
+
+void printStats(const char *name, QList<qint64> values, const char *unit)
+{
+    std::sort(values.begin(), values.end());
+    printf("  %-14s min=%lld%s p50=%lld%s max=%lld%s\n",
+           name,
+           static_cast<long long>(values.first()),
+           unit,
+           static_cast<long long>(values.at(values.size() / 2)),
+           unit,
+           static_cast<long long>(values.last()),
+           unit);
+}
+
+bool runMode(const Options &options, bool snapshot, Ticker &ticker)
+{
+    QList<qint64> stalls;
+    QList<qint64> freezes;
+    QList<qint64> gaps;
+    QList<qint64> completions;
+    QList<qint64> sizes;
+    for (int i = 0; i != options.iterations; ++i) {
+        Sample sample = {};
+        if (!runOnce(snapshot, ticker, &sample)) {
+            fprintf(stderr, "Writing the dump failed\n");
+            return false;
+        }
+        stalls.append(sample.stallUs);
+        freezes.append(sample.freezeUs);
+        gaps.append(sample.maxGapUs);
+        completions.append(sample.completeUs);
+        sizes.append(sample.dumpBytes / 1024);
+    }
+    printf("mode=%s heap=%dMB threads=%d iterations=%d\n",
+           snapshot ? "snapshot" : "in-process",
+           options.heapMegabytes,
+           options.threads,
+           options.iterations);
+    printStats("caller-stall", stalls, "us");
+    if (snapshot) {
+        printStats("thread-freeze", freezes, "us");
+    }
+    printStats("serving-gap", gaps, "us");
+    printStats("dump-complete", completions, "us");
+    if (snapshot) {
+        printStats("dump-size", sizes, "KB");
+    }
+    return true;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    bool ok = true;
+    for (int i = 1; ok && (i < argc); ++i) {
+        const bool hasValue = (i + 1) < argc;
+        if ((strcmp(argv[i], "--iterations") == 0) && hasValue) {
+            options.iterations = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--heap-mb") == 0) && hasValue) {
+            options.heapMegabytes = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--threads") == 0) && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--work-dir") == 0) && hasValue) {
+            options.workDir = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || (options.iterations <= 0) || (options.heapMegabytes < 0) || (options.threads < 0)) {
+        fprintf(stderr,
+                "Usage: %s [--iterations N] [--heap-mb N] [--threads N] [--work-dir DIR]\n",
+                argv[0]);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options = {};
+    if (!parseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+    QDir(options.workDir).removeRecursively();
+    QDir().mkpath(options.workDir);
+    qbreakpad_initCrashHandler(options.workDir);
+
+    std::vector<char> heap(size_t(options.heapMegabytes) * 1024 * 1024);
+    for (size_t i = 0; i < heap.size(); i += 4096) {
+        heap[i] = char(i);
+    }
+
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> idleThreads;
+    for (int i = 0; i != options.threads; ++i) {
+        idleThreads.emplace_back([&stop]() {
+            while (!stop.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        });
+    }
+
+    bool ok = true;
+    {
+        Ticker ticker;
+        ok = runMode(options, false, ticker) && runMode(options, true, ticker);
+    }
+    stop.store(true);
+    for (std::thread &thread : idleThreads) {
+        thread.join();
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
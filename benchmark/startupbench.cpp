@@ -0,0 +1,293 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Measures how long crash handler setup keeps main() from getting on with the
+// application. Every variant is timed over the setup plus all of the settings an
+// application makes, the reporter path and arguments included. "sync" is
+// qbreakpad_initCrashHandler() after the settings; "two-phase" is
+// qbreakpad_installCrashHandler(), the settings and qbreakpad_initCrashHandlerAsync(),
+// which leaves the directory setup and the optional subsystems to another thread.
+// "late-settings" makes the settings after qbreakpad_initCrashHandlerAsync(), where
+// they are queued for the setup thread. All are also timed until setup has fully
+// finished with the queued settings applied, and the two-phase variants are printed
+// as the difference to sync. "early-crash" faults right after
+// qbreakpad_installCrashHandler() and checks that the dump landed in the fallback
+// directory. Every round runs in a fresh child, with the dump directory removed
+// beforehand.
+//
+//     startupbench --rounds 20 --retention-count 100 --compression-level 3
+
+#include "qbreakpad.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Mode { Sync, TwoPhase, LateSettings };
+
+struct Options
+{
+    int rounds = 20;
+    int retentionCount = 100;
+    int compressionLevel = 0;
+    bool memoryMonitor = true;
+    QString workDir = QDir::tempPath() + QStringLiteral("/qbreakpad-startupbench");
+};
+
+// Filled in by the children.
+struct SharedState
+{
+    qint64 blockedNs;
+    qint64 finishedNs;
+};
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    bool ok = true;
+    for (int i = 1; ok && (i < argc); ++i) {
+        const bool hasValue = (i + 1) < argc;
+        if ((strcmp(argv[i], "--rounds") == 0) && hasValue) {
+            options.rounds = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--retention-count") == 0) && hasValue) {
+            options.retentionCount = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--compression-level") == 0) && hasValue) {
+            options.compressionLevel = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-memory-monitor") == 0) {
+            options.memoryMonitor = false;
+        } else if ((strcmp(argv[i], "--work-dir") == 0) && hasValue) {
+            options.workDir = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || (options.rounds <= 0)) {
+        fprintf(stderr,
+                "Usage: %s [--rounds N] [--retention-count N] [--compression-level N]"
+                " [--no-memory-monitor] [--work-dir DIR]\n",
+                argv[0]);
+        return false;
+    }
+    return true;
+}
+
+qint64 elapsedNs(Clock::time_point begin)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+}
+
+// The settings an application makes around setting up the handler.
+void configure(const Options &options)
+{
+    qbreakpad_setReporterPath(options.workDir + QStringLiteral("/reporter"));
+    qbreakpad_setReporterCommonArguments(
+        {QStringLiteral("--product"), QStringLiteral("startupbench")});
+    qbreakpad_setReporterDumpFileArgument(QStringLiteral("--dump"));
+    qbreakpad_setReporterLogFileArgument(QStringLiteral("--log"));
+    qbreakpad_setLogFilePath(options.workDir + QStringLiteral("/startupbench.log"));
+    qbreakpad_setDumpCompressionLevel(options.compressionLevel);
+    qbreakpad_setDumpRetentionMaxCount(options.retentionCount);
+    if (options.memoryMonitor) {
+        qbreakpad_setMemoryDumpLimitPercent(90);
+    }
+}
+
+[[noreturn]] void startupChild(const Options &options, Mode mode, SharedState *shared)
+{
+    const QString dumpDir = options.workDir + QStringLiteral("/dumps");
+    const QByteArray fallbackDir = QFile::encodeName(options.workDir + QStringLiteral("/fallback"));
+    const auto begin = Clock::now();
+    if (mode == Mode::Sync) {
+        configure(options);
+        qbreakpad_initCrashHandler(dumpDir);
+    } else if (mode == Mode::TwoPhase) {
+        qbreakpad_installCrashHandler(fallbackDir.constData());
+        configure(options);
+        qbreakpad_initCrashHandlerAsync(dumpDir);
+    } else {
+        qbreakpad_installCrashHandler(fallbackDir.constData());
+        qbreakpad_initCrashHandlerAsync(dumpDir);
+        configure(options);
+    }
+    shared->blockedNs = elapsedNs(begin);
+    qbreakpad_waitForCrashHandler();
+    shared->finishedNs = elapsedNs(begin);
+    // Static destruction would stop the worker threads, which is not part of startup.
+    _exit(EXIT_SUCCESS);
+}
+
+[[noreturn]] void earlyCrashChild(const Options &options)
+{
+    const QByteArray fallbackDir = QFile::encodeName(options.workDir + QStringLiteral("/fallback"));
+    qbreakpad_installCrashHandler(fallbackDir.constData());
+    *static_cast<volatile int *>(nullptr) = 0;
+    _exit(EXIT_FAILURE);
+}
+
+bool runChild(const Options &options, Mode mode, SharedState *shared, bool crash)
+{
+    QDir(options.workDir).removeRecursively();
+    QDir().mkpath(options.workDir + QStringLiteral("/fallback"));
+    memset(shared, 0, sizeof(SharedState));
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        if (crash) {
+            earlyCrashChild(options);
+        }
+        startupChild(options, mode, shared);
+    }
+    int status = 0;
+    while ((waitpid(pid, &status, 0) == -1) && (errno == EINTR)) {
+    }
+    return crash || (WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS));
+}
+
+void printStats(const char *name, QList<qint64> values)
+{
+    std::sort(values.begin(), values.end());
+    printf("  %-18s min=%.1fus p50=%.1fus max=%.1fus\n",
+           name,
+           double(values.first()) / 1000.0,
+           double(values.at(values.size() / 2)) / 1000.0,
+           double(values.last()) / 1000.0);
+}
+
+const char *modeName(Mode mode)
+{
+    switch (mode) {
+    case Mode::Sync:
+        return "sync";
+    case Mode::TwoPhase:
+        return "two-phase";
+    case Mode::LateSettings:
+        return "late-settings";
+    }
+    return "";
+}
+
+qint64 median(QList<qint64> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+
+// The median of each measurement.
+struct Result
+{
+    qint64 blockedNs = 0;
+    qint64 finishedNs = 0;
+};
+
+void printDifference(const char *name, qint64 valueNs, qint64 baselineNs)
+{
+    printf("  %-18s %+.1fus (%+.1f%%)\n",
+           name,
+           double(valueNs - baselineNs) / 1000.0,
+           (baselineNs > 0) ? (100.0 * double(valueNs - baselineNs) / double(baselineNs)) : 0.0);
+}
+
+bool runMode(const Options &options, Mode mode, SharedState *shared, Result *result)
+{
+    QList<qint64> blocked = {};
+    QList<qint64> finished = {};
+    for (int round = 0; round != options.rounds; ++round) {
+        if (!runChild(options, mode, shared, false)) {
+            fprintf(stderr, "A startup child failed\n");
+            return false;
+        }
+        blocked.append(shared->blockedNs);
+        finished.append(shared->finishedNs);
+    }
+    printf("mode=%s rounds=%d\n", modeName(mode), options.rounds);
+    printStats("main-thread", blocked);
+    printStats("until-finished", finished);
+    result->blockedNs = median(blocked);
+    result->finishedNs = median(finished);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options = {};
+    if (!parseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+    auto shared = static_cast<SharedState *>(
+        mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    printf("retention-count=%d compression-level=%d memory-monitor=%s\n",
+           options.retentionCount,
+           options.compressionLevel,
+           options.memoryMonitor ? "yes" : "no");
+    Result sync = {};
+    if (!runMode(options, Mode::Sync, shared, &sync)) {
+        return EXIT_FAILURE;
+    }
+    for (const Mode mode : {Mode::TwoPhase, Mode::LateSettings}) {
+        Result result = {};
+        if (!runMode(options, mode, shared, &result)) {
+            return EXIT_FAILURE;
+        }
+        // Negative is faster than sync.
+        printf("difference=%s-vs-sync p50\n", modeName(mode));
+        printDifference("main-thread", result.blockedNs, sync.blockedNs);
+        printDifference("until-finished", result.finishedNs, sync.finishedNs);
+    }
+
+    runChild(options, Mode::TwoPhase, shared, true);
+    const QStringList fallbackDumps = QDir(options.workDir + QStringLiteral("/fallback"))
+                                          .entryList({QStringLiteral("*.dmp")}, QDir::Files);
+    printf("scenario=early-crash\n");
+    printf("  %-18s %d\n", "fallback-dumps", int(fallbackDumps.size()));
+    QDir(options.workDir).removeRecursively();
+    if (fallbackDumps.isEmpty()) {
+        fprintf(stderr, "No dump for a crash before qbreakpad_initCrashHandlerAsync()\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Uploads a directory of fake dumps through the QBreakpad uploader to a local HTTP
+// stand-in server and reports how long it took, how many requests and retries were
+// needed, the effective bandwidth and the highest number of concurrent requests.
+// The server can be told to fail every Nth request to exercise the retry path.
+
+#include "qbreakpad.h"
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QString>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+struct Options
+{
+    int dumps = 32;
+    int dumpKilobytes = 256;
+    int batchSize = 4;
+    int concurrency = 2;
+    qint64 bandwidthLimit = 0;
+    int failEvery = 0;
+    QString workDir = QDir::tempPath() + QStringLiteral("/qbreakpad-uploadbench");
+};
+
+struct ServerStats
+{
+    int requests = 0;
+    int failedRequests = 0;
+    int activeRequests = 0;
+    int peakRequests = 0;
+    qint64 bytes = 0;
+    QSet<QByteArray> receivedFiles = {};
+};
+
+class StandInServer
+{
+public:
+    explicit StandInServer(const Options &options, ServerStats *stats)
+        : m_options(options)
+        , m_stats(stats)
+    {
+        QObject::connect(&m_server, &QTcpServer::newConnection, &m_server, [this]() {
+            while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+                QObject::connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() {
+                    handleData(socket);
+                });
+                QObject::connect(socket, &QTcpSocket::disconnected, socket, [this, socket]() {
+                    if (!m_buffers.take(socket).isEmpty()) {
+                        --m_stats->activeRequests;
+                    }
+                    socket->deleteLater();
+                });
+            }
+        });
+    }
+
+    bool listen() { return m_server.listen(QHostAddress::LocalHost); }
+    quint16 port() const { return m_server.serverPort(); }
+
+private:
+    void handleData(QTcpSocket *socket)
+    {
+        QByteArray &buffer = m_buffers[socket];
+        if (buffer.isEmpty()) {
+            m_stats->peakRequests = std::max(m_stats->peakRequests, ++m_stats->activeRequests);
+        }
+        buffer.append(socket->readAll());
+        const qsizetype headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            return;
+        }
+        qint64 contentLength = 0;
+        for (const QByteArray &line : buffer.left(headerEnd).split('\n')) {
+            if (line.toLower().startsWith("content-length:")) {
+                contentLength = line.mid(15).trimmed().toLongLong();
+            }
+        }
+        const qint64 requestSize = headerEnd + 4 + contentLength;
+        if (buffer.size() < requestSize) {
+            return;
+        }
+        const QByteArray body = buffer.mid(headerEnd + 4, contentLength);
+        buffer = buffer.mid(requestSize);
+        --m_stats->activeRequests;
+        if (!buffer.isEmpty()) {
+            m_stats->peakRequests = std::max(m_stats->peakRequests, ++m_stats->activeRequests);
+        }
+
+        ++m_stats->requests;
+        m_stats->bytes += requestSize;
+        if ((m_options.failEvery > 0) && ((m_stats->requests % m_options.failEvery) == 0)) {
+            ++m_stats->failedRequests;
+            socket->write("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n");
+            return;
+        }
+        for (qsizetype from = body.indexOf("filename=\""); from >= 0;
+             from = body.indexOf("filename=\"", from)) {
+            from += 10;
+            m_stats->receivedFiles.insert(body.mid(from, body.indexOf('"', from) - from));
+        }
+        socket->write("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+    }
+
+    const Options m_options;
+    ServerStats *const m_stats;
+    QTcpServer m_server;
+    QHash<QTcpSocket *, QByteArray> m_buffers = {};
+};
+
+bool createDumps(const Options &options)
+{
+    QDir(options.workDir).removeRecursively();
+    if (!QDir().mkpath(options.workDir)) {
+        return false;
+    }
+    QByteArray content(options.dumpKilobytes * 1024, '\0');
+    for (int i = 0; i != options.dumps; ++i) {
+        for (char &c : content) {
+            c = char(QRandomGenerator::global()->generate());
+        }
+        QFile file(options.workDir + QStringLiteral("/dump-") + QString::number(i)
+                   + QStringLiteral(".dmp"));
+        if (!file.open(QIODevice::WriteOnly) || (file.write(content) != content.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray argument = argv[i];
+        const bool hasValue = (i + 1) < argc;
+        if ((argument == "--dumps") && hasValue) {
+            options.dumps = atoi(argv[++i]);
+        } else if ((argument == "--dump-kb") && hasValue) {
+            options.dumpKilobytes = atoi(argv[++i]);
+        } else if ((argument == "--batch") && hasValue) {
+            options.batchSize = atoi(argv[++i]);
+        } else if ((argument == "--concurrency") && hasValue) {
+            options.concurrency = atoi(argv[++i]);
+        } else if ((argument == "--bandwidth-kb") && hasValue) {
+            options.bandwidthLimit = qint64(atoi(argv[++i])) * 1024;
+        } else if ((argument == "--fail-every") && hasValue) {
+            options.failEvery = atoi(argv[++i]);
+        } else if ((argument == "--work-dir") && hasValue) {
+            options.workDir = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [--dumps N] [--dump-kb N] [--batch N] [--concurrency N]"
+                    " [--bandwidth-kb N] [--fail-every N] [--work-dir DIR]\n",
+                    argv[0]);
+            return false;
+        }
+    }
+    return options.dumps > 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    Options options = {};
+    if (!parseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+    if (!createDumps(options)) {
+        fprintf(stderr, "Failed to create the dumps in %s\n", qPrintable(options.workDir));
+        return EXIT_FAILURE;
+    }
+
+    ServerStats stats = {};
+    StandInServer server(options, &stats);
+    if (!server.listen()) {
+        fprintf(stderr, "Failed to start the stand-in server\n");
+        return EXIT_FAILURE;
+    }
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    qbreakpad_setUploadUrl(QStringLiteral("http://127.0.0.1:%1/upload").arg(server.port()));
+    qbreakpad_setUploadBatchSize(options.batchSize);
+    qbreakpad_setUploadConcurrency(options.concurrency);
+    qbreakpad_setUploadBandwidthLimit(options.bandwidthLimit);
+    qbreakpad_setUploadRetryDelay(100);
+    qbreakpad_initCrashHandler(options.workDir);
+
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &poll, [&]() {
+        if ((stats.receivedFiles.size() >= options.dumps) || (elapsed.elapsed() > 5 * 60 * 1000)) {
+            QCoreApplication::quit();
+        }
+    });
+    poll.start(10);
+    QCoreApplication::exec();
+
+    const double seconds = elapsed.nsecsElapsed() / 1e9;
+    printf("dumps=%d size=%dKB batch=%d concurrency=%d bandwidth=%lldKB/s fail-every=%d\n",
+           options.dumps,
+           options.dumpKilobytes,
+           options.batchSize,
+           options.concurrency,
+           static_cast<long long>(options.bandwidthLimit / 1024),
+           options.failEvery);
+    printf("uploaded=%d/%d requests=%d failed=%d peak-concurrency=%d time=%.2fs rate=%.1fKB/s\n",
+           int(stats.receivedFiles.size()),
+           options.dumps,
+           stats.requests,
+           stats.failedRequests,
+           stats.peakRequests,
+           seconds,
+           (stats.bytes / 1024.0) / seconds);
+    return (stats.receivedFiles.size() >= options.dumps) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -23,16 +23,62 @@
  */
 
 #include "qbreakpad.h"
+#include "qbreakpad_annotations_p.h"
+#include "qbreakpad_asyncdump_p.h"
+#include "qbreakpad_breadcrumbs_p.h"
+#include "qbreakpad_logtail_p.h"
+#include "qbreakpad_retention_p.h"
+#include "qbreakpad_watchdog_p.h"
+#ifdef QBREAKPAD_HAS_UPLOADER
+#include "qbreakpad_uploader_p.h"
+#endif
 
 #include <QDebug>
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
+#include <QMutex>
 #include <QProcess>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
 #ifdef Q_OS_WINDOWS
 #include "windowsdllinterceptor.h"
 #include <client/windows/handler/exception_handler.h>
 #elif defined(Q_OS_LINUX)
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <client/linux/crash_generation/crash_generation_server.h>
 #include <client/linux/handler/exception_handler.h>
+#include <common/linux/linux_libc_support.h>
+#include <memory>
+#ifdef QBREAKPAD_HAS_ZSTD
+#include "qbreakpad_compressor_p.h"
+#endif
+#include "qbreakpad_dumper_p.h"
+#include "qbreakpad_emergency_p.h"
+#include "qbreakpad_index_p.h"
+#include "qbreakpad_memfd_p.h"
+#include "qbreakpad_memory_p.h"
+#include "qbreakpad_signature_p.h"
+#include "qbreakpad_slots_p.h"
+#include "qbreakpad_snapshot_p.h"
+#include "qbreakpad_stats_p.h"
+#include "qbreakpad_streams_p.h"
+#include <QUuid>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #elif defined(Q_OS_MACOS)
 #include <client/mac/handler/exception_handler.h>
 #endif
@@ -44,6 +90,40 @@ QString m_reporterPath = {}, m_dumpDirPath = {}, m_logFilePath = {}, m_dumpFileA
         m_logFileArgument = {}, m_dumpFileExtName = QString::fromUtf8(".dmp");
 QStringList m_crashReporterArguments = {};
 bool m_reportCrashesToSystem = false;
+int m_dumpCompressionLevel = 0;
+qint64 m_dumpSizeLimit = 0;
+bool m_microdumpEnabled = false;
+bool m_sanitizeStacks = false;
+QByteArray m_microdumpProductInfo = {};
+quintptr m_principalMappingAddress = 0;
+QString m_lastDumpFilePath = {};
+// Set by qbreakpad_installCrashHandler(), whose handler qbreakpad_initCrashHandler()
+// then only has to point at the dump directory.
+bool m_earlyCrashHandler = false;
+qint64 m_retentionMaxBytes = 0;
+int m_retentionMaxCount = 0;
+int m_retentionMaxAge = 0;
+QScopedPointer<qbreakpad::DumpRetention> m_dumpRetention;
+qbreakpad::AsyncDumpPolicy m_asyncDumpPolicy = {};
+QScopedPointer<qbreakpad::AsyncDumper> m_asyncDumper;
+int m_hangDumpInterval = 600;
+QScopedPointer<qbreakpad::HangWatchdog> m_hangWatchdog;
+#ifdef Q_OS_LINUX
+qbreakpad::MemoryPolicy m_memoryPolicy = {};
+QScopedPointer<qbreakpad::MemoryMonitor> m_memoryMonitor;
+qbreakpad::DumpIndex m_dumpIndex;
+qbreakpad::CrashStats m_crashStats;
+// Set when a crash or a requested dump starts, DumpCallback() takes the dump write
+// time from it.
+qint64 m_crashDumpStartTime = 0;
+// Guards the path only; writers of the file do not wait for each other.
+QMutex m_statsTextFileMutex;
+QString m_statsTextFilePath = {};
+#endif
+#ifdef QBREAKPAD_HAS_UPLOADER
+qbreakpad::UploadPolicy m_uploadPolicy = {};
+QScopedPointer<qbreakpad::DumpUploader> m_dumpUploader;
+#endif
 
 #ifdef Q_OS_WINDOWS
 WindowsDllInterceptor m_kernel32Intercept;
@@ -75,200 +155,2556 @@ SetUnhandledExceptionFilterPatched(LPTOP_LEVEL_EXCEPTION_FILTER lpTopLevelExcept
 }
 #endif
 
-#ifdef Q_OS_WINDOWS
-bool DumpCallback(LPCWSTR _dump_dir,
-                  LPCWSTR _minidump_id,
-                  LPVOID context,
-                  LPEXCEPTION_POINTERS exinfo,
-                  MDRawAssertionInfo *assertion,
-                  bool succeeded)
-#elif defined(Q_OS_LINUX)
-bool DumpCallback(const google_breakpad::MinidumpDescriptor &md, void *context, bool succeeded)
-#elif defined(Q_OS_MACOS)
-bool DumpCallback(const char *_dump_dir, const char *_minidump_id, void *context, bool succeeded)
+QStringList dumpNameFilters()
+{
+    QStringList nameFilters = {QString::fromUtf8("*.dmp"), QString::fromUtf8("*.dmp.zst")};
+    if (m_dumpFileExtName != QString::fromUtf8(".dmp")) {
+        nameFilters << QChar::fromLatin1('*') + m_dumpFileExtName
+                    << QChar::fromLatin1('*') + m_dumpFileExtName + QString::fromUtf8(".zst");
+    }
+    return nameFilters;
+}
+
+void startDumpRetention(const QString &dirPath)
+{
+    if (!m_dumpRetention.isNull() || dirPath.isEmpty()) {
+        return;
+    }
+    if ((m_retentionMaxBytes <= 0) && (m_retentionMaxCount <= 0) && (m_retentionMaxAge <= 0)) {
+        return;
+    }
+    m_dumpRetention.reset(new qbreakpad::DumpRetention(dirPath, dumpNameFilters()));
+    m_dumpRetention->setPolicy(m_retentionMaxBytes, m_retentionMaxCount, m_retentionMaxAge);
+    m_dumpRetention->start(QThread::LowPriority);
+}
+
+void updateDumpRetention()
+{
+    if (m_dumpRetention.isNull()) {
+        startDumpRetention(m_dumpDirPath);
+    } else {
+        m_dumpRetention->setPolicy(m_retentionMaxBytes, m_retentionMaxCount, m_retentionMaxAge);
+    }
+}
+
+#ifdef QBREAKPAD_HAS_UPLOADER
+void startDumpUploader(const QString &dirPath)
+{
+    if (!m_dumpUploader.isNull() || dirPath.isEmpty() || m_uploadPolicy.url.isEmpty()) {
+        return;
+    }
+    m_dumpUploader.reset(new qbreakpad::DumpUploader(dirPath, dumpNameFilters()));
+    m_dumpUploader->setPolicy(m_uploadPolicy);
+    m_dumpUploader->start(QThread::LowPriority);
+}
+
+void updateDumpUploader()
+{
+    if (m_dumpUploader.isNull()) {
+        startDumpUploader(m_dumpDirPath);
+    } else {
+        m_dumpUploader->setPolicy(m_uploadPolicy);
+    }
+}
 #endif
+
+#ifdef Q_OS_LINUX
+// The process that crashed cannot write it, so this also runs once the handler is
+// set up, with the numbers the last crash left in qbreakpad.stats.
+void writeStatsTextFile()
 {
-    Q_UNUSED(context)
-#ifdef Q_OS_WINDOWS
-    Q_UNUSED(exinfo)
-    Q_UNUSED(assertion)
+    QString filePath = {};
+    {
+        const QMutexLocker locker(&m_statsTextFileMutex);
+        filePath = m_statsTextFilePath;
+    }
+    qbreakpad::CrashStatsData data = {};
+    if (filePath.isEmpty() || !m_crashStats.read(&data)) {
+        return;
+    }
+    if (!qbreakpad::CrashStats::writeTextFile(filePath, data)) {
+        qWarning().noquote() << "Failed to write the crash statistics to" << filePath;
+    }
+}
 #endif
-    if (QFileInfo::exists(m_reporterPath)) {
-#ifdef Q_OS_WINDOWS
-        const QString dumpFilePath = QString::fromWCharArray(_dump_dir) + QDir::separator()
-                                     + QString::fromWCharArray(_minidump_id) + m_dumpFileExtName;
-#elif defined(Q_OS_LINUX)
-        const QString dumpFilePath = QString::fromUtf8(md.path());
-#elif defined(Q_OS_MACOS)
-        const QString dumpFilePath = QString::fromUtf8(_dump_dir) + QDir::separator()
-                                     + QString::fromUtf8(_minidump_id) + m_dumpFileExtName;
+
+void announceDump(const QString &filePath)
+{
+    if (filePath.isEmpty()) {
+        return;
+    }
+    if (!m_dumpRetention.isNull()) {
+        m_dumpRetention->addDump(filePath);
+    }
+#ifdef QBREAKPAD_HAS_UPLOADER
+    if (!m_dumpUploader.isNull()) {
+        m_dumpUploader->addDump(filePath);
+    }
 #endif
-        if (!m_dumpFileArgument.isEmpty()) {
-            m_crashReporterArguments.append(m_dumpFileArgument);
+#ifdef Q_OS_LINUX
+    // Room for the next crash.
+    m_dumpIndex.reserve();
+    writeStatsTextFile();
+#endif
+}
+
+#ifdef Q_OS_LINUX
+// For dumps that were not written through DumpCallback().
+void recordDump(const QString &filePath, qint64 pid)
+{
+    const QFileInfo fileInfo(filePath);
+    m_dumpIndex.append(QFile::encodeName(fileInfo.fileName()).constData(),
+                       qbreakpad::DumpIndex::Written,
+                       fileInfo.size(),
+                       0,
+                       pid);
+    m_crashStats.add(qbreakpad::CrashStats::DumpsWritten);
+    m_crashStats.add(qbreakpad::CrashStats::BytesWritten, quint64(fileInfo.size()));
+}
+
+// Async-signal-safe. Daemon notifications count as a start, the reporter has the
+// dump from then on.
+void recordReporterStart(qbreakpad::CrashStats::Counter counter, qint64 startTime)
+{
+    m_crashStats.add(counter);
+    if (counter != qbreakpad::CrashStats::ReporterLaunchFailures) {
+        m_crashStats.record(qbreakpad::CrashStats::ReporterStartTime, startTime);
+    }
+}
+#endif
+
+#ifdef Q_OS_LINUX
+// Everything the crash path needs to start the reporter is prepared here whenever
+// one of the setters changes, so that DumpCallback() only has to copy the dump file
+// path into a static buffer and call clone()/execve(). No heap, no locks, no Qt.
+constexpr int kReporterMaxArguments = 128;
+constexpr int kReporterMaxEnvironment = 512;
+constexpr size_t kReporterBufferSize = 64 * 1024;
+constexpr size_t kReporterStackSize = 16 * 1024;
+constexpr size_t kReporterDaemonMessageSize = 3 * PATH_MAX + 96;
+// Added to the reporter's environment when not all of ours fit.
+constexpr char kReporterEnvironmentTruncated[] = "QBREAKPAD_ENVIRONMENT_TRUNCATED=1";
+
+struct ReporterLaunchData
+{
+    std::unique_ptr<char[]> buffer = {};
+    char *argv[kReporterMaxArguments + 1] = {};
+    char *envp[kReporterMaxEnvironment + 1] = {};
+    int inheritedFd = -1;
+    bool valid = false;
+};
+
+ReporterLaunchData m_reporterDaemonLaunchData = {};
+char m_crashDumpFilePath[PATH_MAX] = {};
+// Where crashes go between qbreakpad_installCrashHandler() and the end of
+// qbreakpad_initCrashHandler().
+std::string m_fallbackDumpDirPath = {};
+char m_crashAnnotationFilePath[PATH_MAX] = {};
+// One launch at a time, see launchReporter().
+std::atomic<pid_t> m_reporterLauncher = 0;
+volatile int m_reporterExecErrno = 0;
+alignas(16) char m_reporterChildStack[kReporterStackSize] = {};
+alignas(16) char m_reporterGrandchildStack[kReporterStackSize] = {};
+
+bool m_reporterDaemonEnabled = false;
+QString m_reporterDaemonArgument = QString::fromUtf8("--crash-channel-fd");
+int m_reporterDaemonFd = -1;
+char m_reporterDaemonMessage[kReporterDaemonMessageSize] = {};
+
+// With an in-memory dump, m_crashDumpFilePath is only the name the dump gets if it
+// has to go to disk after all, see finishInMemoryDump().
+qint64 m_inMemoryDumpSize = 0;
+bool m_inMemoryDumpDiskFallback = true;
+qbreakpad::InMemoryDump m_inMemoryDump;
+char m_inMemoryDumpFilePath[PATH_MAX] = {};
+bool m_crashDumpInMemory = false;
+bool m_crashDumpHandedOver = false;
+
+// The slot the next dump goes into; set with m_crashConfigMutex held and published
+// with the crash config.
+int m_dumpSlotCount = 0;
+qint64 m_dumpSlotSize = 0;
+QScopedPointer<qbreakpad::DumpSlotPool> m_dumpSlotPool;
+int m_dumpSlotFd = -1;
+char m_dumpSlotFilePath[PATH_MAX] = {};
+char m_dumpSlotTargetPath[PATH_MAX] = {};
+bool m_crashDumpInSlot = false;
+
+// Packs arguments and a copy of the environment into data. The entry at
+// placeholderIndex is not copied; it points to placeholder instead, which the
+// crash path fills in right before the launch. Environment entries that do not fit
+// are left out as a whole, and the reporter gets kReporterEnvironmentTruncated.
+bool buildLaunchData(ReporterLaunchData &data,
+                     const QList<QByteArray> &arguments,
+                     int placeholderIndex = -1,
+                     char *placeholder = nullptr)
+{
+    data.valid = false;
+    if (arguments.size() > kReporterMaxArguments) {
+        qWarning().noquote() << "Too many crash reporter arguments.";
+        return false;
+    }
+
+    // Sized to fit, the buffer is kept alive for as long as the data may be used.
+    size_t bufferSize = 0;
+    for (const QByteArray &argument : arguments) {
+        bufferSize += size_t(argument.size()) + 1;
+    }
+    for (char **env = environ; env && *env; ++env) {
+        bufferSize += my_strlen(*env) + 1;
+    }
+    bufferSize = qMin(bufferSize, kReporterBufferSize) + sizeof(kReporterEnvironmentTruncated);
+    data.buffer.reset(new char[bufferSize]);
+
+    size_t offset = 0;
+    const auto append = [&data, &offset, bufferSize](const char *value) -> char * {
+        const size_t length = my_strlen(value) + 1;
+        if ((offset + length) > bufferSize) {
+            return nullptr;
         }
-        m_crashReporterArguments.append(QDir::toNativeSeparators(dumpFilePath));
-        if (!m_logFileArgument.isEmpty() && !m_logFilePath.isEmpty()) {
-            m_crashReporterArguments << m_logFileArgument
-                                     << QDir::toNativeSeparators(m_logFilePath);
+        char *result = data.buffer.get() + offset;
+        memcpy(result, value, length);
+        offset += length;
+        return result;
+    };
+
+    for (int i = 0; i != arguments.size(); ++i) {
+        if (i == placeholderIndex) {
+            data.argv[i] = placeholder;
+            continue;
+        }
+        data.argv[i] = append(arguments.at(i).constData());
+        if (!data.argv[i]) {
+            qWarning().noquote() << "Crash reporter arguments are too long.";
+            return false;
         }
-        QProcess::startDetached(m_reporterPath, m_crashReporterArguments);
     }
+    data.argv[arguments.size()] = nullptr;
 
-    /*
-    NO STACK USE, NO HEAP USE THERE !!!
-    Creating QString's, using qDebug, etc. - everything is crash-unfriendly.
-    */
-    return m_reportCrashesToSystem ? succeeded : true;
+    // The environment is captured as well: environ may be halfway through a setenv()
+    // on another thread when we crash.
+    int envc = 0;
+    int dropped = 0;
+    for (char **env = environ; env && *env; ++env) {
+        // Room is always left for the marker.
+        const size_t length = my_strlen(*env) + 1;
+        if ((envc < (kReporterMaxEnvironment - 1))
+            && ((offset + length + sizeof(kReporterEnvironmentTruncated)) <= bufferSize)) {
+            data.envp[envc++] = append(*env);
+        } else {
+            ++dropped;
+        }
+    }
+    if (dropped > 0) {
+        qWarning().noquote() << "Left" << dropped
+                             << "environment variables out of the crash reporter environment.";
+        data.envp[envc++] = append(kReporterEnvironmentTruncated);
+    }
+    data.envp[envc] = nullptr;
+    data.valid = true;
+    return true;
 }
 
-#ifdef Q_OS_WINDOWS
-VOID InvalidParameterHandlerFunc(
-    LPCWSTR expression, LPCWSTR function, LPCWSTR file, UINT line, uintptr_t pReserved)
+QList<QByteArray> reporterCommonArguments()
 {
-    Q_UNUSED(expression)
-    Q_UNUSED(function)
-    Q_UNUSED(file)
-    Q_UNUSED(line)
-    Q_UNUSED(pReserved)
-    qDebug().noquote() << "InvalidParameterHandlerFunc";
-    if (!google_breakpad::ExceptionHandler::WriteMinidump(m_dumpDirPath.toStdWString(),
-                                                          DumpCallback,
-                                                          nullptr)) {
-        qWarning().noquote() << "Failed to write minidump.";
+    QList<QByteArray> arguments = {QFile::encodeName(m_reporterPath)};
+    for (const QString &argument : std::as_const(m_crashReporterArguments)) {
+        arguments.append(argument.toLocal8Bit());
     }
-    TerminateProcess(GetCurrentProcess(), EXIT_FAILURE);
+    return arguments;
 }
+#endif
 
-VOID PurecallHandlerFunc()
+// Everything the crash path needs to know about the reporter. Setters build a new
+// snapshot and publish it with one atomic store; the crash path does one load and
+// never sees a half-updated QString or argument list. A crash on another thread may
+// still be using an older snapshot, so the replaced ones are only freed by a later
+// publish that finds no dump using one, see CrashConfigUse.
+struct CrashConfig
 {
-    qDebug().noquote() << "PurecallHandlerFunc";
-    if (!google_breakpad::ExceptionHandler::WriteMinidump(m_dumpDirPath.toStdWString(),
-                                                          DumpCallback,
-                                                          nullptr)) {
-        qWarning().noquote() << "Failed to write minidump.";
-    }
-    TerminateProcess(GetCurrentProcess(), EXIT_FAILURE);
-}
+    QString reporterPath = {};
+    // Arguments for startReporterDetached(); the dump file path goes at dumpFileIndex.
+    QStringList reporterArguments = {};
+    int dumpFileIndex = 0;
+    QString dumpFileExtName = {};
+    // Set by initCrashHandler(), which may run on its own thread.
+    QString dumpDirPath = {};
+#ifdef Q_OS_LINUX
+    ReporterLaunchData launchData = {};
+    char logFilePath[PATH_MAX] = {};
+    // What crashes and requested dumps are written with, see writeCrashDump(). Never
+    // copied: Breakpad does not copy descriptors that have a path.
+    google_breakpad::MinidumpDescriptor descriptor = {};
+    QByteArray microdumpProductInfo = {};
+    // namePatterns points into threadNamePatterns.
+    qbreakpad::ThreadCapturePolicy threadCapturePolicy = {};
+    QByteArray threadNamePatterns = {};
+    // A dump written into the slot is renamed to dumpSlotTargetPath when it is done.
+    int dumpSlotFd = -1;
+    char dumpSlotFilePath[PATH_MAX] = {};
+    char dumpSlotTargetPath[PATH_MAX] = {};
 #endif
+};
 
-} // namespace
+// Held by the setters while they change a setting and publish the result.
+QMutex m_crashConfigMutex;
+std::atomic<const CrashConfig *> m_crashConfig = nullptr;
+std::atomic_int m_crashConfigUsers = 0;
+QList<const CrashConfig *> m_retiredCrashConfigs = {};
 
-void qbreakpad_initCrashHandler(const QString &value)
+// Async-signal-safe. Holds on to the published snapshot for as long as it lives.
+class CrashConfigUse
 {
-    if (!m_crashHandler.isNull() || value.isEmpty()) {
-        return;
+public:
+    CrashConfigUse()
+    {
+        // Both sequentially consistent, like the store and the load in
+        // publishCrashConfig(): a publish that sees no user here has already
+        // replaced the snapshot this loads.
+        m_crashConfigUsers.fetch_add(1);
+        m_config = m_crashConfig.load();
     }
-    const QDir dir(value);
-    if (!dir.exists()) {
-        dir.mkpath(QChar::fromLatin1('.'));
-    }
-    m_dumpDirPath = QDir::toNativeSeparators(dir.canonicalPath());
-#ifdef Q_OS_WINDOWS
-    m_crashHandler.reset(
-        new google_breakpad::ExceptionHandler(m_dumpDirPath.toStdWString(),
-                                              nullptr,
-                                              DumpCallback,
-                                              nullptr,
-                                              google_breakpad::ExceptionHandler::HANDLER_ALL));
-    m_crashHandler->set_handle_debug_exceptions(true);
+    ~CrashConfigUse() { m_crashConfigUsers.fetch_sub(1); }
+    CrashConfigUse(const CrashConfigUse &) = delete;
+    CrashConfigUse &operator=(const CrashConfigUse &) = delete;
 
-    _set_invalid_parameter_handler(InvalidParameterHandlerFunc);
-    _set_purecall_handler(PurecallHandlerFunc);
+    const CrashConfig *get() const { return m_config; }
 
-    _CrtSetReportMode(_CRT_ASSERT, 0);
+private:
+    const CrashConfig *m_config = nullptr;
+};
 
-    m_blockUnhandledExceptionFilter = true;
-    m_kernel32Intercept.Init(L"Kernel32");
-    if (!m_kernel32Intercept.AddHook("SetUnhandledExceptionFilter",
-                                     reinterpret_cast<intptr_t>(SetUnhandledExceptionFilterPatched),
-                                     reinterpret_cast<void **>(
-                                         &m_pSetUnhandledExceptionFilterRedirection))) {
-        qWarning().noquote()
-            << "SetUnhandledExceptionFilter hook failed; crash reporter is vulnerable.";
+#ifdef Q_OS_LINUX
+void fillDumpConfig(CrashConfig *config);
+#endif
+
+// Called with m_crashConfigMutex held.
+void publishCrashConfig()
+{
+    auto config = new CrashConfig;
+    config->reporterPath = m_reporterPath;
+    config->reporterArguments = m_crashReporterArguments;
+    if (!m_dumpFileArgument.isEmpty()) {
+        config->reporterArguments.append(m_dumpFileArgument);
     }
-#elif defined(Q_OS_LINUX)
-    const google_breakpad::MinidumpDescriptor md(m_dumpDirPath.toStdString());
-    m_crashHandler.reset(
-        new google_breakpad::ExceptionHandler(md, nullptr, DumpCallback, nullptr, true, -1));
-#elif defined(Q_OS_MACOS)
-    m_crashHandler.reset(new google_breakpad::ExceptionHandler(m_dumpDirPath.toStdString(),
-                                                               nullptr,
-                                                               DumpCallback,
-                                                               nullptr,
-                                                               true,
-                                                               0));
+    config->dumpFileIndex = int(config->reporterArguments.size());
+    if (!m_logFileArgument.isEmpty() && !m_logFilePath.isEmpty()) {
+        config->reporterArguments << m_logFileArgument << m_logFilePath;
+    }
+    config->dumpFileExtName = m_dumpFileExtName;
+    config->dumpDirPath = m_dumpDirPath;
+#ifdef Q_OS_LINUX
+    const QByteArray logFilePath = QFile::encodeName(m_logFilePath);
+    my_strlcpy(config->logFilePath, logFilePath.constData(), sizeof(config->logFilePath));
+    if (!m_reporterPath.isEmpty()) {
+        QList<QByteArray> arguments = reporterCommonArguments();
+        if (!m_dumpFileArgument.isEmpty()) {
+            arguments.append(m_dumpFileArgument.toLocal8Bit());
+        }
+        const int dumpFileIndex = int(arguments.size());
+        arguments.append(QByteArray());
+        if (!m_logFileArgument.isEmpty() && !m_logFilePath.isEmpty()) {
+            arguments.append(m_logFileArgument.toLocal8Bit());
+            arguments.append(logFilePath);
+        }
+        buildLaunchData(config->launchData, arguments, dumpFileIndex, m_crashDumpFilePath);
+    }
+    fillDumpConfig(config);
 #endif
+    if (const CrashConfig *previous = m_crashConfig.exchange(config)) {
+        m_retiredCrashConfigs.append(previous);
+    }
+    if (m_crashConfigUsers.load() == 0) {
+        qDeleteAll(m_retiredCrashConfigs);
+        m_retiredCrashConfigs.clear();
+    }
 }
 
-bool qbreakpad_writeMiniDump()
+// Only for contexts where using the heap is fine: the Windows and macOS crash
+// callbacks (as before) and the crash server, which runs in a healthy process.
+void startReporterDetached(const QString &dumpFilePath)
 {
-#ifdef Q_OS_WINDOWS
-    const std::wstring path = m_dumpDirPath.toStdWString();
+    const CrashConfigUse use;
+    const CrashConfig *config = use.get();
+    if (!config || !QFileInfo::exists(config->reporterPath)) {
+        return;
+    }
+    QStringList arguments = config->reporterArguments;
+    arguments.insert(config->dumpFileIndex, QDir::toNativeSeparators(dumpFilePath));
+#ifdef Q_OS_LINUX
+    const qint64 startTime = qbreakpad::CrashStats::now();
+    recordReporterStart(QProcess::startDetached(config->reporterPath, arguments)
+                            ? qbreakpad::CrashStats::ReporterLaunches
+                            : qbreakpad::CrashStats::ReporterLaunchFailures,
+                        startTime);
 #else
-    const std::string path = m_dumpDirPath.toStdString();
+    QProcess::startDetached(config->reporterPath, arguments);
 #endif
-    const bool ret = google_breakpad::ExceptionHandler::WriteMinidump(path, DumpCallback, nullptr);
-    if (!ret) {
-        qWarning().noquote() << "Failed to write minidump.";
+}
+
+#ifdef Q_OS_LINUX
+int ReporterGrandchildMain(void *arg)
+{
+    const auto data = static_cast<const ReporterLaunchData *>(arg);
+    sigset_t signalMask;
+    sigemptyset(&signalMask);
+    sigprocmask(SIG_SETMASK, &signalMask, nullptr);
+    if (data->inheritedFd != -1) {
+        fcntl(data->inheritedFd, F_SETFD, 0);
     }
-    return ret;
+    execve(data->argv[0], data->argv, data->envp);
+    // Shares our address space until execve() succeeds or we exit, see CLONE_VFORK.
+    m_reporterExecErrno = errno;
+    _exit(127);
 }
 
-void qbreakpad_setReporterPath(const QString &value)
+int ReporterChildMain(void *arg)
 {
-    if (value.isEmpty()) {
+    // Same double-fork QProcess::startDetached() does, so the reporter gets reparented
+    // and a process that survives qbreakpad_writeMiniDump() is not left with a zombie.
+    const pid_t pid = clone(ReporterGrandchildMain,
+                            m_reporterGrandchildStack + kReporterStackSize,
+                            CLONE_VM | CLONE_VFORK | SIGCHLD,
+                            arg);
+    _exit(((pid > 0) && (m_reporterExecErrno == 0)) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// Async-signal-safe. A crash and a requested dump, or the daemon start, may launch
+// at the same time; the stacks and m_reporterExecErrno are shared, so the others
+// wait. m_reporterLauncher holds the thread id of the launching thread, so a crash
+// on that thread fails its launch instead of waiting for itself.
+bool launchReporter(const ReporterLaunchData &data)
+{
+    if (!data.valid) {
+        return false;
+    }
+    const auto tid = pid_t(syscall(__NR_gettid));
+    pid_t launcher = 0;
+    while (!m_reporterLauncher.compare_exchange_weak(launcher, tid)) {
+        if (launcher == tid) {
+            return false;
+        }
+        launcher = 0;
+        sched_yield();
+    }
+    // CLONE_VM | CLONE_VFORK on a private stack is what posix_spawn() does internally:
+    // no page tables are copied, so the cost does not grow with the size of the heap.
+    m_reporterExecErrno = 0;
+    const pid_t pid = clone(ReporterChildMain,
+                            m_reporterChildStack + kReporterStackSize,
+                            CLONE_VM | CLONE_VFORK | SIGCHLD,
+                            const_cast<ReporterLaunchData *>(&data));
+    int status = 0;
+    while ((pid > 0) && (waitpid(pid, &status, 0) == -1) && (errno == EINTR)) {
+    }
+    m_reporterLauncher.store(0);
+    return (pid > 0) && WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+// Starts the reporter once, with one end of a SOCK_SEQPACKET socket pair, so that a
+// crash only has to send() a single message instead of paying for fork+exec+ld.so
+// while the faulting process is frozen. The reporter sees EOF once we are gone.
+void startReporterDaemon()
+{
+    if (m_reporterDaemonFd != -1) {
         return;
     }
-    const QString path = QDir::toNativeSeparators(value);
-    if (m_reporterPath == path) {
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_reporterPath.isEmpty() || m_reporterDaemonArgument.isEmpty()) {
+        qWarning().noquote() << "The crash reporter daemon needs a reporter path and argument.";
         return;
     }
-    m_reporterPath = path;
+    int fds[2] = {-1, -1};
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        qWarning().noquote() << "Failed to create the crash reporter channel.";
+        return;
+    }
+    QList<QByteArray> arguments = reporterCommonArguments();
+    arguments << m_reporterDaemonArgument.toLocal8Bit() << QByteArray::number(fds[1]);
+    m_reporterDaemonLaunchData.inheritedFd = fds[1];
+    if (buildLaunchData(m_reporterDaemonLaunchData, arguments)
+        && launchReporter(m_reporterDaemonLaunchData)) {
+        m_reporterDaemonFd = fds[0];
+    } else {
+        qWarning().noquote() << "Failed to start the crash reporter daemon.";
+        close(fds[0]);
+    }
+    close(fds[1]);
 }
 
-void qbreakpad_setReporterDumpFileArgument(const QString &value)
+// The daemon sees EOF and exits; crashes go back to launching the reporter.
+void stopReporterDaemon()
 {
-    if (m_dumpFileArgument != value) {
-        m_dumpFileArgument = value;
+    const int fd = m_reporterDaemonFd;
+    if (fd == -1) {
+        return;
     }
+    // Cleared before the close, so a crash never sends to a reused fd number.
+    m_reporterDaemonFd = -1;
+    close(fd);
 }
 
-void qbreakpad_setReporterLogFileArgument(const QString &value)
+// The daemon receives one datagram per dump, made of "key=value" lines:
+// pid=<crashed pid>, succeeded=<0|1>, dump=<dump file path>, log=<log file path>,
+// annotations=<annotation file path, empty without annotations>. In-memory dumps
+// add memfd=1 and come with the memfd as SCM_RIGHTS; dump= is then only the name
+// the dump would have on disk.
+bool notifyReporterDaemon(const CrashConfig *config, bool succeeded)
 {
-    if (m_logFileArgument != value) {
-        m_logFileArgument = value;
+    if (m_reporterDaemonFd == -1) {
+        return false;
     }
+    char *message = m_reporterDaemonMessage;
+    const size_t size = sizeof(m_reporterDaemonMessage);
+    char pid[16] = {};
+    my_uitos(pid, static_cast<uintmax_t>(getpid()), my_uint_len(static_cast<uintmax_t>(getpid())));
+    my_strlcpy(message, "pid=", size);
+    my_strlcat(message, pid, size);
+    my_strlcat(message, succeeded ? "\nsucceeded=1\ndump=" : "\nsucceeded=0\ndump=", size);
+    my_strlcat(message, m_crashDumpFilePath, size);
+    my_strlcat(message, "\nlog=", size);
+    my_strlcat(message, config ? config->logFilePath : "", size);
+    my_strlcat(message, "\nannotations=", size);
+    my_strlcat(message, m_crashAnnotationFilePath, size);
+    my_strlcat(message, m_crashDumpInMemory ? "\nmemfd=1\n" : "\n", size);
+    // One datagram, never blocks and never raises SIGPIPE if the daemon has died.
+    const ssize_t length = static_cast<ssize_t>(my_strlen(message));
+    if (m_crashDumpInMemory) {
+        return m_inMemoryDump.sendTo(m_reporterDaemonFd, message, size_t(length));
+    }
+    return send(m_reporterDaemonFd, message, length, MSG_DONTWAIT | MSG_NOSIGNAL) == length;
 }
 
-void qbreakpad_setReporterCommonArguments(const QStringList &value)
+// Picked ahead of time like the compressed dump paths, outside of the crash path.
+void updateInMemoryDumpFilePath()
 {
-    if (m_crashReporterArguments != value) {
-        m_crashReporterArguments = value;
+    if (!m_inMemoryDump.isInitialized()) {
+        return;
     }
+    const QByteArray path = QFile::encodeName(m_dumpDirPath + QDir::separator()
+                                              + QUuid::createUuid().toString(QUuid::WithoutBraces)
+                                              + m_dumpFileExtName);
+    my_strlcpy(m_inMemoryDumpFilePath, path.constData(), PATH_MAX);
 }
 
-void qbreakpad_setLogFilePath(const QString &value)
+// Async-signal-safe. Nobody took the memfd: write it to disk, or drop the dump.
+void finishInMemoryDump()
 {
-    if (value.isEmpty()) {
+    if (m_inMemoryDumpDiskFallback && m_inMemoryDump.copy(m_crashDumpFilePath)) {
         return;
     }
-    const QString path = QDir::toNativeSeparators(value);
-    if (m_logFilePath == path) {
+    if (m_crashAnnotationFilePath[0] != '\0') {
+        unlink(m_crashAnnotationFilePath);
+        m_crashAnnotationFilePath[0] = '\0';
+    }
+    m_crashDumpFilePath[0] = '\0';
+}
+
+#ifdef QBREAKPAD_HAS_ZSTD
+// The scratch file costs as much memory as the dump; bigger dumps are written
+// uncompressed instead, see writeConfiguredDump().
+constexpr off_t kDumpCompressorScratchLimit = 64 * 1024 * 1024;
+qbreakpad::DumpCompressor m_dumpCompressor;
+char m_compressedDumpFilePath[PATH_MAX] = {};
+char m_uncompressedDumpFilePath[PATH_MAX] = {};
+int m_uncompressedDumpFd = -1;
+
+// Breakpad names the files it writes itself, but with an fd descriptor there is no
+// file: pick the name of the next dump ahead of time, outside of the crash path.
+void updateCompressedDumpFilePaths()
+{
+    if (!m_dumpCompressor.isInitialized()) {
         return;
     }
-    m_logFilePath = path;
+    const QString basePath = m_dumpDirPath + QDir::separator()
+                             + QUuid::createUuid().toString(QUuid::WithoutBraces)
+                             + m_dumpFileExtName;
+    const QByteArray uncompressed = QFile::encodeName(basePath);
+    const QByteArray compressed = QFile::encodeName(basePath + QString::fromUtf8(".zst"));
+    my_strlcpy(m_uncompressedDumpFilePath, uncompressed.constData(), PATH_MAX);
+    my_strlcpy(m_compressedDumpFilePath, compressed.constData(), PATH_MAX);
 }
 
-void qbreakpad_setDumpFileExtName(const QString &value)
+void finishCompressedDump()
 {
-    if (value.isEmpty()) {
+    if (m_dumpCompressor.compress(m_compressedDumpFilePath)) {
+        my_strlcpy(m_crashDumpFilePath, m_compressedDumpFilePath, PATH_MAX);
+    } else if (m_dumpCompressor.copy(m_uncompressedDumpFilePath)) {
+        my_strlcpy(m_crashDumpFilePath, m_uncompressedDumpFilePath, PATH_MAX);
+    } else {
+        m_crashDumpFilePath[0] = '\0';
+    }
+    m_dumpCompressor.discardScratch();
+}
+#endif
+
+// Application memory regions to include in the dump, read by the dump children
+// without taking a lock.
+qbreakpad::AppMemoryRegions m_crashAppMemory;
+
+bool FilterCallback(void *context)
+{
+    Q_UNUSED(context)
+    // First thing on the crash path: everything after it may need memory.
+    qbreakpad::releaseEmergencyMemory();
+    return true;
+}
+
+google_breakpad::MinidumpDescriptor makeMinidumpDescriptor()
+{
+    google_breakpad::MinidumpDescriptor md(m_dumpDirPath.isEmpty() ? m_fallbackDumpDirPath
+                                                                   : m_dumpDirPath.toStdString());
+    if (m_microdumpEnabled) {
+        // Stack of the crashing thread plus module list, as text on stderr.
+        md = google_breakpad::MinidumpDescriptor(
+            google_breakpad::MinidumpDescriptor::kMicrodumpOnConsole);
+    } else if (m_inMemoryDump.isInitialized()) {
+        md = google_breakpad::MinidumpDescriptor(m_inMemoryDump.fd());
+    }
+#ifdef QBREAKPAD_HAS_ZSTD
+    else if ((m_dumpCompressionLevel > 0) && m_dumpCompressor.isInitialized()) {
+        md = google_breakpad::MinidumpDescriptor(m_dumpCompressor.scratchFd());
+    }
+#endif
+    else if (m_dumpSlotFd != -1) {
+        md = google_breakpad::MinidumpDescriptor(m_dumpSlotFd);
+    }
+    if (m_dumpSizeLimit > 0) {
+        md.set_size_limit(static_cast<off_t>(m_dumpSizeLimit));
+    }
+    md.set_sanitize_stacks(m_sanitizeStacks);
+    if (m_principalMappingAddress != 0) {
+        md.set_address_within_principal_mapping(m_principalMappingAddress);
+        md.set_skip_dump_if_principal_mapping_not_referenced(true);
+    }
+    return md;
+}
+
+// Crashes of processes with thousands of threads are written by our own dumper,
+// which captures only some of the threads. Breakpad can only be given a dumper for
+// dumps written to a path, compressed dumps and microdumps capture every thread.
+// Set with m_crashConfigMutex held, the crash path uses the published copy.
+qbreakpad::ThreadCapturePolicy m_threadCapturePolicy = {};
+QByteArray m_capturedThreadNamePatterns = {};
+
+// The handler's own descriptor is left alone once it is created, the dumps are
+// written from the published one.
+void fillDumpConfig(CrashConfig *config)
+{
+    config->descriptor = makeMinidumpDescriptor();
+    if (config->descriptor.IsMicrodumpOnConsole()) {
+        config->microdumpProductInfo = m_microdumpProductInfo;
+        config->descriptor.microdump_extra_info()->product_info
+            = config->microdumpProductInfo.isEmpty() ? nullptr
+                                                     : config->microdumpProductInfo.constData();
+    } else if (!config->descriptor.IsFD()) {
+        // Names the next dump file; requested dumps publish a new one when done.
+        config->descriptor.UpdatePath();
+    }
+    config->threadNamePatterns = m_capturedThreadNamePatterns;
+    config->threadCapturePolicy = m_threadCapturePolicy;
+    config->threadCapturePolicy.namePatterns = config->threadNamePatterns.constData();
+    config->threadCapturePolicy.namePatternsSize = size_t(config->threadNamePatterns.size());
+    config->dumpSlotFd = m_dumpSlotFd;
+    my_strlcpy(config->dumpSlotFilePath, m_dumpSlotFilePath, PATH_MAX);
+    my_strlcpy(config->dumpSlotTargetPath, m_dumpSlotTargetPath, PATH_MAX);
+}
+
+// For the setters of what fillDumpConfig() reads that do not hold the mutex yet.
+void updateDumpConfig()
+{
+    const QMutexLocker locker(&m_crashConfigMutex);
+    publishCrashConfig();
+}
+
+// Called with m_crashConfigMutex held.
+void updateDumpSlotTargetPath()
+{
+    if (m_dumpSlotPool.isNull()) {
         return;
     }
-    QString extName = value.toLower();
-    if (!extName.startsWith(QChar::fromLatin1('.'))) {
-        extName.prepend(QChar::fromLatin1('.'));
+    const QByteArray path = QFile::encodeName(m_dumpDirPath + QDir::separator()
+                                              + QUuid::createUuid().toString(QUuid::WithoutBraces)
+                                              + m_dumpFileExtName);
+    my_strlcpy(m_dumpSlotTargetPath, path.constData(), PATH_MAX);
+}
+
+// Outside of the crash path, once the current slot holds a dump. Without a free
+// slot dumps go back to files named by the descriptor, until the next dump finds
+// one again.
+void takeDumpSlot()
+{
+    const QMutexLocker locker(&m_crashConfigMutex);
+    const int previousFd = m_dumpSlotFd;
+    int fd = -1;
+    QByteArray filePath = {};
+    if (!m_dumpSlotPool.isNull() && m_dumpSlotPool->take(&fd, &filePath)) {
+        my_strlcpy(m_dumpSlotFilePath, filePath.constData(), PATH_MAX);
+        updateDumpSlotTargetPath();
     }
-    if (m_dumpFileExtName != extName) {
-        m_dumpFileExtName = extName;
+    m_dumpSlotFd = fd;
+    publishCrashConfig();
+    if (previousFd != -1) {
+        close(previousFd);
+    }
+}
+
+// Async-signal-safe.
+void finishSlotDump(const CrashConfig *config, int fd)
+{
+    // The reservation lies past the end of the file, where a hole punch does nothing
+    // on ext4 and a truncate to the same size is not required to free anything. A
+    // truncate that shrinks the file frees every block past its new end, so the file
+    // is grown over the reservation first and then cut back to what was written.
+    struct stat st = {};
+    if ((fstat(fd, &st) == 0) && (st.st_size < off_t(m_dumpSlotSize))
+        && (ftruncate(fd, off_t(m_dumpSlotSize)) == 0)) {
+        ftruncate(fd, st.st_size);
+    }
+    if (rename(config->dumpSlotFilePath, config->dumpSlotTargetPath) == 0) {
+        my_strlcpy(m_crashDumpFilePath, config->dumpSlotTargetPath, PATH_MAX);
+    } else {
+        my_strlcpy(m_crashDumpFilePath, config->dumpSlotFilePath, PATH_MAX);
+    }
+}
+
+// Crashes whose signature was already seen within the window skip the full dump
+// and the reporter. They are only counted in the signature table, or written as a
+// microdump by a second handler that never installs signal handlers itself.
+int m_duplicateCrashWindow = 0;
+bool m_duplicateCrashMicrodump = false;
+quint64 m_lastCrashSignature = 0;
+qbreakpad::CrashSignatureTable m_crashSignatures;
+QScopedPointer<google_breakpad::ExceptionHandler> m_duplicateCrashHandler;
+google_breakpad::ExceptionHandler::CrashContext m_duplicateCrashContext = {};
+
+bool openCrashSignatures()
+{
+    return m_crashSignatures.open(m_dumpDirPath + QStringLiteral("/qbreakpad.signatures"));
+}
+
+void startDuplicateCrashHandling()
+{
+    if (m_duplicateCrashWindow <= 0 || !openCrashSignatures() || !m_duplicateCrashMicrodump) {
+        return;
     }
+    // Breakpad asks its handlers newest first, this one must be created before the
+    // main handler so that it is only reached through CrashHandlerCallback.
+    google_breakpad::MinidumpDescriptor md(google_breakpad::MinidumpDescriptor::kMicrodumpOnConsole);
+    md.microdump_extra_info()->product_info = m_microdumpProductInfo.isEmpty()
+                                                  ? nullptr
+                                                  : m_microdumpProductInfo.constData();
+    m_duplicateCrashHandler.reset(
+        new google_breakpad::ExceptionHandler(md, nullptr, nullptr, nullptr, false, -1));
+}
+
+bool DumpCallback(const google_breakpad::MinidumpDescriptor &md, void *context, bool succeeded);
+
+qbreakpad::MinidumpStreamAppender m_streamAppender;
+
+void appendCustomStreams(int fd)
+{
+    if (!m_streamAppender.open(fd)) {
+        return;
+    }
+    qbreakpad::writeBreadcrumbStream(m_streamAppender);
+    qbreakpad::writeLogTailStream(m_streamAppender);
+    qbreakpad::writeAnnotationStream(m_streamAppender);
+    m_streamAppender.finish();
+}
+
+void appendCustomStreams(const char *path)
+{
+    const int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd != -1) {
+        appendCustomStreams(fd);
+        close(fd);
+    }
+}
+
+// What a descriptor for another target takes over. Async-signal-safe.
+void copyDumpSettings(const google_breakpad::MinidumpDescriptor &from,
+                      google_breakpad::MinidumpDescriptor *to)
+{
+    // Breakpad's getters for the last two are not const.
+    auto &settings = const_cast<google_breakpad::MinidumpDescriptor &>(from);
+    to->set_size_limit(settings.size_limit());
+    to->set_sanitize_stacks(settings.sanitize_stacks());
+    to->set_address_within_principal_mapping(settings.address_within_principal_mapping());
+    to->set_skip_dump_if_principal_mapping_not_referenced(
+        settings.skip_dump_if_principal_mapping_not_referenced());
+}
+
+// Writes a dump with the published snapshot, which no setter changes in place, and
+// hands it to DumpCallback(), whose result goes to *handled. context is null for a
+// requested dump, which is taken of the calling thread; only such a dump may have
+// a positive sizeLimit of its own instead of the configured one.
+bool writeConfiguredDump(const CrashConfig *config,
+                         const google_breakpad::ExceptionHandler::CrashContext *context,
+                         bool *handled,
+                         off_t sizeLimit = 0)
+{
+    const auto write = [config, context](const google_breakpad::MinidumpDescriptor &md,
+                                         off_t fileSizeLimit) {
+        return context ? qbreakpad::writeDump(md,
+                                              context,
+                                              config->threadCapturePolicy,
+                                              m_crashAppMemory,
+                                              fileSizeLimit)
+                       : qbreakpad::writeRequestedDump(md,
+                                                       config->threadCapturePolicy,
+                                                       m_crashAppMemory,
+                                                       fileSizeLimit);
+    };
+    const google_breakpad::MinidumpDescriptor &configured = config->descriptor;
+    // Breakpad does not copy a descriptor that has a path already, so one for a
+    // directory names a file of its own.
+    std::unique_ptr<google_breakpad::MinidumpDescriptor> limited;
+    if ((sizeLimit > 0) && !configured.IsMicrodumpOnConsole()) {
+        limited.reset(configured.IsFD()
+                          ? new google_breakpad::MinidumpDescriptor(configured.fd())
+                          : new google_breakpad::MinidumpDescriptor(configured.directory()));
+        copyDumpSettings(configured, limited.get());
+        limited->set_size_limit(sizeLimit);
+        if (!limited->IsFD()) {
+            limited->UpdatePath();
+        }
+    }
+    const google_breakpad::MinidumpDescriptor &md = limited ? *limited : configured;
+    const auto callbackContext = const_cast<CrashConfig *>(config);
+#ifdef QBREAKPAD_HAS_ZSTD
+    if (md.IsFD() && (md.fd() == m_dumpCompressor.scratchFd())) {
+        const bool succeeded = write(md, m_dumpCompressor.scratchLimit());
+        if (succeeded || !m_dumpCompressor.scratchFull()) {
+            *handled = DumpCallback(md, callbackContext, succeeded);
+            return succeeded;
+        }
+        // Too big for the scratch file: written again, uncompressed, straight into
+        // the file the dump would have had without compression.
+        m_dumpCompressor.discardScratch();
+        m_uncompressedDumpFd = open(m_uncompressedDumpFilePath,
+                                    O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                                    0600);
+        if (m_uncompressedDumpFd == -1) {
+            *handled = DumpCallback(md, callbackContext, false);
+            return false;
+        }
+        google_breakpad::MinidumpDescriptor fallback(m_uncompressedDumpFd);
+        copyDumpSettings(md, &fallback);
+        const bool written = write(fallback, 0);
+        *handled = DumpCallback(fallback, callbackContext, written);
+        close(m_uncompressedDumpFd);
+        m_uncompressedDumpFd = -1;
+        return written;
+    }
+#endif
+    const bool succeeded = write(md, 0);
+    *handled = DumpCallback(md, callbackContext, succeeded);
+    return succeeded;
+}
+
+// Returns false to leave the crash to Breakpad, which only happens before the first
+// publish. Breakpad's signal handler re-raises the crash either way.
+bool writeCrashDump(const google_breakpad::ExceptionHandler::CrashContext *context)
+{
+    const CrashConfigUse use;
+    bool handled = false;
+    if (use.get()) {
+        writeConfiguredDump(use.get(), context, &handled);
+    }
+    return handled;
+}
+
+// The same for qbreakpad_writeMiniDump(), like ExceptionHandler::WriteMinidump().
+bool writeRequestedDump(off_t sizeLimit)
+{
+    const CrashConfigUse use;
+    bool handled = false;
+    return use.get() && writeConfiguredDump(use.get(), nullptr, &handled, sizeLimit);
+}
+
+bool CrashHandlerCallback(const void *crash_context, size_t crash_context_size, void *context)
+{
+    Q_UNUSED(context)
+    if (crash_context_size < sizeof(google_breakpad::ExceptionHandler::CrashContext)) {
+        return false;
+    }
+    const auto crashContext = static_cast<const google_breakpad::ExceptionHandler::CrashContext *>(
+        crash_context);
+    m_crashDumpStartTime = qbreakpad::CrashStats::now();
+    m_lastCrashSignature = qbreakpad::computeCrashSignature(&crashContext->context);
+    if ((m_duplicateCrashWindow <= 0)
+        || !m_crashSignatures.record(m_lastCrashSignature, m_duplicateCrashWindow)) {
+        return writeCrashDump(crashContext);
+    }
+    m_dumpIndex.append("", qbreakpad::DumpIndex::Duplicate, 0, m_lastCrashSignature, getpid());
+    m_crashStats.add(qbreakpad::CrashStats::DuplicateCrashes);
+    m_crashDumpStartTime = 0;
+    if (!m_duplicateCrashHandler.isNull()) {
+        // HandleSignal refills Breakpad's global crash context, which is what
+        // crash_context points to.
+        memcpy(&m_duplicateCrashContext, crashContext, sizeof(m_duplicateCrashContext));
+        m_duplicateCrashHandler->HandleSignal(m_duplicateCrashContext.siginfo.si_signo,
+                                              &m_duplicateCrashContext.siginfo,
+                                              &m_duplicateCrashContext.context);
+    }
+    return true;
+}
+
+// Out-of-process dump generation: every worker owns one report channel and one
+// CrashGenerationServer, i.e. one thread that writes dumps for the clients that
+// were handed its client fd. The pool size bounds how many dumps are written at
+// the same time.
+struct CrashServerWorker
+{
+    QScopedPointer<google_breakpad::CrashGenerationServer> server;
+    int serverFd = -1;
+    int clientFd = -1;
+};
+
+std::string m_crashServerDumpPath = {};
+std::vector<std::unique_ptr<CrashServerWorker>> m_crashServerWorkers = {};
+std::atomic_uint m_crashServerNextWorker = 0;
+
+void OnClientDumpRequest(void *context, const google_breakpad::ClientInfo *client_info,
+                         const std::string *file_path)
+{
+    Q_UNUSED(context)
+    const QString dumpFilePath = QString::fromStdString(*file_path);
+    recordDump(dumpFilePath, client_info->pid());
+    startReporterDetached(dumpFilePath);
+    announceDump(dumpFilePath);
+}
+#endif
+
+#ifdef Q_OS_LINUX
+// Async-signal-safe. Requested dumps come through here too; only a crash leaves a
+// signature behind.
+void recordCrashDump(bool succeeded)
+{
+    qint64 size = 0;
+    if (m_crashDumpFilePath[0] != '\0') {
+        const char *fileName = strrchr(m_crashDumpFilePath, '/');
+        struct stat st = {};
+        if (m_crashDumpInMemory) {
+            size = m_inMemoryDump.size();
+        } else if (stat(m_crashDumpFilePath, &st) == 0) {
+            size = qint64(st.st_size);
+        }
+        m_dumpIndex.append(fileName ? (fileName + 1) : m_crashDumpFilePath,
+                           succeeded ? qbreakpad::DumpIndex::Written : qbreakpad::DumpIndex::Failed,
+                           size,
+                           m_lastCrashSignature,
+                           getpid());
+    }
+    m_lastCrashSignature = 0;
+    if (succeeded) {
+        m_crashStats.add(qbreakpad::CrashStats::DumpsWritten);
+        m_crashStats.add(qbreakpad::CrashStats::BytesWritten, quint64(size));
+        m_crashStats.record(qbreakpad::CrashStats::DumpWriteTime, m_crashDumpStartTime);
+    } else {
+        m_crashStats.add(qbreakpad::CrashStats::DumpsFailed);
+    }
+    m_crashDumpStartTime = 0;
+}
+#endif
+
+#ifdef Q_OS_WINDOWS
+bool DumpCallback(LPCWSTR _dump_dir,
+                  LPCWSTR _minidump_id,
+                  LPVOID context,
+                  LPEXCEPTION_POINTERS exinfo,
+                  MDRawAssertionInfo *assertion,
+                  bool succeeded)
+#elif defined(Q_OS_LINUX)
+bool DumpCallback(const google_breakpad::MinidumpDescriptor &md, void *context, bool succeeded)
+#elif defined(Q_OS_MACOS)
+bool DumpCallback(const char *_dump_dir, const char *_minidump_id, void *context, bool succeeded)
+#endif
+{
+#ifdef Q_OS_WINDOWS
+    Q_UNUSED(exinfo)
+    Q_UNUSED(assertion)
+#endif
+    const CrashConfigUse use;
+    // Our own dumps pass the snapshot they were written with.
+    const CrashConfig *config = context ? static_cast<const CrashConfig *>(context) : use.get();
+#ifdef Q_OS_LINUX
+    m_crashDumpInMemory = md.IsFD() && (md.fd() == m_inMemoryDump.fd());
+    m_crashDumpHandedOver = false;
+    m_crashDumpInSlot = md.IsFD() && config && (md.fd() == config->dumpSlotFd);
+    if (m_crashDumpInMemory) {
+        if (succeeded) {
+            appendCustomStreams(md.fd());
+        }
+        my_strlcpy(m_crashDumpFilePath, m_inMemoryDumpFilePath, sizeof(m_crashDumpFilePath));
+    } else
+#ifdef QBREAKPAD_HAS_ZSTD
+    if (md.IsFD() && (md.fd() == m_dumpCompressor.scratchFd())) {
+        if (succeeded) {
+            appendCustomStreams(md.fd());
+        }
+        finishCompressedDump();
+    } else if (md.IsFD() && (md.fd() == m_uncompressedDumpFd)) {
+        if (succeeded) {
+            appendCustomStreams(md.fd());
+        }
+        my_strlcpy(m_crashDumpFilePath, m_uncompressedDumpFilePath, sizeof(m_crashDumpFilePath));
+    } else
+#endif
+    if (m_crashDumpInSlot) {
+        if (succeeded) {
+            appendCustomStreams(md.fd());
+        }
+        finishSlotDump(config, md.fd());
+    } else {
+        // Neither fd nor microdump descriptors have a path.
+        my_strlcpy(m_crashDumpFilePath, md.path() ? md.path() : "", sizeof(m_crashDumpFilePath));
+        if (succeeded && (m_crashDumpFilePath[0] != '\0')) {
+            appendCustomStreams(m_crashDumpFilePath);
+        }
+    }
+    // The reporter finds the annotations next to the dump, as <dump file>.annotations.
+    m_crashAnnotationFilePath[0] = '\0';
+    if (m_crashDumpFilePath[0] != '\0') {
+        my_strlcpy(m_crashAnnotationFilePath, m_crashDumpFilePath, sizeof(m_crashAnnotationFilePath));
+        my_strlcat(m_crashAnnotationFilePath, ".annotations", sizeof(m_crashAnnotationFilePath));
+        if (!qbreakpad::writeAnnotationFile(m_crashAnnotationFilePath)
+            || (access(m_crashAnnotationFilePath, F_OK) != 0)) {
+            m_crashAnnotationFilePath[0] = '\0';
+        }
+    }
+    recordCrashDump(succeeded);
+    qint64 reporterStartTime = qbreakpad::CrashStats::now();
+    const bool notified = notifyReporterDaemon(config, succeeded);
+    if (notified) {
+        recordReporterStart(qbreakpad::CrashStats::ReporterNotifications, reporterStartTime);
+    }
+    m_crashDumpHandedOver = notified && m_crashDumpInMemory;
+    if (!notified && m_crashDumpInMemory) {
+        finishInMemoryDump();
+    }
+    // No reporter set up is not a failed launch.
+    if (!notified && config && config->launchData.valid && (m_crashDumpFilePath[0] != '\0')) {
+        reporterStartTime = qbreakpad::CrashStats::now();
+        recordReporterStart(launchReporter(config->launchData)
+                                ? qbreakpad::CrashStats::ReporterLaunches
+                                : qbreakpad::CrashStats::ReporterLaunchFailures,
+                            reporterStartTime);
+    }
+#else
+#ifdef Q_OS_WINDOWS
+    const QString dumpFilePath = QString::fromWCharArray(_dump_dir) + QDir::separator()
+                                 + QString::fromWCharArray(_minidump_id)
+                                 + (config ? config->dumpFileExtName : QString::fromUtf8(".dmp"));
+#elif defined(Q_OS_MACOS)
+    const QString dumpFilePath = QString::fromUtf8(_dump_dir) + QDir::separator()
+                                 + QString::fromUtf8(_minidump_id)
+                                 + (config ? config->dumpFileExtName : QString::fromUtf8(".dmp"));
+#endif
+    m_lastDumpFilePath = dumpFilePath;
+    startReporterDetached(dumpFilePath);
+#endif
+
+    /*
+    NO STACK USE, NO HEAP USE THERE !!!
+    Creating QString's, using qDebug, etc. - everything is crash-unfriendly.
+    */
+    return m_reportCrashesToSystem ? succeeded : true;
+}
+
+#ifdef Q_OS_WINDOWS
+VOID InvalidParameterHandlerFunc(
+    LPCWSTR expression, LPCWSTR function, LPCWSTR file, UINT line, uintptr_t pReserved)
+{
+    Q_UNUSED(expression)
+    Q_UNUSED(function)
+    Q_UNUSED(file)
+    Q_UNUSED(line)
+    Q_UNUSED(pReserved)
+    qDebug().noquote() << "InvalidParameterHandlerFunc";
+    if (!google_breakpad::ExceptionHandler::WriteMinidump(m_dumpDirPath.toStdWString(),
+                                                          DumpCallback,
+                                                          nullptr)) {
+        qWarning().noquote() << "Failed to write minidump.";
+    }
+    TerminateProcess(GetCurrentProcess(), EXIT_FAILURE);
+}
+
+VOID PurecallHandlerFunc()
+{
+    qDebug().noquote() << "PurecallHandlerFunc";
+    if (!google_breakpad::ExceptionHandler::WriteMinidump(m_dumpDirPath.toStdWString(),
+                                                          DumpCallback,
+                                                          nullptr)) {
+        qWarning().noquote() << "Failed to write minidump.";
+    }
+    TerminateProcess(GetCurrentProcess(), EXIT_FAILURE);
+}
+#endif
+
+#ifdef Q_OS_LINUX
+// After a dump went through the handler's descriptor, picks the targets of the next
+// one. Returns false for a dump handed over in memory.
+bool renewDumpTargets()
+{
+    bool onDisk = true;
+#ifdef QBREAKPAD_HAS_ZSTD
+    updateCompressedDumpFilePaths();
+#endif
+    if (m_crashDumpInMemory) {
+        // The memfd is sealed or owned by the reporter now.
+        if (!m_inMemoryDump.renew()) {
+            qWarning().noquote() << "Failed to replace the in-memory minidump file.";
+        }
+        updateInMemoryDumpFilePath();
+        onDisk = !m_crashDumpHandedOver;
+        m_crashDumpInMemory = false;
+        if (!onDisk) {
+            m_dumpIndex.reserve();
+        }
+    }
+    // Also picks up a slot the pool made since it last ran dry.
+    if (m_crashDumpInSlot || (!m_dumpSlotPool.isNull() && (m_dumpSlotFd == -1))) {
+        m_crashDumpInSlot = false;
+        takeDumpSlot();
+    } else {
+        // Names the next dump file.
+        updateDumpConfig();
+    }
+    return onDisk;
+}
+#endif
+
+// qbreakpad_writeMiniDump() and the async dumper may write at the same time; the
+// dump file path is handed over through globals, so one dump at a time.
+QMutex m_writeMiniDumpMutex;
+
+// sizeLimit replaces the configured size limit of a dump the handler writes in
+// process; *onDiskResult is false for a dump handed over in memory.
+bool writeLimitedMiniDump(QString *filePath, qint64 sizeLimit, bool *onDiskResult)
+{
+    const QMutexLocker locker(&m_writeMiniDumpMutex);
+    bool ret = false;
+    bool onDisk = true;
+    QString dumpFilePath = {};
+#ifndef Q_OS_LINUX
+    Q_UNUSED(sizeLimit)
+#endif
+#ifdef Q_OS_LINUX
+    if (!m_crashHandler.isNull()) {
+        // A crash server client asks the server, everything else goes through the
+        // published descriptor like a crash.
+        m_crashDumpStartTime = qbreakpad::CrashStats::now();
+        ret = m_crashHandler->IsOutOfProcess()
+                  ? m_crashHandler->WriteMinidump()
+                  : writeRequestedDump(static_cast<off_t>(sizeLimit));
+        // A crash server client does not get DumpCallback().
+        m_crashDumpStartTime = 0;
+        dumpFilePath = QFile::decodeName(m_crashDumpFilePath);
+        onDisk = renewDumpTargets();
+    } else
+#endif
+    {
+        const CrashConfigUse use;
+        const QString dirPath = use.get() ? use.get()->dumpDirPath : QString();
+#ifdef Q_OS_WINDOWS
+        const std::wstring path = dirPath.toStdWString();
+#else
+        const std::string path = dirPath.toStdString();
+#endif
+#ifdef Q_OS_LINUX
+        m_crashDumpStartTime = qbreakpad::CrashStats::now();
+#endif
+        ret = google_breakpad::ExceptionHandler::WriteMinidump(path, DumpCallback, nullptr);
+#ifdef Q_OS_LINUX
+        dumpFilePath = QFile::decodeName(m_crashDumpFilePath);
+#else
+        dumpFilePath = m_lastDumpFilePath;
+#endif
+    }
+    if (ret) {
+        // A dump handed over in memory is the reporter's to keep or throw away.
+        if (onDisk) {
+            announceDump(dumpFilePath);
+        }
+    } else {
+        qWarning().noquote() << "Failed to write minidump.";
+        dumpFilePath.clear();
+    }
+    if (filePath) {
+        *filePath = dumpFilePath;
+    }
+    if (onDiskResult) {
+        *onDiskResult = onDisk;
+    }
+    return ret;
+}
+
+bool writeMiniDump(QString *filePath)
+{
+    return writeLimitedMiniDump(filePath, 0, nullptr);
+}
+
+#ifdef Q_OS_LINUX
+// Snapshot children write to a file of their own; a handler that dumps into an fd
+// gets the dump moved there, so it takes the same way as any other dump.
+bool moveDumpToFd(const char *path, int fd)
+{
+    const int source = open(path, O_RDONLY | O_CLOEXEC);
+    if (source == -1) {
+        return false;
+    }
+    struct stat st = {};
+    bool ok = (fstat(source, &st) == 0) && (lseek(fd, 0, SEEK_SET) == 0);
+    off_t offset = 0;
+    while (ok && (offset < st.st_size)) {
+        const ssize_t done = sendfile(fd, source, &offset, size_t(st.st_size - offset));
+        ok = (done > 0) || ((done == -1) && (errno == EINTR));
+    }
+    close(source);
+    unlink(path);
+    return ok;
+}
+
+void finishSnapshotDump(pid_t child,
+                        const std::shared_ptr<google_breakpad::MinidumpDescriptor> &target,
+                        qint64 startTime,
+                        qbreakpad_MiniDumpCallback callback,
+                        void *context)
+{
+    int status = 0;
+    while ((waitpid(child, &status, 0) == -1) && (errno == EINTR)) {
+    }
+    bool succeeded = WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+    QString filePath = {};
+    if (succeeded) {
+        const QMutexLocker locker(&m_writeMiniDumpMutex);
+        const CrashConfigUse use;
+        const auto config = const_cast<CrashConfig *>(use.get());
+        m_crashDumpStartTime = startTime;
+        if (config && config->descriptor.IsFD()) {
+            succeeded = moveDumpToFd(target->path(), config->descriptor.fd());
+            DumpCallback(config->descriptor, config, succeeded);
+        } else {
+            DumpCallback(*target, config, succeeded);
+        }
+        filePath = QFile::decodeName(m_crashDumpFilePath);
+        if (renewDumpTargets() && succeeded) {
+            announceDump(filePath);
+        }
+    } else {
+        m_crashStats.add(qbreakpad::CrashStats::DumpsFailed);
+        QFile::remove(QFile::decodeName(target->path()));
+    }
+    if (!succeeded) {
+        qWarning().noquote() << "Failed to write snapshot minidump.";
+        filePath.clear();
+    }
+    if (callback) {
+        callback(succeeded, filePath, context);
+    }
+}
+
+// Threads that wait for snapshot children. Declared after everything they use, so
+// static destruction waits for them before tearing it down.
+struct SnapshotFinishers
+{
+    ~SnapshotFinishers()
+    {
+        for (const auto &thread : threads) {
+            thread->wait();
+        }
+    }
+
+    QMutex mutex;
+    std::vector<std::unique_ptr<QThread>> threads;
+};
+
+SnapshotFinishers m_snapshotFinishers;
+// Microseconds the last snapshot spent stopping threads, -1 before the first one.
+std::atomic<qint64> m_lastSnapshotFreezeTime = -1;
+#endif
+
+void updateAsyncDumper()
+{
+    if (!m_asyncDumper.isNull()) {
+        m_asyncDumper->setPolicy(m_asyncDumpPolicy);
+    }
+}
+
+#ifdef Q_OS_LINUX
+// Leaves out the file path of a dump handed over in memory, which the statistics
+// cannot be written next to.
+bool writeMemoryDump(qint64 sizeLimit, QString *filePath)
+{
+    bool onDisk = true;
+    const bool succeeded = writeLimitedMiniDump(filePath, sizeLimit, &onDisk);
+    if (!onDisk) {
+        filePath->clear();
+    }
+    return succeeded;
+}
+
+void updateMemoryMonitor()
+{
+    if (m_memoryPolicy.thresholds.isEmpty() && (m_memoryPolicy.limitPercent <= 0)) {
+        m_memoryMonitor.reset();
+        return;
+    }
+    if (m_memoryMonitor.isNull()) {
+        m_memoryMonitor.reset(new qbreakpad::MemoryMonitor(writeMemoryDump));
+        m_memoryMonitor->setPolicy(m_memoryPolicy);
+        m_memoryMonitor->start();
+    } else {
+        m_memoryMonitor->setPolicy(m_memoryPolicy);
+    }
+}
+#endif
+
+#ifdef Q_OS_WINDOWS
+void createCrashHandler(const std::wstring &dirPath)
+{
+    m_crashHandler.reset(
+        new google_breakpad::ExceptionHandler(dirPath,
+                                              nullptr,
+                                              DumpCallback,
+                                              nullptr,
+                                              google_breakpad::ExceptionHandler::HANDLER_ALL));
+    m_crashHandler->set_handle_debug_exceptions(true);
+
+    _set_invalid_parameter_handler(InvalidParameterHandlerFunc);
+    _set_purecall_handler(PurecallHandlerFunc);
+
+    _CrtSetReportMode(_CRT_ASSERT, 0);
+
+    m_blockUnhandledExceptionFilter = true;
+    m_kernel32Intercept.Init(L"Kernel32");
+    if (!m_kernel32Intercept.AddHook("SetUnhandledExceptionFilter",
+                                     reinterpret_cast<intptr_t>(SetUnhandledExceptionFilterPatched),
+                                     reinterpret_cast<void **>(
+                                         &m_pSetUnhandledExceptionFilterRedirection))) {
+        qWarning().noquote()
+            << "SetUnhandledExceptionFilter hook failed; crash reporter is vulnerable.";
+    }
+}
+#endif
+
+// Everything qbreakpad_installCrashHandler() leaves out. Runs on its own thread
+// when started by qbreakpad_initCrashHandlerAsync().
+void initCrashHandler(const QString &value)
+{
+    const QDir dir(value);
+    if (!dir.exists()) {
+        dir.mkpath(QChar::fromLatin1('.'));
+    }
+    const QString dirPath = QDir::toNativeSeparators(dir.canonicalPath());
+    // The early handler may be writing a requested dump right now. Dumps read the
+    // directory with one of the two mutexes held, or from the published config.
+    m_writeMiniDumpMutex.lock();
+    {
+        const QMutexLocker locker(&m_crashConfigMutex);
+        m_dumpDirPath = dirPath;
+        publishCrashConfig();
+    }
+#ifdef Q_OS_WINDOWS
+    if (m_crashHandler.isNull()) {
+        createCrashHandler(m_dumpDirPath.toStdWString());
+    } else {
+        m_crashHandler->set_dump_path(m_dumpDirPath.toStdWString());
+    }
+#elif defined(Q_OS_LINUX)
+    if (m_dumpCompressionLevel > 0) {
+#ifdef QBREAKPAD_HAS_ZSTD
+        if (m_dumpCompressor.initialize(m_dumpCompressionLevel, kDumpCompressorScratchLimit)) {
+            updateCompressedDumpFilePaths();
+        }
+#else
+        qWarning().noquote() << "QBreakpad was built without zstd, dumps are not compressed.";
+#endif
+    }
+    if ((m_inMemoryDumpSize > 0) && m_inMemoryDump.initialize(size_t(m_inMemoryDumpSize))) {
+        updateInMemoryDumpFilePath();
+        if (m_dumpCompressionLevel > 0) {
+            qWarning().noquote() << "In-memory minidumps are handed over uncompressed.";
+        }
+    }
+    if ((m_dumpSlotCount > 0) && m_threadCapturePolicy.isActive()) {
+        // Breakpad's writer only takes a path when it is given our dumper.
+        qWarning().noquote() << "Dump slots are not used together with thread capture limits.";
+    } else if ((m_dumpSlotCount > 0) && m_dumpSlotPool.isNull()) {
+        m_dumpSlotPool.reset(
+            new qbreakpad::DumpSlotPool(m_dumpDirPath, m_dumpSlotCount, m_dumpSlotSize));
+        m_dumpSlotPool->fill();
+        m_dumpSlotPool->start(QThread::LowPriority);
+        takeDumpSlot();
+    }
+    if (m_threadCapturePolicy.isActive()
+        && ((m_dumpCompressionLevel > 0) || m_microdumpEnabled || m_inMemoryDump.isInitialized())) {
+        qWarning().noquote() << "Thread capture limits only apply to uncompressed minidumps on disk.";
+    }
+    if (m_crashHandler.isNull()) {
+        startDuplicateCrashHandling();
+        m_dumpIndex.open(m_dumpDirPath);
+        m_crashStats.open(m_dumpDirPath);
+        const google_breakpad::MinidumpDescriptor md = makeMinidumpDescriptor();
+        m_crashHandler.reset(
+            new google_breakpad::ExceptionHandler(md, FilterCallback, DumpCallback, nullptr, true, -1));
+        m_crashHandler->set_crash_handler(CrashHandlerCallback);
+        updateDumpConfig();
+    } else {
+        // Breakpad asks the newest handler first, so a microdump handler made now
+        // would take every crash away from the early one.
+        if (m_duplicateCrashMicrodump) {
+            qWarning().noquote() << "Microdumps for duplicate crashes are not written when the"
+                                    " handler comes from qbreakpad_installCrashHandler.";
+        }
+        if (m_duplicateCrashWindow > 0) {
+            openCrashSignatures();
+        }
+        m_dumpIndex.open(m_dumpDirPath);
+        m_crashStats.open(m_dumpDirPath);
+        updateDumpConfig();
+    }
+#elif defined(Q_OS_MACOS)
+    if (m_crashHandler.isNull()) {
+        m_crashHandler.reset(new google_breakpad::ExceptionHandler(m_dumpDirPath.toStdString(),
+                                                                   nullptr,
+                                                                   DumpCallback,
+                                                                   nullptr,
+                                                                   true,
+                                                                   0));
+    } else {
+        m_crashHandler->set_dump_path(m_dumpDirPath.toStdString());
+    }
+#endif
+    m_writeMiniDumpMutex.unlock();
+#ifdef Q_OS_LINUX
+    writeStatsTextFile();
+    if (m_reporterDaemonEnabled) {
+        startReporterDaemon();
+    }
+#endif
+    startDumpRetention(m_dumpDirPath);
+#ifdef QBREAKPAD_HAS_UPLOADER
+    startDumpUploader(m_dumpDirPath);
+#endif
+}
+
+// Waits for it before static destruction tears down what it is setting up.
+struct DeferredInitCleanup
+{
+    static void cleanup(QThread *thread)
+    {
+        if (thread) {
+            thread->wait();
+            delete thread;
+        }
+    }
+};
+
+QScopedPointer<QThread, DeferredInitCleanup> m_deferredInit;
+
+// Setters called while initCrashHandler() runs on its own thread do not wait for
+// it: they change state it reads, so they are queued and replayed on that thread
+// once it is done, in the order they were called.
+QMutex m_deferredSettersMutex;
+bool m_deferredInitRunning = false;
+std::vector<std::function<void()>> m_deferredSetters = {};
+
+// Returns true if setter was queued.
+bool deferSetting(std::function<void()> setter)
+{
+    const QMutexLocker locker(&m_deferredSettersMutex);
+    if (!m_deferredInitRunning || (QThread::currentThread() == m_deferredInit.data())) {
+        return false;
+    }
+    m_deferredSetters.push_back(std::move(setter));
+    return true;
+}
+
+void replayDeferredSettings()
+{
+    for (;;) {
+        std::vector<std::function<void()>> setters = {};
+        {
+            const QMutexLocker locker(&m_deferredSettersMutex);
+            if (m_deferredSetters.empty()) {
+                m_deferredInitRunning = false;
+                return;
+            }
+            setters.swap(m_deferredSetters);
+        }
+        for (const auto &setter : setters) {
+            setter();
+        }
+    }
+}
+
+// For the calls that return what the setup and the queued setters leave behind.
+void waitForDeferredInit()
+{
+    if (!m_deferredInit.isNull()) {
+        m_deferredInit->wait();
+    }
+}
+
+} // namespace
+
+void qbreakpad_installCrashHandler(const char *fallbackDirPath)
+{
+    if (!m_crashHandler.isNull()) {
+        return;
+    }
+    // Meant to be the first thing in main(): only the handler itself, no directory
+    // setup and no other threads.
+#ifdef Q_OS_WINDOWS
+    createCrashHandler((fallbackDirPath && (fallbackDirPath[0] != '\0'))
+                           ? QString::fromLocal8Bit(fallbackDirPath).toStdWString()
+                           : QDir::tempPath().toStdWString());
+#else
+    const char *dirPath = fallbackDirPath;
+    if (!dirPath || (dirPath[0] == '\0')) {
+        dirPath = getenv("TMPDIR");
+    }
+    if (!dirPath || (dirPath[0] == '\0')) {
+        dirPath = "/tmp";
+    }
+#ifdef Q_OS_LINUX
+    m_fallbackDumpDirPath = dirPath;
+    const google_breakpad::MinidumpDescriptor md = makeMinidumpDescriptor();
+    m_crashHandler.reset(
+        new google_breakpad::ExceptionHandler(md, FilterCallback, DumpCallback, nullptr, true, -1));
+    m_crashHandler->set_crash_handler(CrashHandlerCallback);
+    updateDumpConfig();
+#elif defined(Q_OS_MACOS)
+    m_crashHandler.reset(
+        new google_breakpad::ExceptionHandler(dirPath, nullptr, DumpCallback, nullptr, true, 0));
+#endif
+#endif
+    m_earlyCrashHandler = true;
+}
+
+void qbreakpad_initCrashHandler(const QString &value)
+{
+    waitForDeferredInit();
+    if (value.isEmpty() || !m_dumpDirPath.isEmpty()
+        || (!m_crashHandler.isNull() && !m_earlyCrashHandler)) {
+        return;
+    }
+    initCrashHandler(value);
+}
+
+void qbreakpad_initCrashHandlerAsync(const QString &value)
+{
+    if (!m_earlyCrashHandler) {
+        // Nothing would catch a crash while the other thread sets up the handler.
+        qbreakpad_initCrashHandler(value);
+        return;
+    }
+    if (!m_deferredInit.isNull() || !m_dumpDirPath.isEmpty() || value.isEmpty()) {
+        return;
+    }
+    m_deferredInit.reset(QThread::create([value]() {
+        initCrashHandler(value);
+        replayDeferredSettings();
+    }));
+    {
+        const QMutexLocker locker(&m_deferredSettersMutex);
+        m_deferredInitRunning = true;
+    }
+    m_deferredInit->start(QThread::LowPriority);
+}
+
+void qbreakpad_waitForCrashHandler()
+{
+    waitForDeferredInit();
+}
+
+bool qbreakpad_writeMiniDump()
+{
+    waitForDeferredInit();
+    return writeMiniDump(nullptr);
+}
+
+bool qbreakpad_writeSnapshotDump(qbreakpad_MiniDumpCallback callback, void *context)
+{
+    waitForDeferredInit();
+#ifdef Q_OS_LINUX
+    if (m_crashHandler.isNull() || m_dumpDirPath.isEmpty()) {
+        qWarning().noquote() << "Snapshot dumps need qbreakpad_initCrashHandler().";
+        return false;
+    }
+    // Named the way Breakpad names the dumps it writes into the directory.
+    const auto target = std::make_shared<google_breakpad::MinidumpDescriptor>(
+        m_dumpDirPath.toStdString());
+    target->UpdatePath();
+    const qint64 startTime = qbreakpad::CrashStats::now();
+    qint64 freezeTime = 0;
+    m_writeMiniDumpMutex.lock();
+    // The child gets its own copy of the path and of the app memory regions.
+    const pid_t child = qbreakpad::startSnapshotDump(target->path(),
+                                                     m_crashAppMemory,
+                                                     static_cast<off_t>(m_dumpSizeLimit),
+                                                     &freezeTime);
+    m_writeMiniDumpMutex.unlock();
+    m_lastSnapshotFreezeTime.store(freezeTime / 1000);
+    if (child == -1) {
+        qWarning().noquote() << "Failed to take a process snapshot.";
+        return false;
+    }
+    const QMutexLocker locker(&m_snapshotFinishers.mutex);
+    auto &threads = m_snapshotFinishers.threads;
+    threads.erase(std::remove_if(threads.begin(),
+                                 threads.end(),
+                                 [](const std::unique_ptr<QThread> &thread) {
+                                     return thread->isFinished();
+                                 }),
+                  threads.end());
+    threads.emplace_back(QThread::create([child, target, startTime, callback, context]() {
+        finishSnapshotDump(child, target, startTime, callback, context);
+    }));
+    threads.back()->start();
+    return true;
+#else
+    // Without fork() the dump is written in-process, as qbreakpad_writeMiniDump() does.
+    QString filePath = {};
+    const bool succeeded = writeMiniDump(&filePath);
+    if (callback) {
+        callback(succeeded, filePath, context);
+    }
+    return succeeded;
+#endif
+}
+
+void qbreakpad_writeMiniDumpAsync(qbreakpad_MiniDumpCallback callback, void *context)
+{
+    waitForDeferredInit();
+    if (m_asyncDumper.isNull()) {
+        m_asyncDumper.reset(new qbreakpad::AsyncDumper(writeMiniDump));
+        m_asyncDumper->setPolicy(m_asyncDumpPolicy);
+        m_asyncDumper->start(QThread::LowPriority);
+    }
+    m_asyncDumper->request(callback, context);
+}
+
+void qbreakpad_setReporterPath(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setReporterPath(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (value.isEmpty()) {
+        return;
+    }
+    const QString path = QDir::toNativeSeparators(value);
+    if (m_reporterPath == path) {
+        return;
+    }
+    m_reporterPath = path;
+    publishCrashConfig();
+}
+
+void qbreakpad_setReporterDumpFileArgument(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setReporterDumpFileArgument(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_dumpFileArgument != value) {
+        m_dumpFileArgument = value;
+        publishCrashConfig();
+    }
+}
+
+void qbreakpad_setReporterLogFileArgument(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setReporterLogFileArgument(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_logFileArgument != value) {
+        m_logFileArgument = value;
+        publishCrashConfig();
+    }
+}
+
+void qbreakpad_setReporterCommonArguments(const QStringList &value)
+{
+    if (deferSetting([=]() { qbreakpad_setReporterCommonArguments(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_crashReporterArguments != value) {
+        m_crashReporterArguments = value;
+        publishCrashConfig();
+    }
+}
+
+void qbreakpad_setLogFilePath(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setLogFilePath(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (value.isEmpty()) {
+        return;
+    }
+    const QString path = QDir::toNativeSeparators(value);
+    if (m_logFilePath == path) {
+        return;
+    }
+    m_logFilePath = path;
+    publishCrashConfig();
+}
+
+void qbreakpad_setDumpFileExtName(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setDumpFileExtName(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (value.isEmpty()) {
+        return;
+    }
+    QString extName = value.toLower();
+    if (!extName.startsWith(QChar::fromLatin1('.'))) {
+        extName.prepend(QChar::fromLatin1('.'));
+    }
+    if (m_dumpFileExtName != extName) {
+        m_dumpFileExtName = extName;
+#ifdef Q_OS_LINUX
+#ifdef QBREAKPAD_HAS_ZSTD
+        updateCompressedDumpFilePaths();
+#endif
+        updateInMemoryDumpFilePath();
+        updateDumpSlotTargetPath();
+#endif
+        publishCrashConfig();
+    }
+}
+
+void qbreakpad_setReporterDaemonEnabled(bool value)
+{
+    if (deferSetting([=]() { qbreakpad_setReporterDaemonEnabled(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (m_reporterDaemonEnabled != value) {
+        m_reporterDaemonEnabled = value;
+        // Before qbreakpad_initCrashHandler() the daemon is started there.
+        if (!m_crashHandler.isNull() && !m_dumpDirPath.isEmpty()) {
+            if (value) {
+                startReporterDaemon();
+            } else {
+                stopReporterDaemon();
+            }
+        }
+    }
+#else
+    if (value) {
+        qWarning().noquote() << "The crash reporter daemon is only supported on Linux.";
+    }
+#endif
+}
+
+void qbreakpad_setReporterDaemonArgument(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setReporterDaemonArgument(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (m_reporterDaemonArgument != value) {
+        m_reporterDaemonArgument = value;
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_initCrashClient(int value)
+{
+    waitForDeferredInit();
+#ifdef Q_OS_LINUX
+    if (!m_crashHandler.isNull() || (value < 0)) {
+        return;
+    }
+    // Dumps are written by the server into its own directory, the descriptor only
+    // has to be valid.
+    const google_breakpad::MinidumpDescriptor md(QDir::tempPath().toStdString());
+    m_crashHandler.reset(
+        new google_breakpad::ExceptionHandler(md, nullptr, DumpCallback, nullptr, true, value));
+#else
+    Q_UNUSED(value)
+    qWarning().noquote() << "Out-of-process crash handling is only supported on Linux.";
+#endif
+}
+
+bool qbreakpad_startCrashServer(const QString &value, int workerCount)
+{
+    waitForDeferredInit();
+#ifdef Q_OS_LINUX
+    if (!m_crashServerWorkers.empty() || value.isEmpty() || (workerCount <= 0)) {
+        return false;
+    }
+    const QDir dir(value);
+    if (!dir.exists()) {
+        dir.mkpath(QChar::fromLatin1('.'));
+    }
+    const QString dumpDirPath = QDir::toNativeSeparators(dir.canonicalPath());
+    m_crashServerDumpPath = dumpDirPath.toStdString();
+    m_dumpIndex.open(dumpDirPath);
+    m_crashStats.open(dumpDirPath);
+    for (int i = 0; i != workerCount; ++i) {
+        auto worker = std::make_unique<CrashServerWorker>();
+        if (!google_breakpad::CrashGenerationServer::CreateReportChannel(&worker->serverFd,
+                                                                         &worker->clientFd)) {
+            qWarning().noquote() << "Failed to create a crash report channel.";
+            break;
+        }
+        worker->server.reset(new google_breakpad::CrashGenerationServer(worker->serverFd,
+                                                                        OnClientDumpRequest,
+                                                                        nullptr,
+                                                                        nullptr,
+                                                                        nullptr,
+                                                                        true,
+                                                                        &m_crashServerDumpPath));
+        if (!worker->server->Start()) {
+            qWarning().noquote() << "Failed to start the crash generation server.";
+            close(worker->serverFd);
+            close(worker->clientFd);
+            break;
+        }
+        m_crashServerWorkers.push_back(std::move(worker));
+    }
+    if (static_cast<int>(m_crashServerWorkers.size()) != workerCount) {
+        qbreakpad_stopCrashServer();
+        return false;
+    }
+    startDumpRetention(dumpDirPath);
+#ifdef QBREAKPAD_HAS_UPLOADER
+    startDumpUploader(dumpDirPath);
+#endif
+    return true;
+#else
+    Q_UNUSED(value)
+    Q_UNUSED(workerCount)
+    qWarning().noquote() << "Out-of-process crash handling is only supported on Linux.";
+    return false;
+#endif
+}
+
+int qbreakpad_crashServerClientFd()
+{
+    waitForDeferredInit();
+#ifdef Q_OS_LINUX
+    if (m_crashServerWorkers.empty()) {
+        return -1;
+    }
+    // Spread the clients over the workers so that simultaneous crashes are dumped in
+    // parallel instead of queueing up behind a single server thread.
+    const unsigned int index = m_crashServerNextWorker.fetch_add(1, std::memory_order_relaxed);
+    return m_crashServerWorkers.at(index % m_crashServerWorkers.size())->clientFd;
+#else
+    return -1;
+#endif
+}
+
+void qbreakpad_stopCrashServer()
+{
+    waitForDeferredInit();
+#ifdef Q_OS_LINUX
+    for (auto &&worker : m_crashServerWorkers) {
+        worker->server->Stop();
+        worker->server.reset();
+        close(worker->serverFd);
+        close(worker->clientFd);
+    }
+    m_crashServerWorkers.clear();
+#endif
+}
+
+void qbreakpad_setDumpCompressionLevel(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setDumpCompressionLevel(value); })) {
+        return;
+    }
+#if defined(Q_OS_LINUX) && defined(QBREAKPAD_HAS_ZSTD)
+    // Once the handler is set up, the level applies from the next dump on.
+    const QMutexLocker dumpLocker(&m_writeMiniDumpMutex);
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_dumpCompressionLevel == value) {
+        return;
+    }
+    m_dumpCompressionLevel = value;
+    if (!m_crashHandler.isNull() && !m_dumpDirPath.isEmpty() && (value > 0)) {
+        if (m_dumpCompressor.isInitialized()) {
+            m_dumpCompressor.setLevel(value);
+        } else if (m_dumpCompressor.initialize(value, kDumpCompressorScratchLimit)) {
+            updateCompressedDumpFilePaths();
+        }
+    }
+    publishCrashConfig();
+#else
+    if (m_dumpCompressionLevel != value) {
+        m_dumpCompressionLevel = value;
+    }
+#endif
+}
+
+void qbreakpad_setDumpSizeLimit(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setDumpSizeLimit(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_dumpSizeLimit != value) {
+        m_dumpSizeLimit = value;
+        publishCrashConfig();
+    }
+}
+
+void qbreakpad_setMicrodumpEnabled(bool value)
+{
+    if (deferSetting([=]() { qbreakpad_setMicrodumpEnabled(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_microdumpEnabled != value) {
+        m_microdumpEnabled = value;
+        publishCrashConfig();
+    }
+#else
+    if (value) {
+        qWarning().noquote() << "Microdumps are only supported on Linux.";
+    }
+#endif
+}
+
+void qbreakpad_setMicrodumpProductInfo(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setMicrodumpProductInfo(value); })) {
+        return;
+    }
+    const QByteArray productInfo = value.toUtf8();
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_microdumpProductInfo != productInfo) {
+        m_microdumpProductInfo = productInfo;
+        publishCrashConfig();
+    }
+}
+
+void qbreakpad_setSanitizeStacks(bool value)
+{
+    if (deferSetting([=]() { qbreakpad_setSanitizeStacks(value); })) {
+        return;
+    }
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_sanitizeStacks != value) {
+        m_sanitizeStacks = value;
+        publishCrashConfig();
+    }
+}
+
+bool qbreakpad_registerAppMemory(void *ptr, size_t len)
+{
+#ifdef Q_OS_LINUX
+    return ptr && (len > 0) && m_crashAppMemory.add(ptr, len);
+#else
+    Q_UNUSED(ptr)
+    Q_UNUSED(len)
+    return false;
+#endif
+}
+
+void qbreakpad_unregisterAppMemory(void *ptr)
+{
+#ifdef Q_OS_LINUX
+    if (ptr) {
+        m_crashAppMemory.remove(ptr);
+    }
+#else
+    Q_UNUSED(ptr)
+#endif
+}
+
+void qbreakpad_setPrincipalMappingFilter(const void *value)
+{
+    if (deferSetting([=]() { qbreakpad_setPrincipalMappingFilter(value); })) {
+        return;
+    }
+    const auto address = reinterpret_cast<quintptr>(value);
+    const QMutexLocker locker(&m_crashConfigMutex);
+    if (m_principalMappingAddress != address) {
+        m_principalMappingAddress = address;
+        publishCrashConfig();
+    }
+}
+
+void qbreakpad_setDumpRetentionMaxBytes(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setDumpRetentionMaxBytes(value); })) {
+        return;
+    }
+    if (m_retentionMaxBytes != value) {
+        m_retentionMaxBytes = value;
+        updateDumpRetention();
+    }
+}
+
+void qbreakpad_setDumpRetentionMaxCount(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setDumpRetentionMaxCount(value); })) {
+        return;
+    }
+    if (m_retentionMaxCount != value) {
+        m_retentionMaxCount = value;
+        updateDumpRetention();
+    }
+}
+
+void qbreakpad_setDumpRetentionMaxAge(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setDumpRetentionMaxAge(value); })) {
+        return;
+    }
+    if (m_retentionMaxAge != value) {
+        m_retentionMaxAge = value;
+        updateDumpRetention();
+    }
+}
+
+void qbreakpad_setDuplicateCrashWindow(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setDuplicateCrashWindow(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    m_duplicateCrashWindow = value;
+    if ((value > 0) && !m_dumpDirPath.isEmpty()) {
+        openCrashSignatures();
+    }
+#else
+    if (value > 0) {
+        qWarning().noquote() << "Crash deduplication is only supported on Linux.";
+    }
+#endif
+}
+
+void qbreakpad_setDuplicateCrashMicrodump(bool value)
+{
+    if (deferSetting([=]() { qbreakpad_setDuplicateCrashMicrodump(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (value && !m_crashHandler.isNull() && m_duplicateCrashHandler.isNull()) {
+        qWarning().noquote() << "Microdumps for duplicate crashes must be enabled before"
+                                " qbreakpad_initCrashHandler.";
+        return;
+    }
+    m_duplicateCrashMicrodump = value;
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setUploadUrl(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setUploadUrl(value); })) {
+        return;
+    }
+#ifdef QBREAKPAD_HAS_UPLOADER
+    const QUrl url(value);
+    if (m_uploadPolicy.url != url) {
+        m_uploadPolicy.url = url;
+        updateDumpUploader();
+    }
+#else
+    if (!value.isEmpty()) {
+        qWarning().noquote() << "QBreakpad was built without the uploader, dumps are not uploaded.";
+    }
+#endif
+}
+
+void qbreakpad_setUploadBatchSize(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setUploadBatchSize(value); })) {
+        return;
+    }
+#ifdef QBREAKPAD_HAS_UPLOADER
+    if (m_uploadPolicy.batchSize != value) {
+        m_uploadPolicy.batchSize = value;
+        updateDumpUploader();
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setUploadConcurrency(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setUploadConcurrency(value); })) {
+        return;
+    }
+#ifdef QBREAKPAD_HAS_UPLOADER
+    if (m_uploadPolicy.concurrency != value) {
+        m_uploadPolicy.concurrency = value;
+        updateDumpUploader();
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setUploadBandwidthLimit(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setUploadBandwidthLimit(value); })) {
+        return;
+    }
+#ifdef QBREAKPAD_HAS_UPLOADER
+    if (m_uploadPolicy.bandwidthLimit != value) {
+        m_uploadPolicy.bandwidthLimit = value;
+        updateDumpUploader();
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setUploadRetryDelay(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setUploadRetryDelay(value); })) {
+        return;
+    }
+#ifdef QBREAKPAD_HAS_UPLOADER
+    if (m_uploadPolicy.retryDelay != value) {
+        m_uploadPolicy.retryDelay = value;
+        updateDumpUploader();
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setUploadMaxAttempts(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setUploadMaxAttempts(value); })) {
+        return;
+    }
+#ifdef QBREAKPAD_HAS_UPLOADER
+    if (m_uploadPolicy.maxAttempts != value) {
+        m_uploadPolicy.maxAttempts = value;
+        updateDumpUploader();
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setMaxCapturedThreads(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setMaxCapturedThreads(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    const QMutexLocker locker(&m_crashConfigMutex);
+    m_threadCapturePolicy.maxThreads = value;
+    publishCrashConfig();
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setCapturedThreadNamePatterns(const QStringList &value)
+{
+    if (deferSetting([=]() { qbreakpad_setCapturedThreadNamePatterns(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    QByteArray patterns = {};
+    for (const QString &pattern : value) {
+        patterns += pattern.toUtf8() + '\0';
+    }
+    // A crash may still be matching against the patterns of the published copy.
+    const QMutexLocker locker(&m_crashConfigMutex);
+    m_capturedThreadNamePatterns = patterns;
+    publishCrashConfig();
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setThreadStackCaptureLimit(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setThreadStackCaptureLimit(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    const QMutexLocker locker(&m_crashConfigMutex);
+    m_threadCapturePolicy.stackLimit = (value > 0) ? size_t(value) : 0;
+    publishCrashConfig();
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setBreadcrumbCapacity(int threads, int events)
+{
+    if (deferSetting([=]() { qbreakpad_setBreadcrumbCapacity(threads, events); })) {
+        return;
+    }
+    if (!qbreakpad::initializeBreadcrumbs(threads, events)) {
+        qWarning().noquote() << "Breadcrumbs can only be set up once, with positive sizes.";
+    }
+#ifndef Q_OS_LINUX
+    qWarning().noquote() << "Breadcrumbs are only written into dumps on Linux.";
+#endif
+}
+
+void qbreakpad_addBreadcrumb(const char *label, quint64 value)
+{
+    qbreakpad::addBreadcrumb(label, value);
+}
+
+void qbreakpad_setLogTailSize(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setLogTailSize(value); })) {
+        return;
+    }
+    if (!qbreakpad::startLogTail(value)) {
+        qWarning().noquote() << "The log tail can only be set up once, with a size between 1 byte and 1 GiB.";
+    }
+#ifndef Q_OS_LINUX
+    qWarning().noquote() << "The log tail is only written into dumps on Linux.";
+#endif
+}
+
+bool qbreakpad_setAnnotation(const char *key, const char *value)
+{
+    return qbreakpad::setAnnotation(key, value);
+}
+
+void qbreakpad_setAsyncDumpMergeWindow(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setAsyncDumpMergeWindow(value); })) {
+        return;
+    }
+    if (m_asyncDumpPolicy.mergeWindow != value) {
+        m_asyncDumpPolicy.mergeWindow = value;
+        updateAsyncDumper();
+    }
+}
+
+void qbreakpad_setAsyncDumpRate(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setAsyncDumpRate(value); })) {
+        return;
+    }
+    if (m_asyncDumpPolicy.rate != value) {
+        m_asyncDumpPolicy.rate = value;
+        updateAsyncDumper();
+    }
+}
+
+void qbreakpad_setAsyncDumpBurst(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setAsyncDumpBurst(value); })) {
+        return;
+    }
+    if (m_asyncDumpPolicy.burst != value) {
+        m_asyncDumpPolicy.burst = value;
+        updateAsyncDumper();
+    }
+}
+
+void qbreakpad_watchThread(QThread *thread, int threshold)
+{
+    if (deferSetting([=]() { qbreakpad_watchThread(thread, threshold); })) {
+        return;
+    }
+    if (!thread) {
+        return;
+    }
+    if (threshold <= 0) {
+        if (!m_hangWatchdog.isNull()) {
+            m_hangWatchdog->unwatch(thread);
+        }
+        return;
+    }
+    if (m_hangWatchdog.isNull()) {
+        m_hangWatchdog.reset(new qbreakpad::HangWatchdog(writeMiniDump));
+        m_hangWatchdog->setDumpInterval(m_hangDumpInterval);
+        m_hangWatchdog->start();
+    }
+    m_hangWatchdog->watch(thread, threshold);
+}
+
+void qbreakpad_setHangDumpInterval(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setHangDumpInterval(value); })) {
+        return;
+    }
+    if (m_hangDumpInterval != value) {
+        m_hangDumpInterval = value;
+        if (!m_hangWatchdog.isNull()) {
+            m_hangWatchdog->setDumpInterval(value);
+        }
+    }
+}
+
+void qbreakpad_setEmergencyMemoryReserve(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setEmergencyMemoryReserve(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (!qbreakpad::reserveEmergencyMemory(size_t(qMax<qint64>(0, value)))) {
+        qWarning().noquote() << "Failed to reserve" << value << "bytes of emergency memory.";
+    }
+#else
+    if (value > 0) {
+        qWarning().noquote() << "Emergency memory is only supported on Linux.";
+    }
+#endif
+}
+
+void qbreakpad_setAlternateSignalStackSize(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setAlternateSignalStackSize(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (!qbreakpad::setAlternateSignalStackSize(size_t(qMax<qint64>(0, value)))) {
+        qWarning().noquote() << "Failed to install an alternate signal stack of" << value << "bytes.";
+    }
+#else
+    if (value > 0) {
+        qWarning().noquote() << "Alternate signal stacks are only supported on Linux.";
+    }
+#endif
+}
+
+bool qbreakpad_listDumps(const QString &dirPath, QList<qbreakpad_DumpInfo> *dumps)
+{
+    waitForDeferredInit();
+#ifdef Q_OS_LINUX
+    QList<qbreakpad::DumpIndexEntry> entries = {};
+    if (!dumps || !qbreakpad::DumpIndex::read(dirPath.isEmpty() ? m_dumpDirPath : dirPath, &entries)) {
+        return false;
+    }
+    dumps->clear();
+    dumps->reserve(entries.size());
+    for (const qbreakpad::DumpIndexEntry &entry : std::as_const(entries)) {
+        dumps->append({entry.fileName,
+                       entry.timestamp,
+                       entry.size,
+                       entry.signature,
+                       entry.pid,
+                       qbreakpad_DumpState(entry.state),
+                       qbreakpad_UploadState(entry.uploadState)});
+    }
+    return true;
+#else
+    Q_UNUSED(dirPath)
+    Q_UNUSED(dumps)
+    qWarning().noquote() << "The dump index is only supported on Linux.";
+    return false;
+#endif
+}
+
+void qbreakpad_setMemoryDumpThresholds(const QList<qint64> &value)
+{
+    if (deferSetting([=]() { qbreakpad_setMemoryDumpThresholds(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (m_memoryPolicy.thresholds != value) {
+        m_memoryPolicy.thresholds = value;
+        updateMemoryMonitor();
+    }
+#else
+    if (!value.isEmpty()) {
+        qWarning().noquote() << "Memory-pressure dumps are only supported on Linux.";
+    }
+#endif
+}
+
+void qbreakpad_setMemoryDumpLimitPercent(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setMemoryDumpLimitPercent(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (m_memoryPolicy.limitPercent != value) {
+        m_memoryPolicy.limitPercent = value;
+        updateMemoryMonitor();
+    }
+#else
+    if (value > 0) {
+        qWarning().noquote() << "Memory-pressure dumps are only supported on Linux.";
+    }
+#endif
+}
+
+void qbreakpad_setMemoryMonitorInterval(int value)
+{
+    if (deferSetting([=]() { qbreakpad_setMemoryMonitorInterval(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (m_memoryPolicy.interval != value) {
+        m_memoryPolicy.interval = value;
+        if (!m_memoryMonitor.isNull()) {
+            m_memoryMonitor->setPolicy(m_memoryPolicy);
+        }
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setInMemoryDumpSize(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setInMemoryDumpSize(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    m_inMemoryDumpSize = qMax<qint64>(0, value);
+#else
+    if (value > 0) {
+        qWarning().noquote() << "In-memory minidumps are only supported on Linux.";
+    }
+#endif
+}
+
+void qbreakpad_setInMemoryDumpDiskFallback(bool value)
+{
+    if (deferSetting([=]() { qbreakpad_setInMemoryDumpDiskFallback(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    m_inMemoryDumpDiskFallback = value;
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+void qbreakpad_setDumpSlotPool(int count, qint64 size)
+{
+    if (deferSetting([=]() { qbreakpad_setDumpSlotPool(count, size); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    m_dumpSlotCount = qMax(0, count);
+    m_dumpSlotSize = qMax<qint64>(0, size);
+#else
+    if (count > 0) {
+        qWarning().noquote() << "Dump slots are only supported on Linux.";
+    }
+    Q_UNUSED(size)
+#endif
+}
+
+bool qbreakpad_getStats(const QString &dirPath, qbreakpad_Stats *stats)
+{
+    waitForDeferredInit();
+#ifdef Q_OS_LINUX
+    static_assert(qbreakpad_LatencyBucketCount == qbreakpad::CrashStats::kBucketCount,
+                  "the public histograms must match the statistics file");
+    qbreakpad::CrashStatsData data = {};
+    if (!stats || !qbreakpad::CrashStats::read(dirPath.isEmpty() ? m_dumpDirPath : dirPath, &data)) {
+        return false;
+    }
+    stats->dumpsWritten = data.counters[qbreakpad::CrashStats::DumpsWritten];
+    stats->dumpsFailed = data.counters[qbreakpad::CrashStats::DumpsFailed];
+    stats->duplicateCrashes = data.counters[qbreakpad::CrashStats::DuplicateCrashes];
+    stats->bytesWritten = data.counters[qbreakpad::CrashStats::BytesWritten];
+    stats->reporterLaunches = data.counters[qbreakpad::CrashStats::ReporterLaunches];
+    stats->reporterLaunchFailures = data.counters[qbreakpad::CrashStats::ReporterLaunchFailures];
+    stats->reporterNotifications = data.counters[qbreakpad::CrashStats::ReporterNotifications];
+    const auto copyHistogram = [&data](qbreakpad::CrashStats::Histogram histogram,
+                                       qbreakpad_LatencyHistogram *target) {
+        const qbreakpad::CrashStatsHistogram &source = data.histograms[histogram];
+        memcpy(target->buckets, source.buckets, sizeof(target->buckets));
+        target->count = source.count;
+        target->sumMicroseconds = source.sumMicroseconds;
+    };
+    copyHistogram(qbreakpad::CrashStats::DumpWriteTime, &stats->dumpWriteTime);
+    copyHistogram(qbreakpad::CrashStats::ReporterStartTime, &stats->reporterStartTime);
+    return true;
+#else
+    Q_UNUSED(dirPath)
+    Q_UNUSED(stats)
+    qWarning().noquote() << "Crash statistics are only supported on Linux.";
+    return false;
+#endif
+}
+
+qint64 qbreakpad_latencyBucketBound(int index)
+{
+#ifdef Q_OS_LINUX
+    return qbreakpad::CrashStats::bucketBound(index);
+#else
+    Q_UNUSED(index)
+    return -1;
+#endif
+}
+
+void qbreakpad_setStatsTextFile(const QString &value)
+{
+    if (deferSetting([=]() { qbreakpad_setStatsTextFile(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    {
+        const QMutexLocker locker(&m_statsTextFileMutex);
+        m_statsTextFilePath = value;
+    }
+    writeStatsTextFile();
+#else
+    if (!value.isEmpty()) {
+        qWarning().noquote() << "Crash statistics are only supported on Linux.";
+    }
+#endif
+}
+
+bool qbreakpad_installAlternateSignalStack()
+{
+#ifdef Q_OS_LINUX
+    if (!qbreakpad::installAlternateSignalStack()) {
+        qWarning().noquote() << "Failed to install an alternate signal stack.";
+        return false;
+    }
+    return true;
+#else
+    qWarning().noquote() << "Alternate signal stacks are only supported on Linux.";
+    return false;
+#endif
+}
+
+void qbreakpad_setMemoryDumpSizeLimit(qint64 value)
+{
+    if (deferSetting([=]() { qbreakpad_setMemoryDumpSizeLimit(value); })) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (m_memoryPolicy.dumpSizeLimit != value) {
+        m_memoryPolicy.dumpSizeLimit = value;
+        if (!m_memoryMonitor.isNull()) {
+            m_memoryMonitor->setPolicy(m_memoryPolicy);
+        }
+    }
+#else
+    Q_UNUSED(value)
+#endif
+}
+
+qint64 qbreakpad_lastSnapshotFreezeTime()
+{
+#ifdef Q_OS_LINUX
+    return m_lastSnapshotFreezeTime.load();
+#else
+    return -1;
+#endif
 }
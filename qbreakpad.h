@@ -27,10 +27,56 @@
 #include "qbreakpad_global.h"
 #include <QStringList>
 
+QT_FORWARD_DECLARE_CLASS(QThread)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef void (*qbreakpad_MiniDumpCallback)(bool succeeded, const QString &filePath, void *context);
+
+enum qbreakpad_DumpState {
+    qbreakpad_DumpWritten = 1,
+    qbreakpad_DumpFailed,
+    qbreakpad_DumpDuplicate,
+    qbreakpad_DumpRemoved
+};
+
+enum qbreakpad_UploadState { qbreakpad_UploadPending, qbreakpad_Uploaded, qbreakpad_UploadFailed };
+
+enum { qbreakpad_LatencyBucketCount = 16 };
+
+struct qbreakpad_LatencyHistogram
+{
+    quint64 buckets[qbreakpad_LatencyBucketCount];
+    quint64 count;
+    quint64 sumMicroseconds;
+};
+
+struct qbreakpad_Stats
+{
+    quint64 dumpsWritten;
+    quint64 dumpsFailed;
+    quint64 duplicateCrashes;
+    quint64 bytesWritten;
+    quint64 reporterLaunches;
+    quint64 reporterLaunchFailures;
+    quint64 reporterNotifications;
+    qbreakpad_LatencyHistogram dumpWriteTime;
+    qbreakpad_LatencyHistogram reporterStartTime;
+};
+
+struct qbreakpad_DumpInfo
+{
+    QString fileName;
+    qint64 timestamp;
+    qint64 size;
+    quint64 signature;
+    qint64 pid;
+    qbreakpad_DumpState state;
+    qbreakpad_UploadState uploadState;
+};
+
 QBREAKPAD_EXPORT void qbreakpad_initCrashHandler(const QString &value);
 QBREAKPAD_EXPORT bool qbreakpad_writeMiniDump();
 QBREAKPAD_EXPORT void qbreakpad_setReporterPath(const QString &value);
@@ -39,6 +85,63 @@ QBREAKPAD_EXPORT void qbreakpad_setReporterDumpFileArgument(const QString &value
 QBREAKPAD_EXPORT void qbreakpad_setReporterLogFileArgument(const QString &value);
 QBREAKPAD_EXPORT void qbreakpad_setLogFilePath(const QString &value);
 QBREAKPAD_EXPORT void qbreakpad_setDumpFileExtName(const QString &value);
+QBREAKPAD_EXPORT void qbreakpad_setReporterDaemonEnabled(bool value);
+QBREAKPAD_EXPORT void qbreakpad_setReporterDaemonArgument(const QString &value);
+QBREAKPAD_EXPORT void qbreakpad_initCrashClient(int value);
+QBREAKPAD_EXPORT bool qbreakpad_startCrashServer(const QString &value, int workerCount);
+QBREAKPAD_EXPORT int qbreakpad_crashServerClientFd();
+QBREAKPAD_EXPORT void qbreakpad_stopCrashServer();
+QBREAKPAD_EXPORT void qbreakpad_setDumpCompressionLevel(int value);
+QBREAKPAD_EXPORT void qbreakpad_setDumpSizeLimit(qint64 value);
+QBREAKPAD_EXPORT void qbreakpad_setMicrodumpEnabled(bool value);
+QBREAKPAD_EXPORT void qbreakpad_setMicrodumpProductInfo(const QString &value);
+QBREAKPAD_EXPORT void qbreakpad_setSanitizeStacks(bool value);
+QBREAKPAD_EXPORT bool qbreakpad_registerAppMemory(void *ptr, size_t len);
+QBREAKPAD_EXPORT void qbreakpad_unregisterAppMemory(void *ptr);
+QBREAKPAD_EXPORT void qbreakpad_setPrincipalMappingFilter(const void *value);
+QBREAKPAD_EXPORT void qbreakpad_setDumpRetentionMaxBytes(qint64 value);
+QBREAKPAD_EXPORT void qbreakpad_setDumpRetentionMaxCount(int value);
+QBREAKPAD_EXPORT void qbreakpad_setDumpRetentionMaxAge(int value);
+QBREAKPAD_EXPORT void qbreakpad_setDuplicateCrashWindow(int value);
+QBREAKPAD_EXPORT void qbreakpad_setDuplicateCrashMicrodump(bool value);
+QBREAKPAD_EXPORT void qbreakpad_setUploadUrl(const QString &value);
+QBREAKPAD_EXPORT void qbreakpad_setUploadBatchSize(int value);
+QBREAKPAD_EXPORT void qbreakpad_setUploadConcurrency(int value);
+QBREAKPAD_EXPORT void qbreakpad_setUploadBandwidthLimit(qint64 value);
+QBREAKPAD_EXPORT void qbreakpad_setUploadRetryDelay(int value);
+QBREAKPAD_EXPORT void qbreakpad_setUploadMaxAttempts(int value);
+QBREAKPAD_EXPORT void qbreakpad_setMaxCapturedThreads(int value);
+QBREAKPAD_EXPORT void qbreakpad_setCapturedThreadNamePatterns(const QStringList &value);
+QBREAKPAD_EXPORT void qbreakpad_setThreadStackCaptureLimit(qint64 value);
+QBREAKPAD_EXPORT void qbreakpad_setBreadcrumbCapacity(int threads, int events);
+QBREAKPAD_EXPORT void qbreakpad_addBreadcrumb(const char *label, quint64 value);
+QBREAKPAD_EXPORT void qbreakpad_setLogTailSize(qint64 value);
+QBREAKPAD_EXPORT bool qbreakpad_setAnnotation(const char *key, const char *value);
+QBREAKPAD_EXPORT void qbreakpad_writeMiniDumpAsync(qbreakpad_MiniDumpCallback callback, void *context);
+QBREAKPAD_EXPORT void qbreakpad_setAsyncDumpMergeWindow(int value);
+QBREAKPAD_EXPORT void qbreakpad_setAsyncDumpRate(int value);
+QBREAKPAD_EXPORT void qbreakpad_setAsyncDumpBurst(int value);
+QBREAKPAD_EXPORT bool qbreakpad_writeSnapshotDump(qbreakpad_MiniDumpCallback callback, void *context);
+QBREAKPAD_EXPORT void qbreakpad_watchThread(QThread *thread, int threshold);
+QBREAKPAD_EXPORT void qbreakpad_setHangDumpInterval(int value);
+QBREAKPAD_EXPORT void qbreakpad_setMemoryDumpThresholds(const QList<qint64> &value);
+QBREAKPAD_EXPORT void qbreakpad_setMemoryDumpLimitPercent(int value);
+QBREAKPAD_EXPORT void qbreakpad_setMemoryMonitorInterval(int value);
+QBREAKPAD_EXPORT void qbreakpad_setEmergencyMemoryReserve(qint64 value);
+QBREAKPAD_EXPORT void qbreakpad_setAlternateSignalStackSize(qint64 value);
+QBREAKPAD_EXPORT bool qbreakpad_listDumps(const QString &dirPath, QList<qbreakpad_DumpInfo> *dumps);
+QBREAKPAD_EXPORT void qbreakpad_installCrashHandler(const char *fallbackDirPath);
+QBREAKPAD_EXPORT void qbreakpad_initCrashHandlerAsync(const QString &value);
+QBREAKPAD_EXPORT void qbreakpad_waitForCrashHandler();
+QBREAKPAD_EXPORT void qbreakpad_setInMemoryDumpSize(qint64 value);
+QBREAKPAD_EXPORT void qbreakpad_setInMemoryDumpDiskFallback(bool value);
+QBREAKPAD_EXPORT void qbreakpad_setDumpSlotPool(int count, qint64 size);
+QBREAKPAD_EXPORT bool qbreakpad_getStats(const QString &dirPath, qbreakpad_Stats *stats);
+QBREAKPAD_EXPORT qint64 qbreakpad_latencyBucketBound(int index);
+QBREAKPAD_EXPORT void qbreakpad_setStatsTextFile(const QString &value);
+QBREAKPAD_EXPORT bool qbreakpad_installAlternateSignalStack();
+QBREAKPAD_EXPORT void qbreakpad_setMemoryDumpSizeLimit(qint64 value);
+QBREAKPAD_EXPORT qint64 qbreakpad_lastSnapshotFreezeTime();
 
 #ifdef __cplusplus
 }
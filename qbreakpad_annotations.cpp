@@ -0,0 +1,259 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_annotations_p.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#ifdef Q_OS_LINUX
+#include "qbreakpad_streams_p.h"
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace qbreakpad {
+
+namespace {
+
+enum SlotState : quint32 { SlotEmpty, SlotClaiming, SlotReady };
+
+constexpr size_t kValueWords = kAnnotationValueSize / sizeof(quint64);
+
+struct AnnotationValue
+{
+    // Odd while a writer owns the buffer.
+    std::atomic<quint32> sequence;
+    std::atomic<quint64> words[kValueWords];
+};
+
+struct AnnotationSlot
+{
+    std::atomic<quint32> state;
+    // Written once, before state becomes SlotReady.
+    char key[kAnnotationKeySize];
+    // The buffer readers take the value from.
+    std::atomic<quint32> current;
+    AnnotationValue values[kAnnotationValueBuffers];
+};
+
+AnnotationSlot m_slots[kAnnotationSlots] = {};
+
+quint32 hashKey(const char *key, size_t length)
+{
+    quint32 hash = 2166136261u;
+    for (size_t i = 0; i != length; ++i) {
+        hash = (hash ^ quint8(key[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// Takes a buffer that is neither current nor owned by another writer, fills it and
+// makes it current; one pass over the buffers, no waiting. Returns -1 when the other
+// writers of this key own every spare buffer: each of them makes its own value
+// current after this call began, so this one would be replaced anyway.
+int claimValue(AnnotationSlot &slot, quint32 *sequence)
+{
+    for (quint32 index = 0; index != kAnnotationValueBuffers; ++index) {
+        AnnotationValue &buffer = slot.values[index];
+        quint32 expected = buffer.sequence.load(std::memory_order_relaxed);
+        if ((expected & 1) || (index == slot.current.load())
+            || !buffer.sequence.compare_exchange_strong(expected, expected + 1)) {
+            continue;
+        }
+        // Its writer may have made it current between the two checks.
+        if (index == slot.current.load()) {
+            buffer.sequence.store(expected + 2, std::memory_order_release);
+            continue;
+        }
+        *sequence = expected + 1;
+        return int(index);
+    }
+    return -1;
+}
+
+void storeValue(AnnotationSlot &slot, const char *value)
+{
+    quint32 sequence = 0;
+    const int index = claimValue(slot, &sequence);
+    if (index == -1) {
+        return;
+    }
+    AnnotationValue &buffer = slot.values[index];
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const size_t length = value ? strnlen(value, kAnnotationValueSize - 1) : 0;
+    for (size_t word = 0; word != kValueWords; ++word) {
+        const size_t offset = word * sizeof(quint64);
+        quint64 bits = 0;
+        if (offset < length) {
+            memcpy(&bits, value + offset, qMin(sizeof(bits), length - offset));
+        }
+        buffer.words[word].store(bits, std::memory_order_relaxed);
+    }
+    // Current before it is released, so no other writer takes it in between.
+    slot.current.store(quint32(index));
+    buffer.sequence.store(sequence + 1, std::memory_order_release);
+}
+
+#ifdef Q_OS_LINUX
+// Returns false for empty and hidden slots.
+bool readAnnotation(const AnnotationSlot &slot, AnnotationRecord *record, bool *torn)
+{
+    if (slot.state.load(std::memory_order_acquire) != SlotReady) {
+        return false;
+    }
+    memcpy(record->key, slot.key, sizeof(record->key));
+    *torn = true;
+    // A buffer is only rewritten once it is no longer current, which takes a writer
+    // that is in the middle of an update exactly then. The writer may be the crashed
+    // thread itself, so give up after a few tries.
+    for (int attempt = 0; (attempt != 64) && *torn; ++attempt) {
+        const AnnotationValue &buffer = slot.values[slot.current.load()];
+        const quint32 before = buffer.sequence.load(std::memory_order_acquire);
+        for (size_t word = 0; word != kValueWords; ++word) {
+            const quint64 bits = buffer.words[word].load(std::memory_order_relaxed);
+            memcpy(record->value + (word * sizeof(quint64)), &bits, sizeof(bits));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const quint32 after = buffer.sequence.load(std::memory_order_relaxed);
+        *torn = (before & 1) || (before != after);
+    }
+    record->value[kAnnotationValueSize - 1] = '\0';
+    return record->value[0] != '\0';
+}
+
+// Filled on the crash path; static so that it needs no stack.
+AnnotationRecord m_snapshot[kAnnotationSlots] = {};
+
+quint32 snapshotAnnotations(quint32 *torn)
+{
+    quint32 count = 0;
+    *torn = 0;
+    for (const AnnotationSlot &slot : m_slots) {
+        bool slotTorn = false;
+        if (readAnnotation(slot, &m_snapshot[count], &slotTorn)) {
+            *torn += slotTorn ? 1 : 0;
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t written = ::write(fd, data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+bool setAnnotation(const char *key, const char *value)
+{
+    if (!key || (key[0] == '\0')) {
+        return false;
+    }
+    const size_t length = strnlen(key, kAnnotationKeySize - 1);
+    const quint32 hash = hashKey(key, length);
+    for (int probe = 0; probe != kAnnotationSlots; ++probe) {
+        AnnotationSlot &slot = m_slots[(hash + quint32(probe)) % kAnnotationSlots];
+        quint32 state = slot.state.load(std::memory_order_acquire);
+        if (state == SlotEmpty) {
+            if (slot.state.compare_exchange_strong(state, SlotClaiming, std::memory_order_acquire)) {
+                memcpy(slot.key, key, length);
+                slot.key[length] = '\0';
+                slot.state.store(SlotReady, std::memory_order_release);
+                state = SlotReady;
+            }
+        }
+        // Another thread is claiming this slot, possibly for the same key.
+        while (state == SlotClaiming) {
+            std::this_thread::yield();
+            state = slot.state.load(std::memory_order_acquire);
+        }
+        if ((strncmp(slot.key, key, length) == 0) && (slot.key[length] == '\0')) {
+            storeValue(slot, value);
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef Q_OS_LINUX
+bool writeAnnotationStream(MinidumpStreamAppender &appender)
+{
+    AnnotationStreamHeader header = {};
+    header.version = 1;
+    header.keySize = kAnnotationKeySize;
+    header.valueSize = kAnnotationValueSize;
+    header.count = snapshotAnnotations(&header.torn);
+    if (header.count == 0) {
+        return true;
+    }
+    if (!appender.beginStream(kAnnotationStreamType) || !appender.write(&header, sizeof(header))
+        || !appender.write(m_snapshot, header.count * sizeof(AnnotationRecord))) {
+        return false;
+    }
+    appender.endStream();
+    return true;
+}
+
+bool writeAnnotationFile(const char *path)
+{
+    quint32 torn = 0;
+    const quint32 count = snapshotAnnotations(&torn);
+    if (count == 0) {
+        return true;
+    }
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return false;
+    }
+    for (quint32 i = 0; i != count; ++i) {
+        AnnotationRecord &record = m_snapshot[i];
+        // One line per pair, whatever the value contains.
+        for (char &c : record.value) {
+            c = (c == '\n') ? ' ' : c;
+        }
+        const size_t keyLength = strnlen(record.key, sizeof(record.key));
+        const size_t valueLength = strnlen(record.value, sizeof(record.value));
+        if (!writeAll(fd, record.key, keyLength) || !writeAll(fd, "=", 1)
+            || !writeAll(fd, record.value, valueLength) || !writeAll(fd, "\n", 1)) {
+            close(fd);
+            return false;
+        }
+    }
+    return close(fd) == 0;
+}
+#endif
+
+} // namespace qbreakpad
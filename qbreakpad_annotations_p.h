@@ -0,0 +1,77 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+#include <cstddef>
+
+namespace qbreakpad {
+
+class MinidumpStreamAppender;
+
+constexpr int kAnnotationSlots = 64;
+constexpr size_t kAnnotationKeySize = 32;
+constexpr size_t kAnnotationValueSize = 128;
+constexpr quint32 kAnnotationValueBuffers = 4;
+
+// A fixed table of key/value pairs, both NUL-terminated and cut to fit. A key
+// claims a slot the first time it is set and keeps it. Each key has
+// kAnnotationValueBuffers value buffers: an update fills one that no reader takes
+// the value from and makes it current with one atomic store, so updates never
+// allocate and, once the key has its slot, never wait for each other. The crash
+// path can tell a complete value from one that was being written. With more
+// updates of one key in progress than spare buffers, the late ones are dropped in
+// favour of those. An empty value hides the key. Returns false when every slot is
+// taken by other keys.
+bool setAnnotation(const char *key, const char *value);
+
+struct AnnotationRecord
+{
+    char key[kAnnotationKeySize];
+    char value[kAnnotationValueSize];
+};
+
+#ifdef Q_OS_LINUX
+// Stream layout: AnnotationStreamHeader followed by count AnnotationRecords.
+struct AnnotationStreamHeader
+{
+    quint32 version;
+    quint32 count;
+    quint32 keySize;
+    quint32 valueSize;
+    // Values that were still being written after a few retries; they are included
+    // as read and may mix the old and the new value.
+    quint32 torn;
+    quint32 reserved;
+};
+
+// Async-signal-safe.
+bool writeAnnotationStream(MinidumpStreamAppender &appender);
+// Writes "key=value" lines to a new file at path, for the reporter; no file is
+// created when there are no annotations. Async-signal-safe.
+bool writeAnnotationFile(const char *path);
+#endif
+
+} // namespace qbreakpad
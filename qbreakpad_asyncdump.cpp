@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_asyncdump_p.h"
+
+#include <algorithm>
+
+namespace qbreakpad {
+
+AsyncDumper::AsyncDumper(const WriteFunction &write)
+    : m_write(write)
+{
+    setObjectName(QStringLiteral("QBreakpad async dumper"));
+}
+
+AsyncDumper::~AsyncDumper()
+{
+    m_mutex.lock();
+    m_stopRequested = true;
+    m_condition.wakeAll();
+    m_mutex.unlock();
+    wait();
+}
+
+void AsyncDumper::setPolicy(const AsyncDumpPolicy &policy)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_policy = policy;
+    // A new rate starts with a full bucket, not with what the old one left.
+    m_tokens = std::max(1, m_policy.burst);
+    m_tokenClock.start();
+    m_condition.wakeAll();
+}
+
+void AsyncDumper::request(Callback callback, void *context)
+{
+    const QMutexLocker locker(&m_mutex);
+    if (m_waiters.isEmpty()) {
+        m_waitingSince.start();
+    }
+    m_waiters.append({callback, context});
+    m_condition.wakeAll();
+}
+
+void AsyncDumper::run()
+{
+    m_mutex.lock();
+    m_tokens = std::max(1, m_policy.burst);
+    m_tokenClock.start();
+    while (!m_stopRequested) {
+        if (m_waiters.isEmpty()) {
+            m_condition.wait(&m_mutex);
+            continue;
+        }
+        const qint64 mergeRemaining = m_policy.mergeWindow - m_waitingSince.elapsed();
+        if (mergeRemaining > 0) {
+            m_condition.wait(&m_mutex, (unsigned long)mergeRemaining);
+            continue;
+        }
+        const int tokenRemaining = msecsUntilToken();
+        if (tokenRemaining > 0) {
+            m_condition.wait(&m_mutex, (unsigned long)tokenRemaining);
+            continue;
+        }
+        // Without a rate there is no bucket to take from.
+        if (m_policy.rate > 0) {
+            m_tokens -= 1;
+        }
+        const QList<Waiter> waiters = m_waiters;
+        m_waiters.clear();
+        m_mutex.unlock();
+        QString filePath = {};
+        const bool succeeded = m_write(&filePath);
+        answer(waiters, succeeded, filePath);
+        m_mutex.lock();
+    }
+    const QList<Waiter> waiters = m_waiters;
+    m_waiters.clear();
+    m_mutex.unlock();
+    answer(waiters, false, QString());
+}
+
+void AsyncDumper::answer(const QList<Waiter> &waiters, bool succeeded, const QString &filePath)
+{
+    for (const Waiter &waiter : waiters) {
+        if (waiter.callback) {
+            waiter.callback(succeeded, filePath, waiter.context);
+        }
+    }
+}
+
+// Called with m_mutex held. Refills the bucket and returns 0 when a dump may be
+// written now.
+int AsyncDumper::msecsUntilToken()
+{
+    if (m_policy.rate <= 0) {
+        return 0;
+    }
+    const double burst = std::max(1, m_policy.burst);
+    const double perMsec = m_policy.rate / (60.0 * 60.0 * 1000.0);
+    m_tokens = std::min(burst, m_tokens + (m_tokenClock.restart() * perMsec));
+    if (m_tokens >= 1) {
+        return 0;
+    }
+    return std::max(1, int((1 - m_tokens) / perMsec));
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,90 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <functional>
+
+namespace qbreakpad {
+
+struct AsyncDumpPolicy
+{
+    // How long the first request waits for others to join it, in milliseconds.
+    int mergeWindow = 100;
+    // Dumps per hour, and how many may be written back to back; a rate of zero or
+    // less means no limit.
+    int rate = 60;
+    int burst = 3;
+};
+
+// Writes diagnostic dumps on its own thread. Requests that are waiting for the
+// merge window, for a token of the rate limit or for the dump in progress to end
+// are all answered by the next dump, so a flood of requests turns into one dump
+// per token at most, and no request is ever dropped.
+class AsyncDumper : public QThread
+{
+public:
+    using WriteFunction = std::function<bool(QString *filePath)>;
+    using Callback = void (*)(bool succeeded, const QString &filePath, void *context);
+
+    explicit AsyncDumper(const WriteFunction &write);
+    ~AsyncDumper() override;
+
+    void setPolicy(const AsyncDumpPolicy &policy);
+    void request(Callback callback, void *context);
+
+protected:
+    void run() override;
+
+private:
+    struct Waiter
+    {
+        Callback callback = nullptr;
+        void *context = nullptr;
+    };
+
+    static void answer(const QList<Waiter> &waiters, bool succeeded, const QString &filePath);
+    int msecsUntilToken();
+
+    const WriteFunction m_write;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    AsyncDumpPolicy m_policy = {};
+    QList<Waiter> m_waiters = {};
+    QElapsedTimer m_waitingSince;
+    bool m_stopRequested = false;
+
+    // Only touched by the worker thread.
+    double m_tokens = 0;
+    QElapsedTimer m_tokenClock;
+};
+
+} // namespace qbreakpad
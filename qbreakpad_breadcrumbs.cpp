@@ -0,0 +1,288 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_breadcrumbs_p.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#ifdef Q_OS_WINDOWS
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include "qbreakpad_streams_p.h"
+#include <ctime>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace qbreakpad {
+
+namespace {
+
+struct Breadcrumb
+{
+    std::atomic<quint64> monotonicNs;
+    std::atomic<quint64> value;
+    std::atomic<const char *> label;
+};
+
+struct BreadcrumbRing
+{
+    // Only the owning thread writes head; release so that a reader that sees an
+    // index also sees the event stored before it.
+    std::atomic<quint64> head;
+    // Kept after the thread exits, its events stay in the ring until the next
+    // thread claims it.
+    std::atomic<quint32> threadId;
+    std::atomic<bool> inUse;
+    quint64 capacityMask;
+    Breadcrumb *events;
+};
+
+struct BreadcrumbPool
+{
+    int ringCount = 0;
+    quint64 capacityMask = 0;
+    std::unique_ptr<BreadcrumbRing[]> rings = {};
+    std::unique_ptr<Breadcrumb[]> events = {};
+};
+
+// Never freed, threads may still be recording while the process exits.
+std::atomic<BreadcrumbPool *> m_pool = nullptr;
+std::atomic<quint64> m_dropped = 0;
+
+quint32 currentThreadId()
+{
+#ifdef Q_OS_LINUX
+    return quint32(syscall(SYS_gettid));
+#elif defined(Q_OS_WINDOWS)
+    return quint32(GetCurrentThreadId());
+#else
+    static std::atomic<quint32> nextId = 1;
+    return nextId.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+struct ThreadRing
+{
+    BreadcrumbRing *ring = nullptr;
+    bool claimed = false;
+
+    ~ThreadRing()
+    {
+        if (ring) {
+            ring->inUse.store(false, std::memory_order_release);
+        }
+    }
+
+    BreadcrumbRing *claim(BreadcrumbPool *pool)
+    {
+        claimed = true;
+        const quint32 threadId = currentThreadId();
+        for (int i = 0; i != pool->ringCount; ++i) {
+            bool expected = false;
+            if (pool->rings[i].inUse.compare_exchange_strong(expected,
+                                                             true,
+                                                             std::memory_order_acq_rel)) {
+                ring = &pool->rings[i];
+                break;
+            }
+        }
+        if (ring) {
+            // The events of the previous thread must not show up under this one's
+            // id: the ring starts over before the id is published.
+            ring->head.store(0, std::memory_order_relaxed);
+            ring->threadId.store(threadId, std::memory_order_release);
+        }
+        return ring;
+    }
+};
+
+thread_local ThreadRing t_ring;
+
+} // namespace
+
+bool initializeBreadcrumbs(int threadCount, int eventsPerThread)
+{
+    if ((threadCount <= 0) || (eventsPerThread <= 0) || m_pool.load(std::memory_order_acquire)) {
+        return false;
+    }
+    quint64 capacity = 1;
+    while (capacity < quint64(eventsPerThread)) {
+        capacity <<= 1;
+    }
+    auto pool = new BreadcrumbPool;
+    pool->ringCount = threadCount;
+    pool->capacityMask = capacity - 1;
+    pool->rings.reset(new BreadcrumbRing[threadCount]());
+    pool->events.reset(new Breadcrumb[size_t(threadCount) * capacity]());
+    for (int i = 0; i != threadCount; ++i) {
+        pool->rings[i].capacityMask = capacity - 1;
+        pool->rings[i].events = pool->events.get() + (size_t(i) * capacity);
+    }
+    BreadcrumbPool *expected = nullptr;
+    if (!m_pool.compare_exchange_strong(expected, pool, std::memory_order_acq_rel)) {
+        delete pool;
+        return false;
+    }
+    return true;
+}
+
+void addBreadcrumb(const char *label, quint64 value)
+{
+    BreadcrumbRing *ring = t_ring.ring;
+    if (!ring) {
+        BreadcrumbPool *pool = m_pool.load(std::memory_order_acquire);
+        if (!pool) {
+            return;
+        }
+        if (t_ring.claimed || !t_ring.claim(pool)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring = t_ring.ring;
+    }
+    const quint64 head = ring->head.load(std::memory_order_relaxed);
+    Breadcrumb &event = ring->events[head & ring->capacityMask];
+    event.monotonicNs.store(quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch())
+                                        .count()),
+                            std::memory_order_relaxed);
+    event.value.store(value, std::memory_order_relaxed);
+    event.label.store(label, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+#ifdef Q_OS_LINUX
+namespace {
+
+struct LabelCacheEntry
+{
+    const char *label;
+    char text[sizeof(BreadcrumbRecord::label)];
+};
+
+// Labels are meant to be string literals, so there are few distinct pointers.
+LabelCacheEntry m_labelCache[64] = {};
+
+quint64 clockNs(clockid_t clock)
+{
+    timespec ts = {};
+    clock_gettime(clock, &ts);
+    return (quint64(ts.tv_sec) * 1000000000) + quint64(ts.tv_nsec);
+}
+
+// A bad label pointer must not fault inside the crash handler, so the text is
+// read through the kernel, which reports EFAULT instead.
+void copyLabel(const char *label, char *text)
+{
+    LabelCacheEntry &entry = m_labelCache[(quintptr(label) >> 3) % 64];
+    if (entry.label != label) {
+        memset(entry.text, 0, sizeof(entry.text));
+        if (label) {
+            iovec local = {entry.text, sizeof(entry.text) - 1};
+            iovec remote = {const_cast<char *>(label), sizeof(entry.text) - 1};
+            if (process_vm_readv(getpid(), &local, 1, &remote, 1, 0) <= 0) {
+                // Probably a literal that ends right before an unmapped page.
+                for (size_t i = 0; i != sizeof(entry.text) - 1; ++i) {
+                    local = {entry.text + i, 1};
+                    remote = {const_cast<char *>(label + i), 1};
+                    if ((process_vm_readv(getpid(), &local, 1, &remote, 1, 0) != 1)
+                        || (entry.text[i] == '\0')) {
+                        break;
+                    }
+                }
+            }
+        }
+        entry.label = label;
+    }
+    memcpy(text, entry.text, sizeof(entry.text));
+}
+
+} // namespace
+
+bool writeBreadcrumbStream(MinidumpStreamAppender &appender)
+{
+    BreadcrumbPool *pool = m_pool.load(std::memory_order_acquire);
+    if (!pool) {
+        return true;
+    }
+    const quint64 capacity = pool->capacityMask + 1;
+    BreadcrumbStreamHeader header = {};
+    header.version = 1;
+    header.ringCapacity = quint32(capacity);
+    header.labelSize = sizeof(BreadcrumbRecord::label);
+    header.monotonicNs = clockNs(CLOCK_MONOTONIC);
+    header.realtimeNs = clockNs(CLOCK_REALTIME);
+    header.dropped = m_dropped.load(std::memory_order_relaxed);
+    for (int i = 0; i != pool->ringCount; ++i) {
+        header.ringCount += (pool->rings[i].head.load(std::memory_order_acquire) > 0) ? 1 : 0;
+    }
+    if (!appender.beginStream(kBreadcrumbStreamType) || !appender.write(&header, sizeof(header))) {
+        return false;
+    }
+    quint32 written = 0;
+    // A ring that started recording since it was counted is left out.
+    for (int i = 0; (i != pool->ringCount) && (written != header.ringCount); ++i) {
+        const BreadcrumbRing &ring = pool->rings[i];
+        const quint32 threadId = ring.threadId.load(std::memory_order_acquire);
+        const quint64 head = ring.head.load(std::memory_order_acquire);
+        if (head == 0) {
+            continue;
+        }
+        ++written;
+        // A new thread claimed the ring meanwhile, head may be either thread's.
+        const quint64 count = (ring.threadId.load(std::memory_order_acquire) == threadId)
+                                  ? qMin(head, capacity)
+                                  : 0;
+        const BreadcrumbRingHeader ringHeader = {threadId, quint32(count), head};
+        if (!appender.write(&ringHeader, sizeof(ringHeader))) {
+            return false;
+        }
+        for (quint64 index = head - count; index != head; ++index) {
+            const Breadcrumb &event = ring.events[index & pool->capacityMask];
+            BreadcrumbRecord record = {};
+            record.monotonicNs = event.monotonicNs.load(std::memory_order_relaxed);
+            record.value = event.value.load(std::memory_order_relaxed);
+            copyLabel(event.label.load(std::memory_order_relaxed), record.label);
+            if (!appender.write(&record, sizeof(record))) {
+                return false;
+            }
+        }
+    }
+    // Counted rings that a new thread has started over since are written empty.
+    for (; written != header.ringCount; ++written) {
+        const BreadcrumbRingHeader ringHeader = {0, 0, 0};
+        if (!appender.write(&ringHeader, sizeof(ringHeader))) {
+            return false;
+        }
+    }
+    appender.endStream();
+    return true;
+}
+#endif
+
+} // namespace qbreakpad
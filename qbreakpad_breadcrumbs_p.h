@@ -0,0 +1,75 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+
+namespace qbreakpad {
+
+class MinidumpStreamAppender;
+
+// Breadcrumbs are kept in fixed size rings, one per thread, that are allocated up
+// front. A thread claims a free ring the first time it records and gives it back
+// when it exits, the events stay until the next thread claims the ring and starts
+// it over. Once every ring is taken further threads only count as dropped.
+// Recording is a clock read and a few relaxed stores into the thread's own ring.
+bool initializeBreadcrumbs(int threadCount, int eventsPerThread);
+void addBreadcrumb(const char *label, quint64 value);
+
+#ifdef Q_OS_LINUX
+// Stream layout, little endian, oldest event of every ring first:
+//   BreadcrumbStreamHeader
+//   ringCount x { BreadcrumbRingHeader, eventCount x BreadcrumbRecord }
+struct BreadcrumbStreamHeader
+{
+    quint32 version;
+    quint32 ringCount;
+    quint32 ringCapacity;
+    quint32 labelSize;
+    // Both clocks when the dump was written, to turn event times into wall time.
+    quint64 monotonicNs;
+    quint64 realtimeNs;
+    quint64 dropped;
+};
+
+struct BreadcrumbRingHeader
+{
+    quint32 threadId;
+    quint32 eventCount;
+    quint64 head;
+};
+
+struct BreadcrumbRecord
+{
+    quint64 monotonicNs;
+    quint64 value;
+    char label[32];
+};
+
+// Async-signal-safe.
+bool writeBreadcrumbStream(MinidumpStreamAppender &appender);
+#endif
+
+} // namespace qbreakpad
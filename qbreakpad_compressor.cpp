@@ -0,0 +1,193 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_compressor_p.h"
+
+#include <QDebug>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+void *allocatePages(size_t size)
+{
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (memory == MAP_FAILED) ? nullptr : memory;
+}
+
+bool writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+int createOutputFile(const char *path)
+{
+    return open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+}
+
+} // namespace
+
+void *DumpCompressor::createStream(int level)
+{
+    const size_t workspaceSize = ZSTD_estimateCStreamSize(level);
+    void *workspace = allocatePages(workspaceSize);
+    ZSTD_CStream *stream = workspace ? ZSTD_initStaticCStream(workspace, workspaceSize) : nullptr;
+    if (!stream) {
+        return nullptr;
+    }
+    ZSTD_CCtx_setParameter(stream, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(stream, ZSTD_c_checksumFlag, 1);
+    return stream;
+}
+
+bool DumpCompressor::initialize(int level, off_t scratchLimit)
+{
+    if (isInitialized()) {
+        return true;
+    }
+    m_inBufferSize = ZSTD_CStreamInSize();
+    m_outBufferSize = ZSTD_CStreamOutSize();
+    void *stream = createStream(level);
+    m_inBuffer = static_cast<char *>(allocatePages(m_inBufferSize));
+    m_outBuffer = static_cast<char *>(allocatePages(m_outBufferSize));
+    if (!stream || !m_inBuffer || !m_outBuffer) {
+        qWarning().noquote() << "Failed to allocate the minidump compressor.";
+        return false;
+    }
+    m_stream.store(stream);
+    m_scratchLimit = scratchLimit;
+    m_scratchFd = memfd_create("qbreakpad-minidump", MFD_CLOEXEC);
+    if (m_scratchFd == -1) {
+        qWarning().noquote() << "Failed to create the minidump scratch file.";
+        return false;
+    }
+    return true;
+}
+
+bool DumpCompressor::setLevel(int level)
+{
+    void *stream = createStream(level);
+    if (!stream) {
+        qWarning().noquote() << "Failed to allocate the minidump compressor.";
+        return false;
+    }
+    m_stream.store(stream);
+    return true;
+}
+
+bool DumpCompressor::compress(const char *path)
+{
+    if (!isInitialized()) {
+        return false;
+    }
+    struct stat st = {};
+    const int outFd = (fstat(m_scratchFd, &st) == 0) ? createOutputFile(path) : -1;
+    if (outFd == -1) {
+        return false;
+    }
+
+    auto stream = static_cast<ZSTD_CStream *>(m_stream.load());
+    ZSTD_CCtx_reset(stream, ZSTD_reset_session_only);
+    ZSTD_CCtx_setPledgedSrcSize(stream, static_cast<unsigned long long>(st.st_size));
+    bool ok = true;
+    off_t offset = 0;
+    bool last = false;
+    while (ok && !last) {
+        const ssize_t count = pread(m_scratchFd, m_inBuffer, m_inBufferSize, offset);
+        if (count < 0) {
+            ok = (errno == EINTR);
+            continue;
+        }
+        offset += count;
+        last = (count == 0) || (offset >= st.st_size);
+        ZSTD_inBuffer in = {m_inBuffer, static_cast<size_t>(count), 0};
+        bool flushed = false;
+        while (ok && !flushed) {
+            ZSTD_outBuffer out = {m_outBuffer, m_outBufferSize, 0};
+            const size_t remaining
+                = ZSTD_compressStream2(stream, &out, &in, last ? ZSTD_e_end : ZSTD_e_continue);
+            ok = !ZSTD_isError(remaining) && writeAll(outFd, m_outBuffer, out.pos);
+            flushed = last ? (remaining == 0) : (in.pos == in.size);
+        }
+    }
+    close(outFd);
+    if (!ok) {
+        unlink(path);
+    }
+    return ok;
+}
+
+bool DumpCompressor::copy(const char *path)
+{
+    if (!isInitialized()) {
+        return false;
+    }
+    struct stat st = {};
+    const int outFd = (fstat(m_scratchFd, &st) == 0) ? createOutputFile(path) : -1;
+    if (outFd == -1) {
+        return false;
+    }
+    off_t offset = 0;
+    bool ok = true;
+    while (ok && (offset < st.st_size)) {
+        const ssize_t count = sendfile(outFd, m_scratchFd, &offset, st.st_size - offset);
+        ok = (count > 0) || ((count < 0) && (errno == EINTR));
+    }
+    close(outFd);
+    return ok;
+}
+
+bool DumpCompressor::scratchFull() const
+{
+    struct stat st = {};
+    return (m_scratchLimit > 0) && (fstat(m_scratchFd, &st) == 0) && (st.st_size >= m_scratchLimit);
+}
+
+void DumpCompressor::discardScratch()
+{
+    if (ftruncate(m_scratchFd, 0) == 0) {
+        lseek(m_scratchFd, 0, SEEK_SET);
+    }
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,69 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace qbreakpad {
+
+// Compresses a finished minidump with zstd from inside the crash handler. Breakpad
+// seeks while it writes, so the dump is first written into an in-memory scratch file
+// (a memfd); compress() then streams it into the final .zst file using buffers and a
+// zstd context that were all allocated up front by initialize(). The scratch file
+// costs as much memory as the dump, so dumps are only written into it up to
+// scratchLimit bytes; scratchFull() tells a dump that failed on the limit.
+class DumpCompressor
+{
+public:
+    bool initialize(int level, off_t scratchLimit);
+    bool isInitialized() const { return m_scratchFd != -1; }
+    int scratchFd() const { return m_scratchFd; }
+    off_t scratchLimit() const { return m_scratchLimit; }
+    // Takes effect with the next dump. A crash may still be using the old context,
+    // which therefore stays allocated.
+    bool setLevel(int level);
+
+    // Async-signal-safe. compress() writes a .zst file, copy() is the uncompressed
+    // fallback; discardScratch() empties the scratch file for the next dump.
+    bool compress(const char *path);
+    bool copy(const char *path);
+    bool scratchFull() const;
+    void discardScratch();
+
+private:
+    static void *createStream(int level);
+
+    int m_scratchFd = -1;
+    off_t m_scratchLimit = 0;
+    std::atomic<void *> m_stream = nullptr;
+    char *m_inBuffer = nullptr;
+    size_t m_inBufferSize = 0;
+    char *m_outBuffer = nullptr;
+    size_t m_outBufferSize = 0;
+};
+
+} // namespace qbreakpad
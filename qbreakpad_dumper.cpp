@@ -0,0 +1,532 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_dumper_p.h"
+
+#include <QtGlobal>
+#include <client/linux/microdump_writer/microdump_writer.h>
+#include <google_breakpad/common/minidump_exception_linux.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+constexpr size_t kDumperStackSize = 64 * 1024;
+
+constexpr quint32 kMinidumpSignature = 0x504d444d; // "MDMP"
+constexpr quint32 kExceptionStream = 6;
+// MDRawDirectory: stream_type, data_size, rva.
+constexpr size_t kDirectoryEntrySize = 12;
+// MDRawExceptionStream: thread_id, __align, then MDException: exception_code,
+// exception_flags, exception_record, exception_address.
+constexpr off_t kExceptionAddressOffset = 24;
+
+struct DumpRequest
+{
+    const google_breakpad::MinidumpDescriptor *descriptor;
+    const google_breakpad::ExceptionHandler::CrashContext *context;
+    const ThreadCapturePolicy *policy;
+    const AppMemoryRegions *appMemory;
+    pid_t crashingProcess;
+    int syncFd;
+    off_t fileSizeLimit;
+};
+
+// The child is not created with CLONE_VM, it runs on its own copy of this, and of
+// the request on its parent's stack.
+alignas(16) char g_dumperStack[kDumperStackSize] = {};
+
+bool globMatch(const char *pattern, const char *text)
+{
+    const char *star = nullptr;
+    const char *resume = nullptr;
+    while (*text != '\0') {
+        if ((*pattern == '?') || ((*pattern != '*') && (*pattern == *text))) {
+            ++pattern;
+            ++text;
+        } else if (*pattern == '*') {
+            star = pattern++;
+            resume = text;
+        } else if (star) {
+            pattern = star + 1;
+            text = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        ++pattern;
+    }
+    return *pattern == '\0';
+}
+
+// Without a ucontext Breakpad's writer takes the crash address of a live process
+// from the instruction pointer of the crashing thread, replacing the one dumperMain()
+// set, so si_addr is put back into the finished dump.
+bool restoreCrashAddress(const char *path, uintptr_t address)
+{
+    const int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    quint32 header[4] = {};
+    bool ok = (pread(fd, header, sizeof(header), 0) == ssize_t(sizeof(header)))
+              && (header[0] == kMinidumpSignature);
+    for (quint32 i = 0; ok && (i != header[2]); ++i) {
+        quint32 entry[3] = {};
+        ok = pread(fd, entry, kDirectoryEntrySize, off_t(header[3] + (i * kDirectoryEntrySize)))
+             == ssize_t(kDirectoryEntrySize);
+        if (ok && (entry[0] == kExceptionStream)) {
+            const quint64 value = address;
+            ok = pwrite(fd, &value, sizeof(value), off_t(entry[2]) + kExceptionAddressOffset)
+                 == ssize_t(sizeof(value));
+            break;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+bool writeThreadLimitedDump(const DumpRequest &request,
+                            const google_breakpad::AppMemoryList &appMemory)
+{
+    const char *path = request.descriptor->path();
+    ThreadLimitedDumper dumper(request.crashingProcess, *request.policy, request.context);
+    dumper.set_crash_address(reinterpret_cast<uintptr_t>(request.context->siginfo.si_addr));
+    dumper.set_crash_signal(request.context->siginfo.si_signo);
+    dumper.set_crash_thread(request.context->tid);
+    return google_breakpad::WriteMinidump(path,
+                                          google_breakpad::MappingList(),
+                                          appMemory,
+                                          &dumper)
+           && restoreCrashAddress(path,
+                                  reinterpret_cast<uintptr_t>(request.context->siginfo.si_addr));
+}
+
+// What ExceptionHandler::DoDump() does with the handler's descriptor.
+int dumperMain(void *argument)
+{
+    const auto request = static_cast<const DumpRequest *>(argument);
+    // Wait until the crashed process has allowed us to ptrace it.
+    char ready = 0;
+    while ((read(request->syncFd, &ready, 1) == -1) && (errno == EINTR)) {
+    }
+    if (request->fileSizeLimit > 0) {
+        // Our own limits and signal handlers: a write past the limit fails with
+        // EFBIG instead of growing the file.
+        struct sigaction action = {};
+        action.sa_handler = SIG_IGN;
+        sigaction(SIGXFSZ, &action, nullptr);
+        const rlimit limit = {rlim_t(request->fileSizeLimit), rlim_t(request->fileSizeLimit)};
+        setrlimit(RLIMIT_FSIZE, &limit);
+    }
+    // Our own copies, and two of the getters Breakpad needs here are not const.
+    auto &md = const_cast<google_breakpad::MinidumpDescriptor &>(*request->descriptor);
+    const google_breakpad::AppMemoryList &appMemory
+        = const_cast<AppMemoryRegions *>(request->appMemory)->collect();
+    const auto context = request->context;
+    bool ok = false;
+    if (md.IsMicrodumpOnConsole()) {
+        ok = google_breakpad::WriteMicrodump(request->crashingProcess,
+                                             context,
+                                             sizeof(*context),
+                                             google_breakpad::MappingList(),
+                                             md.skip_dump_if_principal_mapping_not_referenced(),
+                                             md.address_within_principal_mapping(),
+                                             md.sanitize_stacks(),
+                                             *md.microdump_extra_info());
+    } else if (md.IsFD()) {
+        ok = google_breakpad::WriteMinidump(md.fd(),
+                                            md.size_limit(),
+                                            request->crashingProcess,
+                                            context,
+                                            sizeof(*context),
+                                            google_breakpad::MappingList(),
+                                            appMemory,
+                                            md.skip_dump_if_principal_mapping_not_referenced(),
+                                            md.address_within_principal_mapping(),
+                                            md.sanitize_stacks());
+    } else if (request->policy->isActive()) {
+        ok = writeThreadLimitedDump(*request, appMemory);
+    } else {
+        ok = google_breakpad::WriteMinidump(md.path(),
+                                            md.size_limit(),
+                                            request->crashingProcess,
+                                            context,
+                                            sizeof(*context),
+                                            google_breakpad::MappingList(),
+                                            appMemory,
+                                            md.skip_dump_if_principal_mapping_not_referenced(),
+                                            md.address_within_principal_mapping(),
+                                            md.sanitize_stacks());
+    }
+    _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+} // namespace
+
+ThreadLimitedDumper::ThreadLimitedDumper(pid_t pid,
+                                         const ThreadCapturePolicy &policy,
+                                         const google_breakpad::ExceptionHandler::CrashContext *context)
+    : google_breakpad::LinuxPtraceDumper(pid)
+    , m_policy(policy)
+    , m_context(context)
+{}
+
+bool ThreadLimitedDumper::EnumerateThreads()
+{
+    if (!google_breakpad::LinuxPtraceDumper::EnumerateThreads()) {
+        return false;
+    }
+    if (m_policy.maxThreads < 0) {
+        return true;
+    }
+    // Threads that are dropped here are never attached, they keep running while
+    // the dump is written.
+    size_t kept = 0;
+    int others = 0;
+    for (size_t i = 0; i != threads_.size(); ++i) {
+        const pid_t tid = threads_[i];
+        bool keep = (tid == crash_thread()) || nameMatches(tid);
+        if (!keep && (others < m_policy.maxThreads)) {
+            keep = true;
+            ++others;
+        }
+        if (keep) {
+            threads_[kept++] = tid;
+        }
+    }
+    threads_.resize(kept);
+    return true;
+}
+
+bool ThreadLimitedDumper::GetThreadInfoByIndex(size_t index, google_breakpad::ThreadInfo *info)
+{
+    m_stackLimiter.restore();
+    if (!google_breakpad::LinuxPtraceDumper::GetThreadInfoByIndex(index, info)) {
+        return false;
+    }
+    if (threads_[index] == crash_thread()) {
+        fillThreadRegisters(*m_context, info);
+    } else if (m_policy.stackLimit > 0) {
+        m_stackLimiter.limit(*this, info->stack_pointer, m_policy.stackLimit);
+    }
+    return true;
+}
+
+bool ThreadLimitedDumper::ThreadsResume()
+{
+    // The last thread's mapping would otherwise stay short.
+    m_stackLimiter.restore();
+    return google_breakpad::LinuxPtraceDumper::ThreadsResume();
+}
+
+bool ThreadLimitedDumper::nameMatches(pid_t tid) const
+{
+    if (!m_policy.namePatterns || (m_policy.namePatternsSize == 0)) {
+        return false;
+    }
+    char path[PATH_MAX] = {};
+    if (!BuildProcPath(path, tid, "comm")) {
+        return false;
+    }
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    char name[32] = {};
+    const ssize_t length = read(fd, name, sizeof(name) - 1);
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    if (name[length - 1] == '\n') {
+        name[length - 1] = '\0';
+    }
+    const char *pattern = m_policy.namePatterns;
+    const char *end = m_policy.namePatterns + m_policy.namePatternsSize;
+    for (; pattern < end; pattern += strlen(pattern) + 1) {
+        if ((*pattern != '\0') && globMatch(pattern, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StackLimiter::limit(const google_breakpad::LinuxDumper &dumper,
+                         uintptr_t stackPointer,
+                         size_t limit)
+{
+    restore();
+    auto mapping = const_cast<google_breakpad::MappingInfo *>(
+        dumper.FindMapping(reinterpret_cast<const void *>(stackPointer)));
+    if (!mapping) {
+        return;
+    }
+    // Breakpad starts copying at the page the stack pointer is in.
+    const uintptr_t pageSize = uintptr_t(getpagesize());
+    const uintptr_t end = (stackPointer & ~(pageSize - 1)) + std::max<uintptr_t>(limit, pageSize);
+    if (end < (mapping->start_addr + mapping->size)) {
+        m_mapping = mapping;
+        m_mappingSize = mapping->size;
+        mapping->size = end - mapping->start_addr;
+    }
+}
+
+void StackLimiter::restore()
+{
+    if (m_mapping) {
+        m_mapping->size = m_mappingSize;
+        m_mapping = nullptr;
+    }
+}
+
+AppMemoryRegions::AppMemoryRegions()
+    : m_spareNodes(kCapacity)
+{
+}
+
+bool AppMemoryRegions::add(void *ptr, size_t length)
+{
+    const auto value = reinterpret_cast<uintptr_t>(ptr);
+    for (const Slot &slot : m_slots) {
+        if (slot.ptr.load() == value) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i != kCapacity; ++i) {
+        Slot &slot = m_slots[i];
+        uint32_t sequence = slot.sequence.load();
+        // Nobody changed the slot in between if the sequence is still the same.
+        if ((sequence & 1) || (slot.ptr.load() != 0)
+            || !slot.sequence.compare_exchange_strong(sequence, sequence + 1)) {
+            continue;
+        }
+        slot.length.store(length);
+        slot.ptr.store(value);
+        slot.sequence.store(sequence + 2);
+        // Of two threads adding the same region at once, the one in the lower slot
+        // keeps it.
+        for (size_t j = 0; j != i; ++j) {
+            if (m_slots[j].ptr.load() == value) {
+                removeAt(i, value);
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool AppMemoryRegions::remove(void *ptr)
+{
+    const auto value = reinterpret_cast<uintptr_t>(ptr);
+    for (size_t i = 0; i != kCapacity; ++i) {
+        if ((m_slots[i].ptr.load() == value) && removeAt(i, value)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AppMemoryRegions::removeAt(size_t index, uintptr_t ptr)
+{
+    Slot &slot = m_slots[index];
+    uint32_t sequence = slot.sequence.load();
+    for (;;) {
+        if (slot.ptr.load() != ptr) {
+            return false;
+        }
+        if (sequence & 1) {
+            // Somebody else is in the middle of a few stores to this slot.
+            sched_yield();
+            sequence = slot.sequence.load();
+        } else if (slot.sequence.compare_exchange_weak(sequence, sequence + 1)) {
+            break;
+        }
+    }
+    slot.ptr.store(0);
+    slot.length.store(0);
+    slot.sequence.store(sequence + 2);
+    return true;
+}
+
+const google_breakpad::AppMemoryList &AppMemoryRegions::collect()
+{
+    for (const Slot &slot : m_slots) {
+        const uint32_t sequence = slot.sequence.load();
+        const uintptr_t ptr = slot.ptr.load();
+        const size_t length = slot.length.load();
+        if ((sequence & 1) || (ptr == 0) || (slot.sequence.load() != sequence)
+            || m_spareNodes.empty()) {
+            continue;
+        }
+        m_regions.splice(m_regions.end(), m_spareNodes, m_spareNodes.begin());
+        m_regions.back().ptr = reinterpret_cast<void *>(ptr);
+        m_regions.back().length = length;
+    }
+    return m_regions;
+}
+
+void captureThreadContext(const ucontext_t *uc, google_breakpad::ExceptionHandler::CrashContext *context)
+{
+    memcpy(&context->context, uc, sizeof(context->context));
+#if defined(__x86_64__)
+    if (uc->uc_mcontext.fpregs) {
+        memcpy(&context->float_state, uc->uc_mcontext.fpregs, sizeof(context->float_state));
+    }
+#elif defined(__aarch64__)
+    const auto fpsimd = reinterpret_cast<const fpsimd_context *>(&uc->uc_mcontext.__reserved);
+    if (fpsimd->head.magic == FPSIMD_MAGIC) {
+        memcpy(&context->float_state, fpsimd, sizeof(context->float_state));
+    }
+#endif
+}
+
+void fillThreadRegisters(const google_breakpad::ExceptionHandler::CrashContext &context,
+                         google_breakpad::ThreadInfo *info)
+{
+#if defined(__x86_64__)
+    const greg_t *gregs = context.context.uc_mcontext.gregs;
+    user_regs_struct &regs = info->regs;
+    regs.r8 = gregs[REG_R8];
+    regs.r9 = gregs[REG_R9];
+    regs.r10 = gregs[REG_R10];
+    regs.r11 = gregs[REG_R11];
+    regs.r12 = gregs[REG_R12];
+    regs.r13 = gregs[REG_R13];
+    regs.r14 = gregs[REG_R14];
+    regs.r15 = gregs[REG_R15];
+    regs.rdi = gregs[REG_RDI];
+    regs.rsi = gregs[REG_RSI];
+    regs.rbp = gregs[REG_RBP];
+    regs.rbx = gregs[REG_RBX];
+    regs.rdx = gregs[REG_RDX];
+    regs.rax = gregs[REG_RAX];
+    regs.rcx = gregs[REG_RCX];
+    regs.rsp = gregs[REG_RSP];
+    regs.rip = gregs[REG_RIP];
+    regs.eflags = gregs[REG_EFL];
+    regs.cs = gregs[REG_CSGSFS] & 0xffff;
+    regs.gs = (gregs[REG_CSGSFS] >> 16) & 0xffff;
+    regs.fs = (gregs[REG_CSGSFS] >> 32) & 0xffff;
+    // Both are the FXSAVE layout.
+    static_assert(sizeof(info->fpregs) == sizeof(context.float_state),
+                  "Unexpected floating point state layout");
+    memcpy(&info->fpregs, &context.float_state, sizeof(info->fpregs));
+    info->stack_pointer = static_cast<uintptr_t>(gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    const mcontext_t &mcontext = context.context.uc_mcontext;
+    for (int i = 0; i != 31; ++i) {
+        info->regs.regs[i] = mcontext.regs[i];
+    }
+    info->regs.sp = mcontext.sp;
+    info->regs.pc = mcontext.pc;
+    info->regs.pstate = mcontext.pstate;
+    for (int i = 0; i != 32; ++i) {
+        info->fpregs.vregs[i] = context.float_state.vregs[i];
+    }
+    info->fpregs.fpsr = context.float_state.fpsr;
+    info->fpregs.fpcr = context.float_state.fpcr;
+    info->stack_pointer = static_cast<uintptr_t>(mcontext.sp);
+#else
+    // Other architectures keep the ptrace registers of the signal handler.
+    Q_UNUSED(context)
+    Q_UNUSED(info)
+#endif
+}
+
+bool writeDump(const google_breakpad::MinidumpDescriptor &descriptor,
+               const google_breakpad::ExceptionHandler::CrashContext *context,
+               const ThreadCapturePolicy &policy,
+               const AppMemoryRegions &appMemory,
+               off_t fileSizeLimit)
+{
+    if (!descriptor.IsFD() && !descriptor.IsMicrodumpOnConsole() && !descriptor.path()) {
+        return false;
+    }
+    int syncFds[2] = {-1, -1};
+    if (pipe2(syncFds, O_CLOEXEC) == -1) {
+        return false;
+    }
+    DumpRequest request
+        = {&descriptor, context, &policy, &appMemory, getpid(), syncFds[0], fileSizeLimit};
+    const pid_t child = clone(dumperMain,
+                              g_dumperStack + sizeof(g_dumperStack),
+                              CLONE_FS | CLONE_UNTRACED,
+                              &request);
+    if (child == -1) {
+        close(syncFds[0]);
+        close(syncFds[1]);
+        return false;
+    }
+    // With Yama, a child may only ptrace its parent once the parent allowed it.
+    prctl(PR_SET_PTRACER, child, 0, 0, 0);
+    const char ready = 0;
+    while ((write(syncFds[1], &ready, 1) == -1) && (errno == EINTR)) {
+    }
+    close(syncFds[0]);
+    close(syncFds[1]);
+    int status = 0;
+    while ((waitpid(child, &status, __WALL) == -1) && (errno == EINTR)) {
+    }
+    return WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+bool writeRequestedDump(const google_breakpad::MinidumpDescriptor &descriptor,
+                        const ThreadCapturePolicy &policy,
+                        const AppMemoryRegions &appMemory,
+                        off_t fileSizeLimit)
+{
+    ucontext_t uc;
+    if (getcontext(&uc) != 0) {
+        return false;
+    }
+    google_breakpad::ExceptionHandler::CrashContext context = {};
+    captureThreadContext(&uc, &context);
+    context.tid = pid_t(syscall(__NR_gettid));
+    context.siginfo.si_signo = MD_EXCEPTION_CODE_LIN_DUMP_REQUESTED;
+#if defined(__x86_64__)
+    context.siginfo.si_addr = reinterpret_cast<void *>(uc.uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+    context.siginfo.si_addr = reinterpret_cast<void *>(uc.uc_mcontext.pc);
+#endif
+    return writeDump(descriptor, &context, policy, appMemory, fileSizeLimit);
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <client/linux/handler/exception_handler.h>
+#include <client/linux/minidump_writer/linux_ptrace_dumper.h>
+#include <client/linux/minidump_writer/minidump_writer.h>
+#include <atomic>
+
+namespace qbreakpad {
+
+struct ThreadCapturePolicy
+{
+    // Threads captured besides the crashing one, negative captures all of them.
+    int maxThreads = -1;
+    // NUL separated glob patterns ('*' and '?') for thread names. Matching threads
+    // are captured on top of maxThreads.
+    const char *namePatterns = nullptr;
+    size_t namePatternsSize = 0;
+    // Stack bytes per thread, not applied to the crashing thread. Breakpad never
+    // copies more than 32 KiB of a stack, so only smaller values make a difference.
+    size_t stackLimit = 0;
+
+    bool isActive() const { return (maxThreads >= 0) || (stackLimit > 0); }
+};
+
+// Shortens the mapping a thread's stack is in, so that Breakpad's writer copies at
+// most limit bytes of it. The writer reads a thread's stack right after asking for
+// its info, so one shortened mapping at a time is enough, even if threads share a
+// mapping; restore() puts it back.
+class StackLimiter
+{
+public:
+    void limit(const google_breakpad::LinuxDumper &dumper, uintptr_t stackPointer, size_t limit);
+    void restore();
+
+private:
+    google_breakpad::MappingInfo *m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+};
+
+// A LinuxPtraceDumper that only suspends and dumps the threads the policy selects.
+// Breakpad's writer has no crash context when it is given its own dumper, so the
+// registers of the crashing thread are taken from the signal context here, instead
+// of from ptrace, which would see the thread inside the signal handler.
+class ThreadLimitedDumper : public google_breakpad::LinuxPtraceDumper
+{
+public:
+    explicit ThreadLimitedDumper(pid_t pid,
+                                 const ThreadCapturePolicy &policy,
+                                 const google_breakpad::ExceptionHandler::CrashContext *context);
+
+    bool GetThreadInfoByIndex(size_t index, google_breakpad::ThreadInfo *info) override;
+    bool ThreadsResume() override;
+
+protected:
+    bool EnumerateThreads() override;
+
+private:
+    bool nameMatches(pid_t tid) const;
+
+    const ThreadCapturePolicy &m_policy;
+    const google_breakpad::ExceptionHandler::CrashContext *const m_context;
+    StackLimiter m_stackLimiter;
+};
+
+// Application memory regions to include in dumps, in a table of fixed size that
+// add() and remove() change without locks. A region is published by a sequence
+// number per slot, so a reader skips one that is being changed. Breakpad's writer
+// wants a std::list; its nodes are allocated up front, so a dump child, which has
+// its own copy of them, only has to link them together.
+class AppMemoryRegions
+{
+public:
+    static constexpr size_t kCapacity = 256;
+
+    AppMemoryRegions();
+    AppMemoryRegions(const AppMemoryRegions &) = delete;
+    AppMemoryRegions &operator=(const AppMemoryRegions &) = delete;
+
+    // False if ptr is registered already or every slot is taken.
+    bool add(void *ptr, size_t length);
+    bool remove(void *ptr);
+
+    // Only for a child process that is not sharing our memory: links up the nodes
+    // of its copy for the regions that were published when it was created, which
+    // it can only do once. Async-signal-safe.
+    const google_breakpad::AppMemoryList &collect();
+
+private:
+    struct Slot
+    {
+        // Odd while the slot is being changed.
+        std::atomic<uint32_t> sequence;
+        std::atomic<uintptr_t> ptr;
+        std::atomic<size_t> length;
+    };
+
+    bool removeAt(size_t index, uintptr_t ptr);
+
+    Slot m_slots[kCapacity] = {};
+    google_breakpad::AppMemoryList m_regions;
+    google_breakpad::AppMemoryList m_spareNodes;
+};
+
+// Copies the registers of a signal or getcontext() context the way Breakpad's
+// signal handler does, and fills the thread info of a dumper with them.
+// Async-signal-safe.
+void captureThreadContext(const ucontext_t *uc, google_breakpad::ExceptionHandler::CrashContext *context);
+void fillThreadRegisters(const google_breakpad::ExceptionHandler::CrashContext &context,
+                         google_breakpad::ThreadInfo *info);
+
+// Writes a dump of the calling, crashed process the way ExceptionHandler::GenerateDump()
+// does, by a cloned child that ptraces its parent, but with a descriptor the caller
+// owns instead of the handler's. An active policy is applied with ThreadLimitedDumper
+// to minidumps written to a path. A positive fileSizeLimit makes writes past it
+// fail, unlike the descriptor's size limit, which Breakpad only aims for.
+// Async-signal-safe.
+bool writeDump(const google_breakpad::MinidumpDescriptor &descriptor,
+               const google_breakpad::ExceptionHandler::CrashContext *context,
+               const ThreadCapturePolicy &policy,
+               const AppMemoryRegions &appMemory,
+               off_t fileSizeLimit);
+
+// The same for the calling thread of a live process, like
+// ExceptionHandler::WriteMinidump().
+bool writeRequestedDump(const google_breakpad::MinidumpDescriptor &descriptor,
+                        const ThreadCapturePolicy &policy,
+                        const AppMemoryRegions &appMemory,
+                        off_t fileSizeLimit);
+
+} // namespace qbreakpad
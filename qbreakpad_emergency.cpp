@@ -0,0 +1,211 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_emergency_p.h"
+
+#include <QMutex>
+#include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef QBREAKPAD_INTERPOSE_PTHREAD_CREATE
+#include <dlfcn.h>
+#include <new>
+#include <pthread.h>
+#endif
+
+namespace qbreakpad {
+
+namespace {
+
+// Breakpad's own alternate stacks are 16 KiB, which its handler needs; ours adds
+// the custom streams, the dedup check and the reporter handoff on top.
+constexpr size_t kMinAlternateStackSize = 64 * 1024;
+
+size_t roundUpToPage(size_t size)
+{
+    const auto page = size_t(sysconf(_SC_PAGESIZE));
+    return ((size + page - 1) / page) * page;
+}
+
+class AlternateStack
+{
+public:
+    ~AlternateStack() { uninstall(); }
+
+    bool install(size_t size);
+    void uninstall();
+
+private:
+    char *m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+};
+
+QMutex m_reserveMutex;
+std::atomic<void *> m_reserve = nullptr;
+std::atomic<size_t> m_reserveSize = 0;
+std::atomic<size_t> m_alternateStackSize = 0;
+thread_local AlternateStack t_alternateStack;
+
+bool AlternateStack::install(size_t size)
+{
+    const auto guardSize = size_t(sysconf(_SC_PAGESIZE));
+    const size_t stackSize = roundUpToPage(std::max(size, kMinAlternateStackSize));
+    const size_t mappingSize = guardSize + stackSize;
+    void *mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    mprotect(mapping, guardSize, PROT_NONE);
+    stack_t stack = {};
+    stack.ss_sp = static_cast<char *>(mapping) + guardSize;
+    stack.ss_size = stackSize;
+    if (sigaltstack(&stack, nullptr) == -1) {
+        munmap(mapping, mappingSize);
+        return false;
+    }
+    // The old stack is no longer in use: this is not a signal handler.
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+    }
+    m_mapping = static_cast<char *>(mapping);
+    m_mappingSize = mappingSize;
+    return true;
+}
+
+void AlternateStack::uninstall()
+{
+    if (!m_mapping) {
+        return;
+    }
+    const auto guardSize = size_t(sysconf(_SC_PAGESIZE));
+    stack_t current = {};
+    if ((sigaltstack(nullptr, &current) == 0) && (current.ss_sp == m_mapping + guardSize)) {
+        stack_t disabled = {};
+        disabled.ss_flags = SS_DISABLE;
+        sigaltstack(&disabled, nullptr);
+    }
+    munmap(m_mapping, m_mappingSize);
+    m_mapping = nullptr;
+    m_mappingSize = 0;
+}
+
+#ifdef QBREAKPAD_INTERPOSE_PTHREAD_CREATE
+struct ThreadStart
+{
+    void *(*routine)(void *);
+    void *argument;
+};
+
+void *startThread(void *argument)
+{
+    const ThreadStart start = *static_cast<ThreadStart *>(argument);
+    delete static_cast<ThreadStart *>(argument);
+    const size_t size = m_alternateStackSize.load(std::memory_order_relaxed);
+    if (size > 0) {
+        t_alternateStack.install(size);
+    }
+    return start.routine(start.argument);
+}
+#endif
+
+} // namespace
+
+bool reserveEmergencyMemory(size_t size)
+{
+    const QMutexLocker locker(&m_reserveMutex);
+    if (void *block = m_reserve.exchange(nullptr)) {
+        munmap(block, m_reserveSize.load());
+    }
+    if (size == 0) {
+        return true;
+    }
+    size = roundUpToPage(size);
+    void *block = mmap(nullptr,
+                       size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                       -1,
+                       0);
+    if (block == MAP_FAILED) {
+        return false;
+    }
+    // Nothing in it is worth a core file's space.
+    madvise(block, size, MADV_DONTDUMP);
+    m_reserveSize.store(size);
+    m_reserve.store(block, std::memory_order_release);
+    return true;
+}
+
+void releaseEmergencyMemory()
+{
+    if (void *block = m_reserve.exchange(nullptr, std::memory_order_acquire)) {
+        munmap(block, m_reserveSize.load());
+    }
+}
+
+bool setAlternateSignalStackSize(size_t size)
+{
+    m_alternateStackSize.store(size, std::memory_order_relaxed);
+    return (size == 0) || t_alternateStack.install(size);
+}
+
+bool installAlternateSignalStack()
+{
+    const size_t size = m_alternateStackSize.load(std::memory_order_relaxed);
+    return (size == 0) || t_alternateStack.install(size);
+}
+
+} // namespace qbreakpad
+
+#ifdef QBREAKPAD_INTERPOSE_PTHREAD_CREATE
+// Built with the QBREAKPAD_INTERPOSE_PTHREAD_CREATE option only: replacing a libc
+// function for the whole process is not something a library does unasked. Every
+// thread that starts after setAlternateSignalStackSize() goes through here, Qt's
+// included, as long as this library comes before libc in the lookup order, which is
+// what linking against it does. Without an alternate stack size threads start as
+// before.
+extern "C" Q_DECL_EXPORT int pthread_create(pthread_t *thread,
+                                            const pthread_attr_t *attributes,
+                                            void *(*routine)(void *),
+                                            void *argument) noexcept
+{
+    using Function = int (*)(pthread_t *, const pthread_attr_t *, void *(*) (void *), void *);
+    static const auto next = reinterpret_cast<Function>(dlsym(RTLD_NEXT, "pthread_create"));
+    if (qbreakpad::m_alternateStackSize.load(std::memory_order_relaxed) == 0) {
+        return next(thread, attributes, routine, argument);
+    }
+    const auto start = new (std::nothrow) qbreakpad::ThreadStart{routine, argument};
+    if (!start) {
+        return next(thread, attributes, routine, argument);
+    }
+    const int result = next(thread, attributes, qbreakpad::startThread, start);
+    if (result != 0) {
+        delete start;
+    }
+    return result;
+}
+#endif
@@ -0,0 +1,53 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace qbreakpad {
+
+// A block of memory held back for the crash path. Heap exhaustion usually means the
+// address space or the cgroup is full, and the dump writer and the reporter
+// handoff need memory of their own; releasing the block as the crash starts makes
+// room for them. The block is mapped and faulted in up front, so it is real memory
+// and not just an overcommitted promise. A new reserve replaces the old one, zero
+// frees it.
+bool reserveEmergencyMemory(size_t size);
+// Async-signal-safe; only the first call after a reserve frees anything.
+void releaseEmergencyMemory();
+
+// A stack overflow leaves no stack for the signal handler, which then only runs on
+// an alternate signal stack; Breakpad sets one up for the thread that installs the
+// handler, and only that one. From now on the calling thread, and every thread
+// that calls installAlternateSignalStack(), gets an alternate stack of this size,
+// with a guard page below it, freed again when the thread exits. Zero stops giving
+// threads one. Threads that already run keep whatever they have. Built with
+// QBREAKPAD_INTERPOSE_PTHREAD_CREATE, threads started later through
+// pthread_create() get one without asking.
+bool setAlternateSignalStackSize(size_t size);
+// For the calling thread, with the size set last; does nothing without one.
+bool installAlternateSignalStack();
+
+} // namespace qbreakpad
@@ -0,0 +1,306 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_index_p.h"
+
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+constexpr quint32 kIndexMagic = 0x51424958; // "QBIX"
+constexpr quint32 kIndexVersion = 1;
+constexpr quint32 kInitialCapacity = 1024;
+// Free records kept for crashes, which cannot grow the file themselves.
+constexpr quint32 kReservedRecords = 64;
+
+QString indexFilePath(const QString &dirPath)
+{
+    return dirPath + QStringLiteral("/qbreakpad.index");
+}
+
+} // namespace
+
+struct DumpIndex::Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 recordSize;
+    // Only grows, under flock().
+    quint32 capacity;
+    // Claimed records; may run past capacity when appends found no room.
+    quint32 count;
+    quint32 reserved[3];
+};
+
+struct DumpIndex::Record
+{
+    // Written last; Empty until the record is complete.
+    quint32 state;
+    quint32 uploadState;
+    qint64 timestamp;
+    qint64 size;
+    quint64 signature;
+    qint64 pid;
+    char fileName[88];
+};
+
+struct DumpIndex::Mapping
+{
+    Header *header;
+    Record *records;
+    quint32 capacity;
+    size_t size;
+    Mapping *previous;
+};
+
+DumpIndex::~DumpIndex()
+{
+    Mapping *mapping = m_mapping.load();
+    while (mapping) {
+        Mapping *previous = mapping->previous;
+        munmap(mapping->header, mapping->size);
+        delete mapping;
+        mapping = previous;
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+}
+
+bool DumpIndex::open(const QString &dirPath)
+{
+    static_assert(sizeof(Record) == 128, "index records must keep their size");
+    const QMutexLocker locker(&m_mutex);
+    if (isOpen()) {
+        return true;
+    }
+    const QString filePath = indexFilePath(dirPath);
+    const QByteArray path = QFile::encodeName(filePath);
+    m_fd = ::open(path.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd == -1) {
+        qWarning().noquote() << "Failed to open the dump index" << filePath;
+        return false;
+    }
+    flock(m_fd, LOCK_EX);
+    bool ok = true;
+    struct stat st = {};
+    if ((fstat(m_fd, &st) == 0) && (st.st_size == 0)) {
+        const Header header = {kIndexMagic, kIndexVersion, sizeof(Record), kInitialCapacity, 0, {}};
+        ok = (ftruncate(m_fd, off_t(sizeof(Header) + (sizeof(Record) * kInitialCapacity))) == 0)
+             && (pwrite(m_fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)));
+    }
+    ok = ok && remap();
+    flock(m_fd, LOCK_UN);
+    if (!ok) {
+        // A file of another version is left alone, its readers may still need it.
+        qWarning().noquote() << "Failed to map the dump index" << filePath;
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    growLocked();
+    return true;
+}
+
+// Maps the file again when another process, or reserve(), made it larger.
+bool DumpIndex::remap()
+{
+    Header header = {};
+    if ((pread(m_fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)))
+        || (header.magic != kIndexMagic) || (header.version != kIndexVersion)
+        || (header.recordSize != sizeof(Record))) {
+        return false;
+    }
+    Mapping *current = m_mapping.load(std::memory_order_acquire);
+    if (current && (current->capacity >= header.capacity)) {
+        return true;
+    }
+    const size_t size = sizeof(Header) + (sizeof(Record) * header.capacity);
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    const auto mapping = new Mapping;
+    mapping->header = static_cast<Header *>(memory);
+    mapping->records = reinterpret_cast<Record *>(mapping->header + 1);
+    mapping->capacity = header.capacity;
+    mapping->size = size;
+    mapping->previous = current;
+    m_mapping.store(mapping, std::memory_order_release);
+    return true;
+}
+
+bool DumpIndex::append(const char *fileName, State state, qint64 size, quint64 signature, qint64 pid)
+{
+    const Mapping *mapping = m_mapping.load(std::memory_order_acquire);
+    if (!mapping) {
+        return false;
+    }
+    const quint32 index = __atomic_fetch_add(&mapping->header->count, 1, __ATOMIC_ACQ_REL);
+    if (index >= mapping->capacity) {
+        return false;
+    }
+    Record &record = mapping->records[index];
+    timespec ts = {};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record.timestamp = (qint64(ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+    record.size = size;
+    record.signature = signature;
+    record.pid = pid;
+    record.uploadState = UploadPending;
+    const size_t length = strnlen(fileName, sizeof(record.fileName) - 1);
+    memcpy(record.fileName, fileName, length);
+    record.fileName[length] = '\0';
+    __atomic_store_n(&record.state, quint32(state), __ATOMIC_RELEASE);
+    return true;
+}
+
+void DumpIndex::reserve()
+{
+    const QMutexLocker locker(&m_mutex);
+    growLocked();
+}
+
+// Called with m_mutex held.
+void DumpIndex::growLocked()
+{
+    const Mapping *mapping = m_mapping.load(std::memory_order_acquire);
+    if (!mapping) {
+        return;
+    }
+    const quint32 needed = __atomic_load_n(&mapping->header->count, __ATOMIC_ACQUIRE) + kReservedRecords;
+    if (needed <= mapping->capacity) {
+        return;
+    }
+    flock(m_fd, LOCK_EX);
+    const quint32 capacity = __atomic_load_n(&mapping->header->capacity, __ATOMIC_ACQUIRE);
+    if (needed > capacity) {
+        quint32 grown = std::max(capacity, kInitialCapacity);
+        while (grown < needed) {
+            grown *= 2;
+        }
+        if (ftruncate(m_fd, off_t(sizeof(Header) + (sizeof(Record) * grown))) == 0) {
+            __atomic_store_n(&mapping->header->capacity, grown, __ATOMIC_RELEASE);
+        }
+    }
+    if (!remap()) {
+        qWarning().noquote() << "Failed to grow the dump index.";
+    }
+    flock(m_fd, LOCK_UN);
+}
+
+DumpIndex::Record *DumpIndex::findRecord(const QString &fileName) const
+{
+    const Mapping *mapping = m_mapping.load(std::memory_order_acquire);
+    if (!mapping || fileName.isEmpty()) {
+        return nullptr;
+    }
+    const QByteArray name = QFile::encodeName(fileName);
+    const quint32 count = std::min(__atomic_load_n(&mapping->header->count, __ATOMIC_ACQUIRE),
+                                   mapping->capacity);
+    // The newest record wins, should a name ever come back.
+    for (quint32 i = count; i != 0; --i) {
+        Record &record = mapping->records[i - 1];
+        if ((__atomic_load_n(&record.state, __ATOMIC_ACQUIRE) != Empty)
+            && (name == record.fileName)) {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+void DumpIndex::setState(const QString &fileName, State state)
+{
+    if (Record *record = findRecord(fileName)) {
+        __atomic_store_n(&record->state, quint32(state), __ATOMIC_RELEASE);
+    }
+}
+
+void DumpIndex::setUploadState(const QString &fileName, UploadState uploadState)
+{
+    if (Record *record = findRecord(fileName)) {
+        __atomic_store_n(&record->uploadState, quint32(uploadState), __ATOMIC_RELEASE);
+    }
+}
+
+bool DumpIndex::read(const QString &dirPath, QList<DumpIndexEntry> *entries)
+{
+    const QByteArray path = QFile::encodeName(indexFilePath(dirPath));
+    const int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st = {};
+    void *memory = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (size_t(st.st_size) >= sizeof(Header))) {
+        memory = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    const auto header = static_cast<const Header *>(memory);
+    const bool ok = (header->magic == kIndexMagic) && (header->version == kIndexVersion)
+                    && (header->recordSize == sizeof(Record));
+    if (ok) {
+        const auto records = reinterpret_cast<const Record *>(header + 1);
+        const quint32 count = quint32(std::min<quint64>(
+            __atomic_load_n(&header->count, __ATOMIC_ACQUIRE),
+            (quint64(st.st_size) - sizeof(Header)) / sizeof(Record)));
+        entries->clear();
+        entries->reserve(count);
+        for (quint32 i = 0; i != count; ++i) {
+            const Record &record = records[i];
+            const quint32 state = __atomic_load_n(&record.state, __ATOMIC_ACQUIRE);
+            if (state == Empty) {
+                continue;
+            }
+            DumpIndexEntry entry = {};
+            entry.fileName = QFile::decodeName(
+                QByteArray(record.fileName, int(strnlen(record.fileName, sizeof(record.fileName)))));
+            entry.timestamp = record.timestamp;
+            entry.size = record.size;
+            entry.signature = record.signature;
+            entry.pid = record.pid;
+            entry.state = state;
+            entry.uploadState = __atomic_load_n(&record.uploadState, __ATOMIC_ACQUIRE);
+            entries->append(entry);
+        }
+    }
+    munmap(memory, size_t(st.st_size));
+    return ok;
+}
+
+} // namespace qbreakpad
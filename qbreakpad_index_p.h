@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+namespace qbreakpad {
+
+struct DumpIndexEntry
+{
+    QString fileName = {};
+    // Milliseconds since the epoch.
+    qint64 timestamp = 0;
+    qint64 size = 0;
+    quint64 signature = 0;
+    qint64 pid = 0;
+    quint32 state = 0;
+    quint32 uploadState = 0;
+};
+
+// An append-only file of fixed-size records, one per dump, kept next to the dumps
+// as qbreakpad.index and shared by every process that uses the directory. It is
+// mapped into memory: the crash path appends by claiming the next record with an
+// atomic increment of the record count and filling it in, the state last; the
+// file is grown ahead of time, so there is always a record for the next crash.
+// Readers get the dumps, their upload state and what became of them from one
+// file, without listing the directory.
+class DumpIndex
+{
+public:
+    enum State : quint32 { Empty, Written, Failed, Duplicate, Removed };
+    enum UploadState : quint32 { UploadPending, Uploaded, UploadFailed };
+
+    ~DumpIndex();
+
+    bool open(const QString &dirPath);
+    bool isOpen() const { return m_mapping.load(std::memory_order_acquire) != nullptr; }
+
+    // Async-signal-safe. fileName is the base name, or empty for a crash that
+    // wrote no dump.
+    bool append(const char *fileName, State state, qint64 size, quint64 signature, qint64 pid);
+    // Grows the file when the free records run low; call it outside the crash path
+    // after appending.
+    void reserve();
+
+    void setState(const QString &fileName, State state);
+    void setUploadState(const QString &fileName, UploadState uploadState);
+
+    // Every record in the index of dirPath, oldest first. Needs no DumpIndex of
+    // its own and never writes.
+    static bool read(const QString &dirPath, QList<DumpIndexEntry> *entries);
+
+private:
+    struct Header;
+    struct Record;
+    struct Mapping;
+
+    Record *findRecord(const QString &fileName) const;
+    void growLocked();
+    bool remap();
+
+    // flock() keeps other processes out while the file grows, this the other
+    // threads of this one.
+    QMutex m_mutex;
+    int m_fd = -1;
+    // Replaced when the file grows; old mappings are kept, the crash path may
+    // still use one.
+    std::atomic<Mapping *> m_mapping = nullptr;
+};
+
+} // namespace qbreakpad
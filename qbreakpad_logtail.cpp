@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_logtail_p.h"
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <cstring>
+#ifdef Q_OS_LINUX
+#include "qbreakpad_streams_p.h"
+#endif
+
+namespace qbreakpad {
+
+namespace {
+
+struct LogTail
+{
+    quint64 capacityMask = 0;
+    char *data = nullptr;
+    std::atomic<quint64> reserved = 0;
+    std::atomic<quint64> committed = 0;
+};
+
+// The stream header holds the size in 32 bits.
+constexpr qint64 kMaxLogTailSize = qint64(1) << 30;
+
+// Never freed, messages may still be logged while the process exits.
+std::atomic<LogTail *> m_logTail = nullptr;
+std::atomic<QtMessageHandler> m_previousMessageHandler = nullptr;
+
+void logTailMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    QByteArray line = qFormatLogMessage(type, context, message).toUtf8();
+    line.append('\n');
+    appendLogTail(line.constData(), size_t(line.size()));
+    if (const QtMessageHandler previous = m_previousMessageHandler.load(std::memory_order_acquire)) {
+        previous(type, context, message);
+    }
+}
+
+} // namespace
+
+bool startLogTail(qint64 size)
+{
+    if ((size <= 0) || (size > kMaxLogTailSize) || m_logTail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    quint64 capacity = 1;
+    while (capacity < quint64(size)) {
+        capacity <<= 1;
+    }
+    auto tail = new LogTail;
+    tail->capacityMask = capacity - 1;
+    tail->data = new char[capacity]();
+    LogTail *expected = nullptr;
+    if (!m_logTail.compare_exchange_strong(expected, tail, std::memory_order_acq_rel)) {
+        delete[] tail->data;
+        delete tail;
+        return false;
+    }
+    m_previousMessageHandler.store(qInstallMessageHandler(logTailMessageHandler),
+                                   std::memory_order_release);
+    return true;
+}
+
+void appendLogTail(const char *text, size_t size)
+{
+    LogTail *tail = m_logTail.load(std::memory_order_acquire);
+    if (!tail || (size == 0)) {
+        return;
+    }
+    const quint64 capacity = tail->capacityMask + 1;
+    if (size > capacity) {
+        text += size - capacity;
+        size = size_t(capacity);
+    }
+    // Concurrent writers get disjoint ranges; only a writer that is lapped by
+    // capacity bytes while copying can be overwritten, and then only by newer text.
+    const quint64 start = tail->reserved.fetch_add(size, std::memory_order_relaxed);
+    const size_t offset = size_t(start & tail->capacityMask);
+    const size_t first = qMin(size, size_t(capacity) - offset);
+    memcpy(tail->data + offset, text, first);
+    memcpy(tail->data, text + first, size - first);
+    tail->committed.fetch_add(size, std::memory_order_release);
+}
+
+#ifdef Q_OS_LINUX
+bool writeLogTailStream(MinidumpStreamAppender &appender)
+{
+    LogTail *tail = m_logTail.load(std::memory_order_acquire);
+    if (!tail) {
+        return true;
+    }
+    const quint64 committed = tail->committed.load(std::memory_order_acquire);
+    const quint64 end = tail->reserved.load(std::memory_order_acquire);
+    const quint64 capacity = tail->capacityMask + 1;
+    LogTailStreamHeader header = {};
+    header.version = 1;
+    header.size = quint32(qMin(end, capacity));
+    header.written = end;
+    header.pending = (end > committed) ? (end - committed) : 0;
+    if (!appender.beginStream(kLogTailStreamType) || !appender.write(&header, sizeof(header))) {
+        return false;
+    }
+    const size_t offset = size_t((end - header.size) & tail->capacityMask);
+    const size_t first = qMin(size_t(header.size), size_t(capacity) - offset);
+    if (!appender.write(tail->data + offset, first)
+        || !appender.write(tail->data, header.size - first)) {
+        return false;
+    }
+    appender.endStream();
+    return true;
+}
+#endif
+
+} // namespace qbreakpad
@@ -0,0 +1,58 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+#include <cstddef>
+
+namespace qbreakpad {
+
+class MinidumpStreamAppender;
+
+// Keeps the most recent Qt log output in a fixed size ring, so a dump carries the
+// lines that had not reached the log file yet. Writers reserve their bytes with a
+// single fetch_add on the write position and copy into the ring without locking.
+// The message handler is installed once and forwards to the previous handler.
+bool startLogTail(qint64 size);
+void appendLogTail(const char *text, size_t size);
+
+#ifdef Q_OS_LINUX
+// Stream layout: LogTailStreamHeader followed by size bytes of UTF-8 text, oldest
+// first. Once the ring has wrapped the first line is usually cut.
+struct LogTailStreamHeader
+{
+    quint32 version;
+    quint32 size;
+    // Bytes ever appended, and bytes reserved by writers that had not finished
+    // copying when the dump was written; those may still hold older text.
+    quint64 written;
+    quint64 pending;
+};
+
+// Async-signal-safe.
+bool writeLogTailStream(MinidumpStreamAppender &appender);
+#endif
+
+} // namespace qbreakpad
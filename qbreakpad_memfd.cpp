@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_memfd_p.h"
+
+#include <QDebug>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+bool InMemoryDump::initialize(size_t reserve)
+{
+    if (isInitialized()) {
+        return true;
+    }
+    m_reserve = reserve;
+    m_fd = create();
+    return m_fd != -1;
+}
+
+int InMemoryDump::create() const
+{
+    const int fd = memfd_create("qbreakpad-minidump", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        qWarning().noquote() << "Failed to create the in-memory minidump file.";
+        return -1;
+    }
+    // Allocated now, so a crash under memory pressure does not have to find the
+    // pages. The size stays 0, Breakpad starts writing at the beginning.
+    if ((m_reserve > 0) && (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, off_t(m_reserve)) != 0)) {
+        qWarning().noquote() << "Failed to reserve" << m_reserve
+                             << "bytes for the in-memory minidump.";
+    }
+    return fd;
+}
+
+qint64 InMemoryDump::size() const
+{
+    struct stat st = {};
+    return (fstat(m_fd, &st) == 0) ? qint64(st.st_size) : 0;
+}
+
+bool InMemoryDump::sendTo(int socketFd, const char *message, size_t length) const
+{
+    if (!isInitialized()) {
+        return false;
+    }
+    // The receiver gets the same open file, read from the start and unchangeable.
+    lseek(m_fd, 0, SEEK_SET);
+    fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    iovec iov = {const_cast<char *>(message), length};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &m_fd, sizeof(int));
+    return sendmsg(socketFd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == ssize_t(length);
+}
+
+bool InMemoryDump::copy(const char *path) const
+{
+    if (!isInitialized()) {
+        return false;
+    }
+    const qint64 size = this->size();
+    const int outFd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (outFd == -1) {
+        return false;
+    }
+    off_t offset = 0;
+    bool ok = true;
+    while (ok && (offset < size)) {
+        const ssize_t count = sendfile(outFd, m_fd, &offset, size_t(size - offset));
+        ok = (count > 0) || ((count < 0) && (errno == EINTR));
+    }
+    close(outFd);
+    return ok;
+}
+
+bool InMemoryDump::renew()
+{
+    if (!isInitialized()) {
+        return false;
+    }
+    const int fd = create();
+    if (fd == -1) {
+        return false;
+    }
+    const bool ok = dup3(fd, m_fd, O_CLOEXEC) != -1;
+    close(fd);
+    return ok;
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,59 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+#include <cstddef>
+
+namespace qbreakpad {
+
+// A minidump that never touches the file system on the crash path: Breakpad writes
+// into a memfd whose pages were allocated up front, and the crash path hands the fd
+// itself to the reporter daemon. copy() is the disk fallback.
+class InMemoryDump
+{
+public:
+    bool initialize(size_t reserve);
+    bool isInitialized() const { return m_fd != -1; }
+    int fd() const { return m_fd; }
+
+    // Async-signal-safe. sendTo() seals the memfd and sends it over socketFd as
+    // SCM_RIGHTS, together with message.
+    qint64 size() const;
+    bool sendTo(int socketFd, const char *message, size_t length) const;
+    bool copy(const char *path) const;
+
+    // Puts a fresh memfd under the same fd number, so the descriptor stays valid.
+    // The old one may belong to the reporter by now.
+    bool renew();
+
+private:
+    int create() const;
+
+    int m_fd = -1;
+    size_t m_reserve = 0;
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,342 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_memory_p.h"
+
+#include "qbreakpad_annotations_p.h"
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+constexpr qint64 kMinDumpInterval = 60 * 1000;
+
+// Reads a small proc or cgroup file from its start, NUL-terminated. Returns the
+// length, or -1.
+qint64 readFile(int fd, char *buffer, size_t size)
+{
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t length = 0;
+    do {
+        length = pread(fd, buffer, size - 1, 0);
+    } while ((length == -1) && (errno == EINTR));
+    if (length < 0) {
+        return -1;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+// Returns -1 for "max" and for a file that cannot be read.
+qint64 readNumber(int fd)
+{
+    char buffer[32] = {};
+    if ((readFile(fd, buffer, sizeof(buffer)) <= 0) || !isdigit(static_cast<unsigned char>(buffer[0]))) {
+        return -1;
+    }
+    return strtoll(buffer, nullptr, 10);
+}
+
+// The value of a "key value" line, the format of memory.events and memory.stat.
+qint64 findValue(const char *text, const char *key)
+{
+    const size_t length = strlen(key);
+    const char *line = text;
+    while (line) {
+        if ((strncmp(line, key, length) == 0) && (line[length] == ' ')) {
+            return strtoll(line + length + 1, nullptr, 10);
+        }
+        line = strchr(line, '\n');
+        if (line) {
+            ++line;
+        }
+    }
+    return 0;
+}
+
+// Turns "key value" lines into "prefix.key=value" lines.
+void appendKeyValues(QByteArray *stats, const char *prefix, const char *text)
+{
+    const QList<QByteArray> lines = QByteArray(text).split('\n');
+    for (const QByteArray &line : lines) {
+        const int space = line.indexOf(' ');
+        if (space > 0) {
+            *stats += QByteArray(prefix) + '.' + line.left(space) + '=' + line.mid(space + 1) + '\n';
+        }
+    }
+}
+
+// The cgroup v2 directory of this process, or an empty path under cgroup v1.
+QByteArray cgroupDirectory()
+{
+    QFile file(QStringLiteral("/proc/self/cgroup"));
+    if (!file.open(QFile::ReadOnly)) {
+        return {};
+    }
+    const QList<QByteArray> lines = file.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("0::")) {
+            return "/sys/fs/cgroup" + line.mid(3);
+        }
+    }
+    return {};
+}
+
+} // namespace
+
+MemoryMonitor::MemoryMonitor(const WriteFunction &write)
+    : m_write(write)
+{
+    setObjectName(QStringLiteral("QBreakpad memory monitor"));
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+MemoryMonitor::~MemoryMonitor()
+{
+    m_mutex.lock();
+    m_stopRequested = true;
+    m_mutex.unlock();
+    wake();
+    wait();
+    if (m_wakeFd != -1) {
+        close(m_wakeFd);
+    }
+}
+
+void MemoryMonitor::setPolicy(const MemoryPolicy &policy)
+{
+    m_mutex.lock();
+    m_policy = policy;
+    std::sort(m_policy.thresholds.begin(), m_policy.thresholds.end());
+    m_policyChanged = true;
+    m_mutex.unlock();
+    wake();
+}
+
+void MemoryMonitor::wake()
+{
+    const quint64 value = 1;
+    if (write(m_wakeFd, &value, sizeof(value)) == -1) {
+        // Already signalled.
+    }
+}
+
+void MemoryMonitor::run()
+{
+    openFiles();
+    while (true) {
+        m_mutex.lock();
+        if (m_stopRequested) {
+            m_mutex.unlock();
+            break;
+        }
+        if (m_policyChanged) {
+            m_policyChanged = false;
+            m_armed.clear();
+            for (int i = 0; i != m_policy.thresholds.size(); ++i) {
+                m_armed.append(true);
+            }
+            m_limitArmed = true;
+        }
+        const MemoryPolicy policy = m_policy;
+        m_mutex.unlock();
+
+        MemorySample sample = {};
+        if (takeSample(&sample)) {
+            const QByteArray reason = findTrigger(policy, sample);
+            if (!reason.isEmpty()) {
+                writeMemoryDump(reason, sample, policy.dumpSizeLimit);
+            }
+        }
+
+        // Only watch memory.events when its events lead to a dump, it may fire a
+        // lot in a throttled group.
+        pollfd fds[2] = {{m_wakeFd, POLLIN, 0}, {m_eventsFd, POLLPRI, 0}};
+        const nfds_t count = ((m_eventsFd != -1) && (policy.limitPercent > 0)) ? 2 : 1;
+        if ((poll(fds, count, std::max(10, policy.interval)) > 0) && (fds[0].revents & POLLIN)) {
+            quint64 value = 0;
+            if (read(m_wakeFd, &value, sizeof(value)) == -1) {
+                // Drained by a spurious wake-up.
+            }
+        }
+    }
+    closeFiles();
+}
+
+void MemoryMonitor::openFiles()
+{
+    m_statmFd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (m_statmFd == -1) {
+        qWarning().noquote() << "Failed to open /proc/self/statm, memory use is not monitored.";
+    }
+    m_cgroupPath = cgroupDirectory();
+    if (m_cgroupPath.isEmpty()) {
+        return;
+    }
+    const auto openCgroupFile = [this](const char *name) {
+        return open((m_cgroupPath + '/' + name).constData(), O_RDONLY | O_CLOEXEC);
+    };
+    m_currentFd = openCgroupFile("memory.current");
+    m_maxFd = openCgroupFile("memory.max");
+    m_highFd = openCgroupFile("memory.high");
+    m_eventsFd = openCgroupFile("memory.events");
+    m_statFd = openCgroupFile("memory.stat");
+}
+
+void MemoryMonitor::closeFiles()
+{
+    for (int *fd : {&m_statmFd, &m_currentFd, &m_maxFd, &m_highFd, &m_eventsFd, &m_statFd}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+bool MemoryMonitor::takeSample(MemorySample *sample) const
+{
+    // "size resident shared text lib data dt", in pages.
+    char statm[128] = {};
+    if (readFile(m_statmFd, statm, sizeof(statm)) <= 0) {
+        return false;
+    }
+    const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    char *end = nullptr;
+    sample->vmSize = strtoll(statm, &end, 10) * pageSize;
+    sample->rss = strtoll(end, nullptr, 10) * pageSize;
+    sample->cgroupCurrent = readNumber(m_currentFd);
+    sample->cgroupMax = readNumber(m_maxFd);
+    sample->cgroupHigh = readNumber(m_highFd);
+    // Reading memory.events also rearms its poll().
+    char events[512] = {};
+    if (readFile(m_eventsFd, events, sizeof(events)) > 0) {
+        sample->maxEvents = findValue(events, "max");
+        sample->oomKillEvents = findValue(events, "oom_kill");
+    }
+    return true;
+}
+
+// Returns why a dump is due, or an empty reason.
+QByteArray MemoryMonitor::findTrigger(const MemoryPolicy &policy, const MemorySample &sample)
+{
+    for (int i = 0; i != policy.thresholds.size(); ++i) {
+        if (sample.rss < ((policy.thresholds.at(i) / 10) * 9)) {
+            m_armed[i] = true;
+        }
+    }
+    qint64 limit = sample.cgroupMax;
+    if ((sample.cgroupHigh > 0) && ((limit <= 0) || (sample.cgroupHigh < limit))) {
+        limit = sample.cgroupHigh;
+    }
+    const qint64 percent = ((limit > 0) && (sample.cgroupCurrent >= 0))
+                               ? ((sample.cgroupCurrent * 100) / limit)
+                               : -1;
+    if ((percent >= 0) && (percent < (policy.limitPercent - 5))) {
+        m_limitArmed = true;
+    }
+    const bool hitMax = (m_maxEvents != -1) && (sample.maxEvents > m_maxEvents);
+    const bool oomKill = (m_oomKillEvents != -1) && (sample.oomKillEvents > m_oomKillEvents);
+    m_maxEvents = sample.maxEvents;
+    m_oomKillEvents = sample.oomKillEvents;
+
+    if (m_lastDump.isValid() && (m_lastDump.elapsed() < kMinDumpInterval)) {
+        return {};
+    }
+    QByteArray reason = {};
+    for (int i = policy.thresholds.size() - 1; i >= 0; --i) {
+        if (m_armed.at(i) && (sample.rss >= policy.thresholds.at(i))) {
+            reason = "resident set above " + QByteArray::number(policy.thresholds.at(i)) + " bytes";
+            // One dump for every threshold crossed at once.
+            for (int j = 0; j <= i; ++j) {
+                m_armed[j] = false;
+            }
+            break;
+        }
+    }
+    if (reason.isEmpty() && (policy.limitPercent > 0)) {
+        if (m_limitArmed && (percent >= policy.limitPercent)) {
+            reason = "cgroup at " + QByteArray::number(percent) + "% of its memory limit";
+            m_limitArmed = false;
+        } else if (oomKill) {
+            reason = "OOM kill in the cgroup";
+        } else if (hitMax) {
+            reason = "cgroup hit memory.max";
+        }
+    }
+    if (!reason.isEmpty()) {
+        m_lastDump.start();
+    }
+    return reason;
+}
+
+void MemoryMonitor::writeMemoryDump(const QByteArray &reason,
+                                    const MemorySample &sample,
+                                    qint64 sizeLimit)
+{
+    qWarning().noquote() << "Writing a memory dump:" << reason;
+    setAnnotation("qbreakpad.memory", reason.constData());
+    QString filePath = {};
+    const bool succeeded = m_write(sizeLimit, &filePath);
+    setAnnotation("qbreakpad.memory", "");
+    // A dump handed over in memory only has the reason, in its annotations.
+    if (!succeeded || filePath.isEmpty()) {
+        return;
+    }
+
+    QByteArray stats = "reason=" + reason + '\n';
+    stats += "rss=" + QByteArray::number(sample.rss) + '\n';
+    stats += "vm_size=" + QByteArray::number(sample.vmSize) + '\n';
+    if (!m_cgroupPath.isEmpty()) {
+        stats += "cgroup=" + m_cgroupPath + '\n';
+        stats += "memory.current=" + QByteArray::number(sample.cgroupCurrent) + '\n';
+        stats += "memory.max=" + QByteArray::number(sample.cgroupMax) + '\n';
+        stats += "memory.high=" + QByteArray::number(sample.cgroupHigh) + '\n';
+        char text[16384] = {};
+        if (readFile(m_eventsFd, text, sizeof(text)) > 0) {
+            appendKeyValues(&stats, "memory.events", text);
+        }
+        if (readFile(m_statFd, text, sizeof(text)) > 0) {
+            appendKeyValues(&stats, "memory.stat", text);
+        }
+    }
+    QFile file(filePath + QStringLiteral(".memory"));
+    if (!file.open(QFile::WriteOnly | QFile::Truncate) || (file.write(stats) != stats.size())) {
+        qWarning().noquote() << "Failed to write the memory statistics of" << filePath;
+    }
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <functional>
+
+namespace qbreakpad {
+
+struct MemoryPolicy
+{
+    // Resident set sizes, in bytes, that each get a dump when memory use grows past
+    // them.
+    QList<qint64> thresholds = {};
+    // Dump when the cgroup uses this percentage of its limit (the lower of
+    // memory.max and memory.high), or when it hits memory.max; zero disables both.
+    int limitPercent = 0;
+    // How often the process is sampled, in milliseconds; cgroup memory events
+    // wake the monitor at once.
+    int interval = 1000;
+    // Size limit of memory dumps, which are taken when there is little memory
+    // and disk to spare; zero keeps the one of every other dump.
+    qint64 dumpSizeLimit = 0;
+};
+
+struct MemorySample
+{
+    qint64 rss = 0;
+    qint64 vmSize = 0;
+    // -1 where there is no cgroup v2 memory controller, or no limit.
+    qint64 cgroupCurrent = -1;
+    qint64 cgroupMax = -1;
+    qint64 cgroupHigh = -1;
+    qint64 maxEvents = 0;
+    qint64 oomKillEvents = 0;
+};
+
+// Writes a dump, plus a "<dump>.memory" file with the memory statistics if the dump
+// is a file, when the process is about to run out of memory. The kernel OOM killer sends SIGKILL,
+// which no crash handler sees, so this is the only dump such a process leaves.
+// The resident set comes from /proc/self/statm; under a cgroup v2 memory
+// controller the monitor also polls memory.events, which the kernel signals as
+// soon as the group is throttled or hits its limit. A threshold is dumped once
+// and re-armed when memory use drops well below it; memory dumps are at least a
+// minute apart.
+class MemoryMonitor : public QThread
+{
+public:
+    // Gets the size limit of the policy; leaves filePath empty for a dump that is
+    // not written to a file.
+    using WriteFunction = std::function<bool(qint64 sizeLimit, QString *filePath)>;
+
+    explicit MemoryMonitor(const WriteFunction &write);
+    ~MemoryMonitor() override;
+
+    void setPolicy(const MemoryPolicy &policy);
+
+protected:
+    void run() override;
+
+private:
+    void openFiles();
+    void closeFiles();
+    bool takeSample(MemorySample *sample) const;
+    QByteArray findTrigger(const MemoryPolicy &policy, const MemorySample &sample);
+    void writeMemoryDump(const QByteArray &reason, const MemorySample &sample, qint64 sizeLimit);
+    void wake();
+
+    const WriteFunction m_write;
+    int m_wakeFd = -1;
+
+    QMutex m_mutex;
+    MemoryPolicy m_policy = {};
+    bool m_policyChanged = false;
+    bool m_stopRequested = false;
+
+    // Only touched by the worker thread.
+    int m_statmFd = -1;
+    int m_currentFd = -1;
+    int m_maxFd = -1;
+    int m_highFd = -1;
+    int m_eventsFd = -1;
+    int m_statFd = -1;
+    QByteArray m_cgroupPath = {};
+    QList<bool> m_armed = {};
+    bool m_limitArmed = true;
+    qint64 m_maxEvents = -1;
+    qint64 m_oomKillEvents = -1;
+    QElapsedTimer m_lastDump;
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,156 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_retention_p.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+namespace qbreakpad {
+
+namespace {
+
+// Without an age limit there is nothing to do until the next dump arrives.
+constexpr unsigned long kAgeCheckInterval = 60 * 60 * 1000;
+
+} // namespace
+
+DumpRetention::DumpRetention(const QString &dirPath, const QStringList &nameFilters)
+    : m_dirPath(dirPath)
+    , m_nameFilters(nameFilters)
+{
+    setObjectName(QStringLiteral("QBreakpad dump retention"));
+}
+
+DumpRetention::~DumpRetention()
+{
+    m_mutex.lock();
+    m_stopRequested = true;
+    m_condition.wakeAll();
+    m_mutex.unlock();
+    wait();
+}
+
+void DumpRetention::setPolicy(qint64 maxBytes, int maxCount, int maxAge)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_maxBytes = maxBytes;
+    m_maxCount = maxCount;
+    m_maxAge = maxAge;
+    m_policyChanged = true;
+    m_condition.wakeAll();
+}
+
+void DumpRetention::addDump(const QString &filePath)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_pendingFiles.append(filePath);
+    m_condition.wakeAll();
+}
+
+void DumpRetention::run()
+{
+#ifdef Q_OS_LINUX
+    m_index.open(m_dirPath);
+#endif
+    scanDirectory();
+    enforcePolicy();
+    m_mutex.lock();
+    while (!m_stopRequested) {
+        if (m_pendingFiles.isEmpty() && !m_policyChanged) {
+            m_condition.wait(&m_mutex, (m_maxAge > 0) ? kAgeCheckInterval : ULONG_MAX);
+        }
+        const QStringList pendingFiles = m_pendingFiles;
+        m_pendingFiles.clear();
+        m_policyChanged = false;
+        m_mutex.unlock();
+        for (const QString &filePath : pendingFiles) {
+            indexFile(filePath);
+        }
+        enforcePolicy();
+        m_mutex.lock();
+    }
+    m_mutex.unlock();
+}
+
+void DumpRetention::scanDirectory()
+{
+    const QDir dir(m_dirPath);
+    const QStringList fileNames = dir.entryList(m_nameFilters, QDir::Files | QDir::NoDotAndDotDot);
+    for (const QString &fileName : fileNames) {
+        indexFile(dir.absoluteFilePath(fileName));
+    }
+}
+
+void DumpRetention::indexFile(const QString &filePath)
+{
+    if (m_indexedFiles.contains(filePath)) {
+        return;
+    }
+    const QFileInfo fileInfo(filePath);
+    if (!fileInfo.isFile()) {
+        return;
+    }
+    m_entries.insert({fileInfo.lastModified().toMSecsSinceEpoch(), {filePath, fileInfo.size()}});
+    m_indexedFiles.insert(filePath);
+    m_totalBytes += fileInfo.size();
+}
+
+void DumpRetention::enforcePolicy()
+{
+    m_mutex.lock();
+    const qint64 maxBytes = m_maxBytes;
+    const int maxCount = m_maxCount;
+    const qint64 maxAgeMs = qint64(m_maxAge) * 1000;
+    m_mutex.unlock();
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    // The newest dump always survives, even if it alone exceeds the quota.
+    while (m_entries.size() > 1) {
+        const auto oldest = m_entries.begin();
+        const bool overCount = (maxCount > 0) && (m_entries.size() > size_t(maxCount));
+        const bool overBytes = (maxBytes > 0) && (m_totalBytes > maxBytes);
+        const bool expired = (maxAgeMs > 0) && ((now - oldest->first) > maxAgeMs);
+        if (!overCount && !overBytes && !expired) {
+            break;
+        }
+        const Entry &entry = oldest->second;
+        if (!QFile::remove(entry.filePath) && QFileInfo::exists(entry.filePath)) {
+            qWarning().noquote() << "Failed to remove old minidump" << entry.filePath;
+        }
+        QFile::remove(entry.filePath + QString::fromUtf8(".annotations"));
+        QFile::remove(entry.filePath + QString::fromUtf8(".memory"));
+#ifdef Q_OS_LINUX
+        m_index.setState(QFileInfo(entry.filePath).fileName(), DumpIndex::Removed);
+#endif
+        m_totalBytes -= entry.size;
+        m_indexedFiles.remove(entry.filePath);
+        m_entries.erase(oldest);
+    }
+}
+
+} // namespace qbreakpad
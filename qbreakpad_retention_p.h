@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+#include <climits>
+#include <map>
+
+#ifdef Q_OS_LINUX
+#include "qbreakpad_index_p.h"
+#endif
+
+namespace qbreakpad {
+
+// Keeps the dump directory within a size, count and age quota. The directory is
+// scanned once, on the worker thread, when the retention starts; after that new
+// dumps are announced through addDump() and kept in an index ordered by time, so
+// enforcing the quota never needs another readdir().
+class DumpRetention : public QThread
+{
+public:
+    explicit DumpRetention(const QString &dirPath, const QStringList &nameFilters);
+    ~DumpRetention() override;
+
+    void setPolicy(qint64 maxBytes, int maxCount, int maxAge);
+    void addDump(const QString &filePath);
+
+protected:
+    void run() override;
+
+private:
+    struct Entry
+    {
+        QString filePath = {};
+        qint64 size = 0;
+    };
+
+    void scanDirectory();
+    void indexFile(const QString &filePath);
+    void enforcePolicy();
+
+    const QString m_dirPath;
+    const QStringList m_nameFilters;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QStringList m_pendingFiles = {};
+    qint64 m_maxBytes = 0;
+    int m_maxCount = 0;
+    int m_maxAge = 0;
+    bool m_policyChanged = false;
+    bool m_stopRequested = false;
+
+    // Only touched by the worker thread.
+    std::multimap<qint64, Entry> m_entries = {};
+    QSet<QString> m_indexedFiles = {};
+    qint64 m_totalBytes = 0;
+#ifdef Q_OS_LINUX
+    DumpIndex m_index;
+#endif
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,371 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_signature_p.h"
+
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+constexpr int kSignatureFrameCount = 8;
+constexpr quintptr kMaxFrameSize = 1024 * 1024;
+// How far above the stack pointer the first frame may be; any further and the
+// frame pointer register holds something else.
+constexpr quintptr kMaxStackSpan = 8 * 1024 * 1024;
+constexpr quint32 kTableMagic = 0x51425347; // "QBSG"
+constexpr quint32 kTableVersion = 1;
+constexpr quint32 kTableCapacity = 256;
+// Tries to take over an entry that another process keeps taking first.
+constexpr int kClaimAttempts = 4;
+
+constexpr quint64 kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+constexpr quint64 kFnvPrime = 0x100000001b3ULL;
+
+quint64 fnv1a(quint64 hash, const void *data, size_t size)
+{
+    const auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i != size; ++i) {
+        hash = (hash ^ bytes[i]) * kFnvPrime;
+    }
+    return hash;
+}
+
+// A wild frame pointer must not fault inside the signal handler, so the stack is
+// read through the kernel, which reports EFAULT instead.
+bool readWord(quintptr address, quintptr *value)
+{
+    iovec local = {value, sizeof(*value)};
+    iovec remote = {reinterpret_cast<void *>(address), sizeof(*value)};
+    return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) == ssize_t(sizeof(*value));
+}
+
+int collectFrames(const ucontext_t *context, quintptr *frames)
+{
+    int count = 0;
+#if defined(__x86_64__)
+    frames[count++] = static_cast<quintptr>(context->uc_mcontext.gregs[REG_RIP]);
+    const quintptr sp = static_cast<quintptr>(context->uc_mcontext.gregs[REG_RSP]);
+    quintptr fp = static_cast<quintptr>(context->uc_mcontext.gregs[REG_RBP]);
+#elif defined(__aarch64__)
+    frames[count++] = static_cast<quintptr>(context->uc_mcontext.pc);
+    frames[count++] = static_cast<quintptr>(context->uc_mcontext.regs[30]);
+    const quintptr sp = static_cast<quintptr>(context->uc_mcontext.sp);
+    quintptr fp = static_cast<quintptr>(context->uc_mcontext.regs[29]);
+#else
+    // No frame walker for this architecture, the signature degrades to zero and
+    // every crash is treated as unique.
+    Q_UNUSED(context)
+    Q_UNUSED(frames)
+    return 0;
+#endif
+#if defined(__x86_64__) || defined(__aarch64__)
+    if ((fp < sp) || ((fp - sp) > kMaxStackSpan)) {
+        return count;
+    }
+    // Both ABIs keep {previous frame pointer, return address} at the frame pointer.
+    while ((count < kSignatureFrameCount) && (fp != 0) && ((fp % sizeof(quintptr)) == 0)) {
+        quintptr next = 0;
+        quintptr returnAddress = 0;
+        if (!readWord(fp, &next) || !readWord(fp + sizeof(quintptr), &returnAddress)
+            || (returnAddress == 0)) {
+            break;
+        }
+        frames[count++] = returnAddress;
+        if ((next <= fp) || ((next - fp) > kMaxFrameSize)) {
+            break;
+        }
+        fp = next;
+    }
+    return count;
+#endif
+}
+
+const char *parseHex(const char *text, const char *end, quintptr *value)
+{
+    *value = 0;
+    for (; text != end; ++text) {
+        const char c = *text;
+        int digit = 0;
+        if ((c >= '0') && (c <= '9')) {
+            digit = c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            digit = c - 'a' + 10;
+        } else {
+            break;
+        }
+        *value = (*value << 4) | quintptr(digit);
+    }
+    return text;
+}
+
+// Handles one /proc/self/maps line:
+// "start-end perms offset dev inode     path".
+void resolveFrames(const char *line, const char *end, const quintptr *frames, int count,
+                   quint64 *moduleHashes, quintptr *offsets)
+{
+    quintptr start = 0;
+    quintptr stop = 0;
+    quintptr fileOffset = 0;
+    const char *cursor = parseHex(line, end, &start);
+    if ((cursor == end) || (*cursor++ != '-')) {
+        return;
+    }
+    cursor = parseHex(cursor, end, &stop);
+    // A return address has to point at code.
+    if (((end - cursor) < 4) || (cursor[3] != 'x')) {
+        return;
+    }
+    bool matched = false;
+    for (int i = 0; i != count; ++i) {
+        matched |= (frames[i] >= start) && (frames[i] < stop);
+    }
+    if (!matched) {
+        return;
+    }
+    // perms, offset, dev, inode, path
+    int field = 0;
+    const char *name = end;
+    while (cursor != end) {
+        while ((cursor != end) && (*cursor == ' ')) {
+            ++cursor;
+        }
+        if (cursor == end) {
+            break;
+        }
+        ++field;
+        if (field == 2) {
+            cursor = parseHex(cursor, end, &fileOffset);
+        } else if (field == 5) {
+            name = cursor;
+            break;
+        }
+        while ((cursor != end) && (*cursor != ' ')) {
+            ++cursor;
+        }
+    }
+    const char *baseName = name;
+    for (const char *c = name; c != end; ++c) {
+        if (*c == '/') {
+            baseName = c + 1;
+        }
+    }
+    const quint64 nameHash = fnv1a(kFnvOffsetBasis, baseName, size_t(end - baseName));
+    for (int i = 0; i != count; ++i) {
+        if ((frames[i] >= start) && (frames[i] < stop)) {
+            moduleHashes[i] = nameHash;
+            offsets[i] = frames[i] - start + fileOffset;
+        }
+    }
+}
+
+char g_mapsBuffer[16 * 1024] = {};
+
+} // namespace
+
+quint64 computeCrashSignature(const ucontext_t *context)
+{
+    quintptr frames[kSignatureFrameCount] = {};
+    const int count = collectFrames(context, frames);
+    if (count == 0) {
+        return 0;
+    }
+    quint64 moduleHashes[kSignatureFrameCount] = {};
+    quintptr offsets[kSignatureFrameCount] = {};
+    for (int i = 0; i != count; ++i) {
+        offsets[i] = frames[i];
+    }
+
+    const int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    int resolvedCount = count;
+    if (fd != -1) {
+        size_t used = 0;
+        for (;;) {
+            const ssize_t bytes = read(fd, g_mapsBuffer + used, sizeof(g_mapsBuffer) - used);
+            if ((bytes < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if (bytes <= 0) {
+                break;
+            }
+            used += size_t(bytes);
+            const char *line = g_mapsBuffer;
+            const char *bufferEnd = g_mapsBuffer + used;
+            for (const char *c = line; c != bufferEnd; ++c) {
+                if (*c == '\n') {
+                    resolveFrames(line, c, frames, count, moduleHashes, offsets);
+                    line = c + 1;
+                }
+            }
+            used = size_t(bufferEnd - line);
+            if (used == sizeof(g_mapsBuffer)) {
+                // A single line longer than the buffer, skip it.
+                used = 0;
+            }
+            memmove(g_mapsBuffer, line, used);
+        }
+        close(fd);
+        // A return address outside of the code means that the chain was none, as in
+        // code built with -fomit-frame-pointer; only the faulting instruction, and
+        // the link register, are left to go by.
+        resolvedCount = 0;
+        while ((resolvedCount != count) && (moduleHashes[resolvedCount] != 0)) {
+            ++resolvedCount;
+        }
+#if defined(__aarch64__)
+        resolvedCount = std::max(resolvedCount, std::min(count, 2));
+#else
+        resolvedCount = std::max(resolvedCount, 1);
+#endif
+    }
+
+    quint64 signature = kFnvOffsetBasis;
+    for (int i = 0; i != resolvedCount; ++i) {
+        signature = fnv1a(signature, &moduleHashes[i], sizeof(moduleHashes[i]));
+        signature = fnv1a(signature, &offsets[i], sizeof(offsets[i]));
+    }
+    return signature;
+}
+
+struct CrashSignatureTable::Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 capacity;
+    quint32 reserved;
+};
+
+// Shared by processes without a lock, so every field is a lock-free atomic, which
+// works across processes; an entry belongs to whoever swapped its signature in.
+struct CrashSignatureTable::Entry
+{
+    std::atomic<quint64> signature;
+    std::atomic<qint64> firstSeen;
+    std::atomic<qint64> lastSeen;
+    std::atomic<quint32> count;
+    std::atomic<quint32> suppressed;
+};
+
+static_assert(std::atomic<quint64>::is_always_lock_free,
+              "The signature table needs atomics that work across processes.");
+
+CrashSignatureTable::~CrashSignatureTable()
+{
+    if (m_header) {
+        munmap(m_header, m_mappedSize);
+    }
+}
+
+bool CrashSignatureTable::open(const QString &filePath)
+{
+    if (isOpen()) {
+        return true;
+    }
+    const QByteArray path = QFile::encodeName(filePath);
+    const int fd = ::open(path.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        qWarning().noquote() << "Failed to open the crash signature table" << filePath;
+        return false;
+    }
+    const size_t size = sizeof(Header) + (sizeof(Entry) * kTableCapacity);
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, off_t(size)) == 0) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        qWarning().noquote() << "Failed to map the crash signature table" << filePath;
+        return false;
+    }
+    auto header = static_cast<Header *>(memory);
+    if ((header->magic != kTableMagic) || (header->version != kTableVersion)
+        || (header->capacity != kTableCapacity)) {
+        memset(memory, 0, size);
+        header->magic = kTableMagic;
+        header->version = kTableVersion;
+        header->capacity = kTableCapacity;
+    }
+    m_header = header;
+    m_entries = reinterpret_cast<Entry *>(header + 1);
+    m_mappedSize = size;
+    return true;
+}
+
+bool CrashSignatureTable::record(quint64 signature, int window)
+{
+    if (!isOpen() || (signature == 0)) {
+        return false;
+    }
+    timespec ts = {};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const qint64 now = ts.tv_sec;
+    for (int attempt = 0; attempt != kClaimAttempts; ++attempt) {
+        Entry *oldest = m_entries;
+        qint64 oldestSeen = oldest->lastSeen.load();
+        for (quint32 i = 0; i != kTableCapacity; ++i) {
+            Entry &entry = m_entries[i];
+            if (entry.signature.load() == signature) {
+                const bool duplicate = (now - entry.lastSeen.exchange(now)) <= window;
+                if (duplicate) {
+                    entry.suppressed.fetch_add(1);
+                } else {
+                    entry.firstSeen.store(now);
+                }
+                entry.count.fetch_add(1);
+                return duplicate;
+            }
+            const qint64 lastSeen = entry.lastSeen.load();
+            if (lastSeen < oldestSeen) {
+                oldest = &entry;
+                oldestSeen = lastSeen;
+            }
+        }
+        // Whoever got the entry first may have recorded this very signature, so
+        // look again after losing it.
+        quint64 evicted = oldest->signature.load();
+        if (oldest->lastSeen.load() != oldestSeen
+            || !oldest->signature.compare_exchange_strong(evicted, signature)) {
+            continue;
+        }
+        oldest->firstSeen.store(now);
+        oldest->count.store(1);
+        oldest->suppressed.store(0);
+        oldest->lastSeen.store(now);
+        return false;
+    }
+    return false;
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,67 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QString>
+#include <sys/ucontext.h>
+
+namespace qbreakpad {
+
+// Hash of the faulting instruction and the first return addresses of the crashing
+// thread's frame pointer chain. Every address is made relative to the file it was
+// mapped from and combined with that file's name, so the same bug gives the same
+// signature across restarts despite ASLR. Async-signal-safe.
+//
+// The chain only exists in code built with -fno-omit-frame-pointer (see the
+// QBREAKPAD_FRAME_POINTERS CMake option). The walk stops at the first frame that
+// is not on the stack or whose return address is not in an executable mapping,
+// so without frame pointers the signature comes down to the faulting instruction,
+// and different crashes at the same place count as duplicates.
+quint64 computeCrashSignature(const ucontext_t *context);
+
+// Recently seen signatures, in a small file shared by all processes that use the
+// same dump directory.
+class CrashSignatureTable
+{
+public:
+    ~CrashSignatureTable();
+
+    bool open(const QString &filePath);
+    bool isOpen() const { return m_header != nullptr; }
+
+    // Async-signal-safe. Returns true if the signature was already seen in the last
+    // window seconds; either way it is recorded as seen now.
+    bool record(quint64 signature, int window);
+
+private:
+    struct Header;
+    struct Entry;
+
+    Header *m_header = nullptr;
+    Entry *m_entries = nullptr;
+    size_t m_mappedSize = 0;
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,156 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_slots_p.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+
+namespace qbreakpad {
+
+namespace {
+
+const char kSlotPrefix[] = ".qbreakpad-slot-";
+
+} // namespace
+
+DumpSlotPool::DumpSlotPool(const QString &dirPath, int count, qint64 size)
+    : m_dirPath(dirPath)
+    , m_count(count)
+    , m_size(size)
+{
+    setObjectName(QStringLiteral("QBreakpad dump slots"));
+}
+
+DumpSlotPool::~DumpSlotPool()
+{
+    m_mutex.lock();
+    m_stopRequested = true;
+    m_condition.wakeAll();
+    m_mutex.unlock();
+    wait();
+    for (const Slot &slot : std::as_const(m_slots)) {
+        close(slot.fd);
+        unlink(slot.filePath.constData());
+    }
+}
+
+void DumpSlotPool::fill()
+{
+    removeStaleSlots();
+    const QMutexLocker locker(&m_mutex);
+    while (m_slots.size() < m_count) {
+        Slot slot = {};
+        if (!createSlot(&slot, m_nextSlot++)) {
+            break;
+        }
+        m_slots.append(slot);
+    }
+}
+
+bool DumpSlotPool::take(int *fd, QByteArray *filePath)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_condition.wakeAll();
+    if (m_slots.isEmpty()) {
+        return false;
+    }
+    const Slot slot = m_slots.takeFirst();
+    *fd = slot.fd;
+    *filePath = slot.filePath;
+    return true;
+}
+
+bool DumpSlotPool::createSlot(Slot *slot, quint64 number) const
+{
+    const QByteArray filePath = QFile::encodeName(m_dirPath + QDir::separator()
+                                                  + QString::fromUtf8(kSlotPrefix)
+                                                  + QString::number(getpid())
+                                                  + QChar::fromLatin1('-')
+                                                  + QString::number(number));
+    const int fd = open(filePath.constData(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        qWarning().noquote() << "Failed to create the dump slot" << QFile::decodeName(filePath);
+        return false;
+    }
+    // The size stays 0: a dump shorter than the slot must not end in zeros.
+    if ((fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, off_t(m_size)) != 0) && (errno != EOPNOTSUPP)) {
+        qWarning().noquote() << "Failed to reserve" << m_size << "bytes for a dump slot.";
+        close(fd);
+        unlink(filePath.constData());
+        return false;
+    }
+    slot->fd = fd;
+    slot->filePath = filePath;
+    return true;
+}
+
+void DumpSlotPool::removeStaleSlots()
+{
+    const QStringList fileNames = QDir(m_dirPath).entryList({QString::fromUtf8(kSlotPrefix)
+                                                             + QChar::fromLatin1('*')},
+                                                            QDir::Files | QDir::Hidden);
+    for (const QString &fileName : fileNames) {
+        // .qbreakpad-slot-<pid>-<number>
+        const QString pid = fileName.mid(int(sizeof(kSlotPrefix)) - 1)
+                                .section(QChar::fromLatin1('-'), 0, 0);
+        bool ok = false;
+        const pid_t owner = pid_t(pid.toInt(&ok));
+        if (ok && (owner != getpid()) && (kill(owner, 0) == -1) && (errno == ESRCH)) {
+            QFile::remove(m_dirPath + QDir::separator() + fileName);
+        }
+    }
+}
+
+void DumpSlotPool::run()
+{
+    m_mutex.lock();
+    while (!m_stopRequested) {
+        if (m_slots.size() >= m_count) {
+            m_condition.wait(&m_mutex);
+            continue;
+        }
+        // take() must not wait for a slow file system.
+        const quint64 number = m_nextSlot++;
+        m_mutex.unlock();
+        Slot slot = {};
+        const bool created = createSlot(&slot, number);
+        m_mutex.lock();
+        if (created) {
+            m_slots.append(slot);
+        } else if (!m_stopRequested) {
+            // Most likely out of space; try again after the next dump.
+            m_condition.wait(&m_mutex);
+        }
+    }
+    m_mutex.unlock();
+}
+
+} // namespace qbreakpad
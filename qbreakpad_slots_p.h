@@ -0,0 +1,77 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+namespace qbreakpad {
+
+// Dump files created and fallocate()d ahead of time, so that a crash writes into a
+// file that already has its blocks instead of creating one on a slow or full file
+// system. A slot is handed out with take(); the worker thread creates a new one in
+// its place. Slot files are hidden and carry the pid, slots of processes that are
+// gone are removed by the next pool in the same directory.
+class DumpSlotPool : public QThread
+{
+public:
+    explicit DumpSlotPool(const QString &dirPath, int count, qint64 size);
+    ~DumpSlotPool() override;
+
+    // Creates the first slots on the calling thread.
+    void fill();
+    // Hands out a slot, the caller owns fd and the file. Returns false when the pool
+    // ran dry instead of creating one with the mutex held; the worker refills it.
+    bool take(int *fd, QByteArray *filePath);
+
+protected:
+    void run() override;
+
+private:
+    struct Slot
+    {
+        int fd = -1;
+        QByteArray filePath = {};
+    };
+
+    bool createSlot(Slot *slot, quint64 number) const;
+    void removeStaleSlots();
+
+    const QString m_dirPath;
+    const int m_count;
+    const qint64 m_size;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QList<Slot> m_slots = {};
+    quint64 m_nextSlot = 0;
+    bool m_stopRequested = false;
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,364 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_snapshot_p.h"
+#include "qbreakpad_dumper_p.h"
+
+#include <QtGlobal>
+#include <google_breakpad/common/minidump_exception_linux.h>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+using CrashContext = google_breakpad::ExceptionHandler::CrashContext;
+
+constexpr size_t kSnapshotStackSize = 64 * 1024;
+// Enough for a thread that is busy in a system call to take the signal; one that
+// does not is left out instead of stalling everybody else. A thread that blocks
+// the signal never takes it, so it costs the caller all of this.
+constexpr qint64 kFreezeTimeoutNs = 200 * 1000 * 1000;
+// What Breakpad's writer does for a size limit, which it only applies when it
+// suspends the threads itself: past the first threads, stacks are cut short once
+// the dump is expected to outgrow the limit.
+constexpr size_t kLimitBaseThreadCount = 20;
+constexpr off_t kLimitAverageStackSize = 8 * 1024;
+constexpr off_t kLimitFudgeFactor = 64 * 1024;
+constexpr size_t kLimitExtraStackSize = 2 * 1024;
+
+struct SnapshotThread
+{
+    pid_t tid;
+    std::atomic<bool> captured;
+    CrashContext context;
+};
+
+struct SnapshotRequest
+{
+    const char *path;
+    const AppMemoryRegions *appMemory;
+    off_t sizeLimit;
+    SnapshotThread *threads;
+    size_t threadCount;
+    // The snapshotted process, not the child that writes the dump.
+    pid_t process;
+    pid_t parentProcess;
+    pid_t requestingThread;
+};
+
+int snapshotSignal()
+{
+    // The top of the real-time range, away from the ones libraries usually take.
+    return SIGRTMAX - 2;
+}
+
+std::atomic<bool> m_snapshotInProgress = false;
+bool m_signalHandlerInstalled = false;
+// Ends with a zero tid. Grown when needed, never freed: a thread that took the
+// signal late may still be looking at an older array.
+SnapshotThread *m_threadArray = nullptr;
+size_t m_threadArrayCapacity = 0;
+std::atomic<SnapshotThread *> m_frozenThreads = nullptr;
+std::atomic<int> m_arrivedThreads = 0;
+// Futex word; stopped threads wait for it to change.
+std::atomic<int> m_releaseGeneration = 0;
+
+// The child is not created with CLONE_VM, it runs on its own copy of this.
+alignas(16) char m_snapshotStack[kSnapshotStackSize] = {};
+SnapshotRequest m_snapshotRequest = {};
+
+qint64 monotonicNs()
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (qint64(ts.tv_sec) * 1000000000) + ts.tv_nsec;
+}
+
+void freezeHandler(int signal, siginfo_t *info, void *uc)
+{
+    Q_UNUSED(signal)
+    Q_UNUSED(info)
+    const int savedErrno = errno;
+    // Generation first: if the threads are released between the two loads, the
+    // wait below sees the new generation and returns at once.
+    const int generation = m_releaseGeneration.load();
+    SnapshotThread *threads = m_frozenThreads.load();
+    const pid_t tid = pid_t(syscall(SYS_gettid));
+    for (size_t i = 0; threads && (threads[i].tid != 0); ++i) {
+        if ((threads[i].tid != tid) || threads[i].captured.load()) {
+            continue;
+        }
+        captureThreadContext(static_cast<const ucontext_t *>(uc), &threads[i].context);
+        threads[i].context.tid = tid;
+        threads[i].captured.store(true);
+        m_arrivedThreads.fetch_add(1);
+        while (m_releaseGeneration.load() == generation) {
+            syscall(SYS_futex, &m_releaseGeneration, FUTEX_WAIT_PRIVATE, generation, nullptr, nullptr, 0);
+        }
+        break;
+    }
+    errno = savedErrno;
+}
+
+// Dumps the snapshot from inside the child. The child is a single thread, so the
+// threads come from the contexts saved by the stopped threads, and memory is read
+// from our own copy of the address space instead of through ptrace.
+class SnapshotDumper : public google_breakpad::LinuxPtraceDumper
+{
+public:
+    explicit SnapshotDumper(const SnapshotRequest &request)
+        : google_breakpad::LinuxPtraceDumper(getpid())
+        , m_request(request)
+    {}
+
+    bool ThreadsSuspend() override { return true; }
+    bool ThreadsResume() override
+    {
+        m_stackLimiter.restore();
+        return true;
+    }
+
+    bool CopyFromProcess(void *dest, pid_t child, const void *src, size_t length) override
+    {
+        Q_UNUSED(child)
+        iovec local = {dest, length};
+        iovec remote = {const_cast<void *>(src), length};
+        if (process_vm_readv(pid_, &local, 1, &remote, 1, 0) == ssize_t(length)) {
+            return true;
+        }
+        memset(dest, 0, length);
+        return false;
+    }
+
+    bool GetThreadInfoByIndex(size_t index, google_breakpad::ThreadInfo *info) override
+    {
+        if (index >= m_threadCount) {
+            return false;
+        }
+        m_stackLimiter.restore();
+        memset(info, 0, sizeof(*info));
+        info->tgid = m_request.process;
+        info->ppid = m_request.parentProcess;
+        fillThreadRegisters(m_request.threads[m_threadIndices[index]].context, info);
+        // The requesting thread comes first, its stack is never cut.
+        if (m_limitStacks && (index >= kLimitBaseThreadCount)) {
+            m_stackLimiter.limit(*this, info->stack_pointer, kLimitExtraStackSize);
+        }
+        return true;
+    }
+
+protected:
+    bool EnumerateThreads() override
+    {
+        for (size_t i = 0; i != m_request.threadCount; ++i) {
+            if (m_request.threads[i].captured.load(std::memory_order_relaxed)
+                && (m_threadCount != kMaxThreads)) {
+                threads_.push_back(m_request.threads[i].tid);
+                m_threadIndices[m_threadCount++] = i;
+            }
+        }
+        m_limitStacks = (m_request.sizeLimit > 0) && (m_threadCount > kLimitBaseThreadCount)
+                        && (((off_t(m_threadCount) * kLimitAverageStackSize) + kLimitFudgeFactor)
+                            > m_request.sizeLimit);
+        return m_threadCount > 0;
+    }
+
+private:
+    static constexpr size_t kMaxThreads = 4096;
+
+    const SnapshotRequest &m_request;
+    size_t m_threadIndices[kMaxThreads] = {};
+    size_t m_threadCount = 0;
+    bool m_limitStacks = false;
+    StackLimiter m_stackLimiter;
+};
+
+int snapshotMain(void *argument)
+{
+    const auto request = static_cast<const SnapshotRequest *>(argument);
+    // Whatever goes wrong in here must not look like a crash of the service.
+    for (const int signal : {SIGSEGV, SIGABRT, SIGFPE, SIGILL, SIGBUS, SIGTRAP}) {
+        struct sigaction action = {};
+        action.sa_handler = SIG_DFL;
+        sigaction(signal, &action, nullptr);
+    }
+    // Too big for this stack; the heap of the copy may have been locked by a
+    // stopped thread, so the memory comes straight from mmap(). Never released,
+    // the child exits right after.
+    google_breakpad::PageAllocator allocator;
+    void *memory = allocator.Alloc(sizeof(SnapshotDumper));
+    if (!memory) {
+        _exit(EXIT_FAILURE);
+    }
+    auto dumper = new (memory) SnapshotDumper(*request);
+    dumper->set_crash_thread(request->requestingThread);
+    dumper->set_crash_signal(MD_EXCEPTION_CODE_LIN_DUMP_REQUESTED);
+    // Our own copy of the regions.
+    const google_breakpad::AppMemoryList &appMemory
+        = const_cast<AppMemoryRegions *>(request->appMemory)->collect();
+    const bool ok = google_breakpad::WriteMinidump(request->path,
+                                                   google_breakpad::MappingList(),
+                                                   appMemory,
+                                                   dumper);
+    _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+bool installFreezeHandler()
+{
+    if (m_signalHandlerInstalled) {
+        return true;
+    }
+    // Stays installed: a thread that had the signal blocked takes it whenever it
+    // unblocks it, and must not be killed by the default action then.
+    struct sigaction action = {};
+    action.sa_sigaction = freezeHandler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigfillset(&action.sa_mask);
+    m_signalHandlerInstalled = (sigaction(snapshotSignal(), &action, nullptr) == 0);
+    return m_signalHandlerInstalled;
+}
+
+void reserveThreads(size_t count)
+{
+    // One more for the terminating entry.
+    if (count < m_threadArrayCapacity) {
+        return;
+    }
+    const size_t capacity = qMax<size_t>(64, count * 2);
+    auto threads = new SnapshotThread[capacity]();
+    for (size_t i = 0; i != m_threadArrayCapacity; ++i) {
+        threads[i].tid = m_threadArray[i].tid;
+    }
+    m_threadArray = threads;
+    m_threadArrayCapacity = capacity;
+}
+
+// Everything that allocates happens here, before any thread is stopped: a stopped
+// thread may hold the malloc lock. Threads being started right now may be missed,
+// they are not part of the snapshot then.
+size_t prepareThreads(pid_t requestingThread)
+{
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir) {
+        return 0;
+    }
+    // The requesting thread goes first, it is always captured.
+    reserveThreads(1);
+    m_threadArray[0].tid = requestingThread;
+    size_t count = 1;
+    while (const dirent *entry = readdir(dir)) {
+        const pid_t tid = pid_t(atoi(entry->d_name));
+        if ((tid <= 0) || (tid == requestingThread)) {
+            continue;
+        }
+        reserveThreads(count + 1);
+        m_threadArray[count++].tid = tid;
+    }
+    closedir(dir);
+    m_threadArray[count].tid = 0;
+    for (size_t i = 0; i != count; ++i) {
+        m_threadArray[i].captured.store(false);
+    }
+    return count;
+}
+
+} // namespace
+
+pid_t startSnapshotDump(const char *path,
+                        const AppMemoryRegions &appMemory,
+                        off_t sizeLimit,
+                        qint64 *freezeTime)
+{
+    bool expected = false;
+    if (!m_snapshotInProgress.compare_exchange_strong(expected, true)) {
+        return -1;
+    }
+    const pid_t process = getpid();
+    const pid_t requestingThread = pid_t(syscall(SYS_gettid));
+    const size_t threadCount = installFreezeHandler() ? prepareThreads(requestingThread) : 0;
+    if (threadCount == 0) {
+        m_snapshotInProgress.store(false);
+        return -1;
+    }
+
+    const qint64 freezeStart = monotonicNs();
+    m_arrivedThreads.store(0);
+    m_frozenThreads.store(m_threadArray);
+    int signalled = 0;
+    for (size_t i = 1; i != threadCount; ++i) {
+        if (syscall(SYS_tgkill, process, m_threadArray[i].tid, snapshotSignal()) == 0) {
+            ++signalled;
+        }
+    }
+    const qint64 deadline = monotonicNs() + kFreezeTimeoutNs;
+    while ((m_arrivedThreads.load() < signalled) && (monotonicNs() < deadline)) {
+        sched_yield();
+    }
+    if (freezeTime) {
+        *freezeTime = monotonicNs() - freezeStart;
+    }
+
+    ucontext_t uc = {};
+    getcontext(&uc);
+    captureThreadContext(&uc, &m_threadArray[0].context);
+    m_threadArray[0].context.tid = requestingThread;
+    m_threadArray[0].captured.store(true);
+
+    m_snapshotRequest = {path,
+                         &appMemory,
+                         sizeLimit,
+                         m_threadArray,
+                         threadCount,
+                         process,
+                         getppid(),
+                         requestingThread};
+    // clone() without CLONE_VM is fork() minus the atfork handlers, which would
+    // try to take locks the stopped threads may be holding.
+    const pid_t child = clone(snapshotMain,
+                              m_snapshotStack + sizeof(m_snapshotStack),
+                              SIGCHLD,
+                              &m_snapshotRequest);
+
+    m_frozenThreads.store(nullptr);
+    m_releaseGeneration.fetch_add(1);
+    syscall(SYS_futex, &m_releaseGeneration, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    m_snapshotInProgress.store(false);
+    return child;
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,52 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "qbreakpad_dumper_p.h"
+
+#include <QtGlobal>
+#include <sys/types.h>
+
+namespace qbreakpad {
+
+// Takes a copy-on-write snapshot of the running process and writes a minidump of
+// it from a child process, so the caller only stalls for as long as it takes to
+// stop the other threads and fork(). Every other thread is stopped by a signal
+// (SIGRTMAX-2) right before the fork and released right after, each saving its
+// registers first, so the child can dump all of them although only the calling
+// thread exists in it. Threads that block the signal, or do not take it within
+// 200 ms, are left out of the dump; the caller waits out those 200 ms whenever a
+// single thread blocks the signal.
+//
+// The child writes the dump to path and exits; the caller has to waitpid() the
+// returned pid. A positive sizeLimit cuts stacks the way Breakpad does for the
+// size limit of a descriptor. *freezeTime, if given, gets the nanoseconds spent
+// stopping the threads, part of the caller's stall. Returns -1 on failure.
+pid_t startSnapshotDump(const char *path,
+                        const AppMemoryRegions &appMemory,
+                        off_t sizeLimit,
+                        qint64 *freezeTime = nullptr);
+
+} // namespace qbreakpad
@@ -0,0 +1,293 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_stats_p.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+constexpr quint32 kStatsMagic = 0x51425354; // "QBST"
+constexpr quint32 kStatsVersion = 1;
+constexpr qint64 kFirstBucketBound = 250;
+
+struct MetricInfo
+{
+    const char *name;
+    const char *help;
+};
+
+constexpr MetricInfo kCounterInfo[CrashStats::CounterCount] = {
+    {"qbreakpad_dumps_written_total", "Minidumps written."},
+    {"qbreakpad_dumps_failed_total", "Minidumps that could not be written."},
+    {"qbreakpad_duplicate_crashes_total", "Crashes skipped as duplicates of a recent one."},
+    {"qbreakpad_dump_bytes_written_total", "Size of the written minidumps, as stored."},
+    {"qbreakpad_reporter_launches_total", "Crash reporters started for a dump."},
+    {"qbreakpad_reporter_launch_failures_total", "Crash reporters that failed to start."},
+    {"qbreakpad_reporter_notifications_total", "Dumps handed to the crash reporter daemon."},
+};
+
+constexpr MetricInfo kHistogramInfo[CrashStats::HistogramCount] = {
+    {"qbreakpad_dump_write_seconds", "Time from the crash or request to the finished minidump."},
+    {"qbreakpad_reporter_start_seconds", "Time to start the crash reporter or hand it the dump."},
+};
+
+QString statsFilePath(const QString &dirPath)
+{
+    return dirPath + QStringLiteral("/qbreakpad.stats");
+}
+
+int bucketIndex(qint64 microseconds)
+{
+    int index = 0;
+    while ((index != (CrashStats::kBucketCount - 1))
+           && (microseconds > CrashStats::bucketBound(index))) {
+        ++index;
+    }
+    return index;
+}
+
+void appendMetricHeader(QByteArray &text, const MetricInfo &info, const char *type)
+{
+    text += "# HELP ";
+    text += info.name;
+    text += ' ';
+    text += info.help;
+    text += "\n# TYPE ";
+    text += info.name;
+    text += ' ';
+    text += type;
+    text += '\n';
+}
+
+void appendSample(QByteArray &text, const char *name, const char *suffix, const QByteArray &value)
+{
+    text += name;
+    text += suffix;
+    text += ' ';
+    text += value;
+    text += '\n';
+}
+
+} // namespace
+
+struct CrashStats::Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 size;
+    quint32 reserved;
+};
+
+struct CrashStats::Block
+{
+    Header header;
+    quint64 counters[CounterCount];
+    CrashStatsHistogram histograms[HistogramCount];
+};
+
+CrashStats::~CrashStats()
+{
+    if (Block *block = m_block.load()) {
+        munmap(block, sizeof(Block));
+    }
+}
+
+bool CrashStats::open(const QString &dirPath)
+{
+    const QMutexLocker locker(&m_mutex);
+    if (isOpen()) {
+        return true;
+    }
+    const QString filePath = statsFilePath(dirPath);
+    const QByteArray path = QFile::encodeName(filePath);
+    const int fd = ::open(path.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        qWarning().noquote() << "Failed to open the crash statistics" << filePath;
+        return false;
+    }
+    // Whoever finds the file empty writes the header; the others wait for it.
+    flock(fd, LOCK_EX);
+    bool ok = true;
+    struct stat st = {};
+    if ((fstat(fd, &st) == 0) && (st.st_size == 0)) {
+        const Header header = {kStatsMagic, kStatsVersion, sizeof(Block), 0};
+        ok = (ftruncate(fd, off_t(sizeof(Block))) == 0)
+             && (pwrite(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)));
+    }
+    Header header = {};
+    ok = ok && (pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)))
+         && (header.magic == kStatsMagic) && (header.version == kStatsVersion)
+         && (header.size == sizeof(Block));
+    void *memory = ok ? mmap(nullptr, sizeof(Block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                      : MAP_FAILED;
+    flock(fd, LOCK_UN);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        // A file of another version is left alone, its readers may still need it.
+        qWarning().noquote() << "Failed to map the crash statistics" << filePath;
+        return false;
+    }
+    m_block.store(static_cast<Block *>(memory), std::memory_order_release);
+    return true;
+}
+
+void CrashStats::add(Counter counter, quint64 value)
+{
+    Block *block = m_block.load(std::memory_order_acquire);
+    if (block && (value != 0)) {
+        __atomic_fetch_add(&block->counters[counter], value, __ATOMIC_RELAXED);
+    }
+}
+
+void CrashStats::record(Histogram histogram, qint64 startTime)
+{
+    Block *block = m_block.load(std::memory_order_acquire);
+    if (!block || (startTime == 0)) {
+        return;
+    }
+    const qint64 microseconds = std::max<qint64>(0, (now() - startTime) / 1000);
+    CrashStatsHistogram &samples = block->histograms[histogram];
+    __atomic_fetch_add(&samples.buckets[bucketIndex(microseconds)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&samples.sumMicroseconds, quint64(microseconds), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&samples.count, 1, __ATOMIC_RELAXED);
+}
+
+qint64 CrashStats::now()
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (qint64(ts.tv_sec) * 1000000000) + ts.tv_nsec;
+}
+
+qint64 CrashStats::bucketBound(int index)
+{
+    if ((index < 0) || (index >= (kBucketCount - 1))) {
+        return -1;
+    }
+    return kFirstBucketBound << index;
+}
+
+bool CrashStats::read(CrashStatsData *data) const
+{
+    const Block *block = m_block.load(std::memory_order_acquire);
+    if (!block) {
+        return false;
+    }
+    copy(block, data);
+    return true;
+}
+
+bool CrashStats::read(const QString &dirPath, CrashStatsData *data)
+{
+    const QByteArray path = QFile::encodeName(statsFilePath(dirPath));
+    const int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st = {};
+    void *memory = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (size_t(st.st_size) >= sizeof(Block))) {
+        memory = mmap(nullptr, sizeof(Block), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    const auto block = static_cast<const Block *>(memory);
+    const bool ok = (block->header.magic == kStatsMagic) && (block->header.version == kStatsVersion)
+                    && (block->header.size == sizeof(Block));
+    if (ok) {
+        copy(block, data);
+    }
+    munmap(memory, sizeof(Block));
+    return ok;
+}
+
+void CrashStats::copy(const Block *block, CrashStatsData *data)
+{
+    for (int i = 0; i != CounterCount; ++i) {
+        data->counters[i] = __atomic_load_n(&block->counters[i], __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i != HistogramCount; ++i) {
+        const CrashStatsHistogram &samples = block->histograms[i];
+        for (int j = 0; j != kBucketCount; ++j) {
+            data->histograms[i].buckets[j] = __atomic_load_n(&samples.buckets[j], __ATOMIC_RELAXED);
+        }
+        data->histograms[i].count = __atomic_load_n(&samples.count, __ATOMIC_RELAXED);
+        data->histograms[i].sumMicroseconds = __atomic_load_n(&samples.sumMicroseconds,
+                                                              __ATOMIC_RELAXED);
+    }
+}
+
+bool CrashStats::writeTextFile(const QString &filePath, const CrashStatsData &data)
+{
+    QByteArray text = {};
+    for (int i = 0; i != CounterCount; ++i) {
+        appendMetricHeader(text, kCounterInfo[i], "counter");
+        appendSample(text, kCounterInfo[i].name, "", QByteArray::number(data.counters[i]));
+    }
+    for (int i = 0; i != HistogramCount; ++i) {
+        const MetricInfo &info = kHistogramInfo[i];
+        const CrashStatsHistogram &samples = data.histograms[i];
+        appendMetricHeader(text, info, "histogram");
+        // Prometheus buckets count every sample up to their bound.
+        quint64 cumulative = 0;
+        for (int j = 0; j != kBucketCount; ++j) {
+            cumulative += samples.buckets[j];
+            const qint64 bound = bucketBound(j);
+            text += info.name;
+            text += "_bucket{le=\"";
+            text += (bound < 0) ? QByteArray("+Inf") : QByteArray::number(double(bound) / 1e6);
+            text += "\"} ";
+            text += QByteArray::number(cumulative);
+            text += '\n';
+        }
+        appendSample(text,
+                     info.name,
+                     "_sum",
+                     QByteArray::number(double(samples.sumMicroseconds) / 1e6, 'f', 6));
+        appendSample(text, info.name, "_count", QByteArray::number(samples.count));
+    }
+    // Renamed into place, the collector never reads half a file.
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(text);
+    return file.commit();
+}
+
+} // namespace qbreakpad
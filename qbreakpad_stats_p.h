@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+namespace qbreakpad {
+
+struct CrashStatsData;
+
+// Counters and latency histograms of the crash handler, kept as qbreakpad.stats next
+// to the dumps and shared by every process that uses the directory. The file is
+// mapped into memory and only ever changed with atomic adds, so the crash path can
+// count its own dump and the numbers survive the process that crashed: they are
+// read back from the file, never from the process.
+class CrashStats
+{
+public:
+    enum Counter : int {
+        DumpsWritten,
+        DumpsFailed,
+        DuplicateCrashes,
+        BytesWritten,
+        ReporterLaunches,
+        ReporterLaunchFailures,
+        ReporterNotifications,
+        CounterCount
+    };
+    enum Histogram : int { DumpWriteTime, ReporterStartTime, HistogramCount };
+
+    // Bucket i holds the samples up to bucketBound(i) microseconds that did not fit
+    // bucket i - 1; the bounds double from 250us, the last bucket has none.
+    static constexpr int kBucketCount = 16;
+
+    ~CrashStats();
+
+    bool open(const QString &dirPath);
+    bool isOpen() const { return m_block.load(std::memory_order_acquire) != nullptr; }
+
+    // Async-signal-safe, like now(). Nothing is counted before open(). record()
+    // takes the time the sample started at, as returned by now(); 0 records nothing.
+    void add(Counter counter, quint64 value = 1);
+    void record(Histogram histogram, qint64 startTime);
+    // CLOCK_MONOTONIC, in nanoseconds.
+    static qint64 now();
+
+    // -1 for the last bucket.
+    static qint64 bucketBound(int index);
+
+    // The numbers in the file this one opened.
+    bool read(CrashStatsData *data) const;
+    // The numbers in qbreakpad.stats of dirPath. Needs no CrashStats of its own and
+    // never writes.
+    static bool read(const QString &dirPath, CrashStatsData *data);
+    // Replaces filePath with data in the Prometheus text format, for the textfile
+    // collector of node_exporter.
+    static bool writeTextFile(const QString &filePath, const CrashStatsData &data);
+
+private:
+    struct Header;
+    struct Block;
+
+    static void copy(const Block *block, CrashStatsData *data);
+
+    QMutex m_mutex;
+    std::atomic<Block *> m_block = nullptr;
+};
+
+struct CrashStatsHistogram
+{
+    quint64 buckets[CrashStats::kBucketCount] = {};
+    quint64 count = 0;
+    quint64 sumMicroseconds = 0;
+};
+
+struct CrashStatsData
+{
+    quint64 counters[CrashStats::CounterCount] = {};
+    CrashStatsHistogram histograms[CrashStats::HistogramCount] = {};
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,173 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_streams_p.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace qbreakpad {
+
+namespace {
+
+constexpr quint32 kMinidumpSignature = 0x504d444d; // "MDMP"
+// MDRawHeader: signature, version, stream_count, stream_directory_rva, checksum,
+// time_date_stamp, flags.
+constexpr off_t kStreamCountOffset = 8;
+constexpr quint64 kMaxRva = 0xffffffffULL;
+
+bool readFully(int fd, void *data, size_t size, off_t offset)
+{
+    auto bytes = static_cast<char *>(data);
+    while (size > 0) {
+        const ssize_t done = pread(fd, bytes, size, offset);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        bytes += done;
+        size -= size_t(done);
+        offset += done;
+    }
+    return true;
+}
+
+bool writeFully(int fd, const void *data, size_t size, off_t offset)
+{
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        const ssize_t done = pwrite(fd, bytes, size, offset);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        bytes += done;
+        size -= size_t(done);
+        offset += done;
+    }
+    return true;
+}
+
+quint64 alignUp(quint64 value)
+{
+    return (value + 7) & ~quint64(7);
+}
+
+} // namespace
+
+bool MinidumpStreamAppender::open(int fd)
+{
+    quint32 header[4] = {};
+    if (!readFully(fd, header, sizeof(header), 0) || (header[0] != kMinidumpSignature)
+        || (header[2] > kMaxStreams)) {
+        return false;
+    }
+    m_streamCount = header[2];
+    if (!readFully(fd, m_directory, sizeof(Directory) * m_streamCount, off_t(header[3]))) {
+        return false;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    m_fd = fd;
+    m_end = alignUp(quint64(st.st_size));
+    m_buffered = 0;
+    m_failed = false;
+    return true;
+}
+
+bool MinidumpStreamAppender::beginStream(quint32 type)
+{
+    if ((m_fd == -1) || m_failed || (m_streamCount == kMaxStreams)) {
+        return false;
+    }
+    m_streamType = type;
+    m_streamStart = m_end;
+    return true;
+}
+
+bool MinidumpStreamAppender::write(const void *data, size_t size)
+{
+    if (m_failed || ((m_end + m_buffered + size) > kMaxRva)) {
+        m_failed = true;
+        return false;
+    }
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        if ((m_buffered == kBufferSize) && !flush()) {
+            return false;
+        }
+        const size_t chunk = qMin(size, kBufferSize - m_buffered);
+        memcpy(m_buffer + m_buffered, bytes, chunk);
+        m_buffered += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool MinidumpStreamAppender::flush()
+{
+    if (!writeFully(m_fd, m_buffer, m_buffered, off_t(m_end))) {
+        m_failed = true;
+        return false;
+    }
+    m_end += m_buffered;
+    m_buffered = 0;
+    return true;
+}
+
+void MinidumpStreamAppender::endStream()
+{
+    if (m_failed || !flush()) {
+        return;
+    }
+    m_directory[m_streamCount++] = {m_streamType,
+                                    {quint32(m_end - m_streamStart), quint32(m_streamStart)}};
+    m_end = alignUp(m_end);
+}
+
+bool MinidumpStreamAppender::finish()
+{
+    if ((m_fd == -1) || m_failed) {
+        return false;
+    }
+    const quint64 directoryRva = m_end;
+    const size_t directorySize = sizeof(Directory) * m_streamCount;
+    if (((directoryRva + directorySize) > kMaxRva)
+        || !writeFully(m_fd, m_directory, directorySize, off_t(directoryRva))) {
+        return false;
+    }
+    const quint32 header[2] = {m_streamCount, quint32(directoryRva)};
+    return writeFully(m_fd, header, sizeof(header), kStreamCountOffset);
+}
+
+} // namespace qbreakpad
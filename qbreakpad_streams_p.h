@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+#include <cstddef>
+
+namespace qbreakpad {
+
+// Stream types of the data QBreakpad adds to minidumps, in the user range that
+// Breakpad and Crashpad leave free ("QB" followed by a number).
+constexpr quint32 kBreadcrumbStreamType = 0x51425001;
+constexpr quint32 kLogTailStreamType = 0x51425002;
+constexpr quint32 kAnnotationStreamType = 0x51425003;
+
+// Appends streams to a finished minidump. The data of the new streams goes to the
+// end of the file, followed by a copy of the stream directory that includes them;
+// the header is pointed at the new directory last, so a dump is never left
+// unreadable. Stream data is collected in a fixed buffer and written with
+// pwrite(), so the fd's file offset does not matter. Async-signal-safe.
+class MinidumpStreamAppender
+{
+public:
+    bool open(int fd);
+
+    bool beginStream(quint32 type);
+    bool write(const void *data, size_t size);
+    void endStream();
+
+    bool finish();
+
+private:
+    bool flush();
+
+    struct Location
+    {
+        quint32 dataSize;
+        quint32 rva;
+    };
+
+    struct Directory
+    {
+        quint32 streamType;
+        Location location;
+    };
+
+    static constexpr quint32 kMaxStreams = 64;
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    int m_fd = -1;
+    quint32 m_streamCount = 0;
+    Directory m_directory[kMaxStreams] = {};
+    quint64 m_end = 0;
+    quint64 m_streamStart = 0;
+    quint32 m_streamType = 0;
+    bool m_failed = false;
+    char m_buffer[kBufferSize] = {};
+    size_t m_buffered = 0;
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,553 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_uploader_p.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QIODevice>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QTimer>
+#include <QUuid>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+#ifdef Q_OS_LINUX
+#include "qbreakpad_index_p.h"
+#endif
+
+namespace qbreakpad {
+
+namespace {
+
+constexpr qint64 kMaxBatchBytes = 32 * 1024 * 1024;
+constexpr qint64 kMaxRetryDelay = 6 * 60 * 60 * 1000;
+constexpr int kTransferTimeout = 2 * 60 * 1000;
+// Throttled bodies wait until at least this much may be sent, not for every byte.
+constexpr qint64 kMinThrottledChunk = 16 * 1024;
+
+// One second worth of burst, shared by every request body of an uploader.
+class TokenBucket
+{
+public:
+    // Called on every sync; only a new rate starts over with a full bucket, the
+    // same rate keeps what has accrued so far.
+    void setRate(qint64 bytesPerSecond)
+    {
+        if (m_clock.isValid() && (m_rate == bytesPerSecond)) {
+            return;
+        }
+        m_rate = bytesPerSecond;
+        m_tokens = double(m_rate);
+        m_clock.start();
+    }
+
+    qint64 take(qint64 wanted)
+    {
+        if (m_rate <= 0) {
+            return wanted;
+        }
+        m_tokens = std::min(double(m_rate), m_tokens + (m_clock.nsecsElapsed() * 1e-9 * m_rate));
+        m_clock.restart();
+        const qint64 granted = std::min(wanted, qint64(m_tokens));
+        m_tokens -= double(granted);
+        return granted;
+    }
+
+    int msecsUntilAvailable() const
+    {
+        const double missing = double(std::min(m_rate, kMinThrottledChunk)) - m_tokens;
+        return std::max(1, int((missing * 1000) / double(m_rate)));
+    }
+
+private:
+    qint64 m_rate = 0;
+    double m_tokens = 0;
+    QElapsedTimer m_clock;
+};
+
+// A multipart/form-data body that streams the dump files from disk instead of
+// loading them into memory, and only hands out as many bytes as the token bucket
+// allows. Returning 0 makes QNetworkAccessManager wait for readyRead().
+class MultipartBody : public QIODevice
+{
+public:
+    explicit MultipartBody(const QByteArray &boundary,
+                           const QStringList &filePaths,
+                           TokenBucket *bucket,
+                           QObject *parent = nullptr)
+        : QIODevice(parent)
+        , m_bucket(bucket)
+    {
+        for (const QString &filePath : filePaths) {
+            const QFileInfo fileInfo(filePath);
+            appendData("--" + boundary + "\r\nContent-Disposition: form-data; "
+                       "name=\"upload_file_minidump\"; filename=\""
+                       + QFile::encodeName(fileInfo.fileName())
+                       + "\"\r\nContent-Type: application/octet-stream\r\n\r\n");
+            m_segments.append({QByteArray(), filePath, fileInfo.size()});
+            m_size += fileInfo.size();
+            appendData("\r\n");
+        }
+        appendData("--" + boundary + "--\r\n");
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 size() const override { return m_size; }
+    bool atEnd() const override { return m_position >= m_size; }
+    qint64 bytesAvailable() const override
+    {
+        return (m_size - m_position) + QIODevice::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        if (m_position >= m_size) {
+            return -1;
+        }
+        const qint64 budget = m_bucket->take(std::min(maxSize, m_size - m_position));
+        if (budget == 0) {
+            if (!m_wakeScheduled) {
+                m_wakeScheduled = true;
+                QTimer::singleShot(m_bucket->msecsUntilAvailable(), this, [this]() {
+                    m_wakeScheduled = false;
+                    emit readyRead();
+                });
+            }
+            return 0;
+        }
+        qint64 done = 0;
+        while (done < budget) {
+            const Segment &segment = m_segments.at(m_segment);
+            const qint64 chunk = std::min(budget - done, segment.size - m_segmentOffset);
+            if (segment.filePath.isEmpty()) {
+                memcpy(data + done, segment.data.constData() + m_segmentOffset, size_t(chunk));
+            } else {
+                if (!m_file.isOpen()) {
+                    m_file.setFileName(segment.filePath);
+                    if (!m_file.open(QIODevice::ReadOnly)) {
+                        setErrorString(m_file.errorString());
+                        return -1;
+                    }
+                }
+                if (m_file.read(data + done, chunk) != chunk) {
+                    setErrorString(QStringLiteral("%1 changed while it was uploaded.")
+                                       .arg(segment.filePath));
+                    return -1;
+                }
+            }
+            done += chunk;
+            m_segmentOffset += chunk;
+            if (m_segmentOffset == segment.size) {
+                m_file.close();
+                ++m_segment;
+                m_segmentOffset = 0;
+            }
+        }
+        m_position += done;
+        return done;
+    }
+
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        Q_UNUSED(data)
+        Q_UNUSED(size)
+        return -1;
+    }
+
+private:
+    struct Segment
+    {
+        QByteArray data = {};
+        QString filePath = {};
+        qint64 size = 0;
+    };
+
+    void appendData(const QByteArray &data)
+    {
+        m_segments.append({data, QString(), data.size()});
+        m_size += data.size();
+    }
+
+    TokenBucket *m_bucket = nullptr;
+    QList<Segment> m_segments = {};
+    int m_segment = 0;
+    qint64 m_segmentOffset = 0;
+    QFile m_file;
+    qint64 m_size = 0;
+    qint64 m_position = 0;
+    bool m_wakeScheduled = false;
+};
+
+} // namespace
+
+class DumpUploader::Worker : public QObject
+{
+public:
+    explicit Worker(DumpUploader *uploader)
+        : m_uploader(uploader)
+    {
+        m_timer.setSingleShot(true);
+        connect(&m_timer, &QTimer::timeout, this, [this]() { schedule(); });
+    }
+
+    ~Worker() override
+    {
+        // Replies still running are aborted by the network manager, and their
+        // finished() must not reach a half destroyed worker.
+        for (QNetworkReply *reply : std::as_const(m_replies)) {
+            reply->disconnect(this);
+        }
+    }
+
+    void start()
+    {
+#ifdef Q_OS_LINUX
+        m_index.open(m_uploader->m_dirPath);
+#endif
+        takePendingFiles();
+        scanDirectory();
+        loadState();
+        // Processes that crashed together start again together, spread them out.
+        m_notBefore = QDateTime::currentMSecsSinceEpoch()
+                      + QRandomGenerator::global()->bounded(std::max(1, m_policy.retryDelay));
+        schedule();
+    }
+
+    void sync()
+    {
+        takePendingFiles();
+        schedule();
+    }
+
+private:
+    void takePendingFiles()
+    {
+        m_uploader->m_mutex.lock();
+        m_policy = m_uploader->m_policy;
+        const QStringList pendingFiles = m_uploader->m_pendingFiles;
+        m_uploader->m_pendingFiles.clear();
+        m_uploader->m_mutex.unlock();
+        m_bucket.setRate(m_policy.bandwidthLimit);
+        for (const QString &filePath : pendingFiles) {
+            indexFile(filePath);
+        }
+    }
+
+    enum class State { Pending, Uploaded, Failed };
+
+    struct Entry
+    {
+        QString filePath = {};
+        qint64 modified = 0;
+        qint64 size = 0;
+        State state = State::Pending;
+        int attempts = 0;
+        qint64 nextAttempt = 0;
+        bool uploading = false;
+    };
+
+    QString stateFilePath() const
+    {
+        return m_uploader->m_dirPath + QStringLiteral("/qbreakpad.uploads");
+    }
+
+    void scanDirectory()
+    {
+        const QDir dir(m_uploader->m_dirPath);
+        const QStringList fileNames = dir.entryList(m_uploader->m_nameFilters,
+                                                    QDir::Files | QDir::NoDotAndDotDot);
+        for (const QString &fileName : fileNames) {
+            indexFile(dir.absoluteFilePath(fileName));
+        }
+    }
+
+    void indexFile(const QString &filePath)
+    {
+        const QFileInfo fileInfo(filePath);
+        if (m_entries.contains(fileInfo.fileName()) || !fileInfo.isFile()) {
+            return;
+        }
+        Entry entry = {};
+        entry.filePath = fileInfo.absoluteFilePath();
+        entry.modified = fileInfo.lastModified().toMSecsSinceEpoch();
+        entry.size = fileInfo.size();
+        m_entries.insert(fileInfo.fileName(), entry);
+    }
+
+    // One "state attempts next-attempt file-name" line per dump that is not
+    // simply pending. Lines of dumps that are gone are dropped on the next save.
+    void loadState()
+    {
+        QFile file(stateFilePath());
+        if (!file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        while (!file.atEnd()) {
+            const QList<QByteArray> fields = file.readLine().trimmed().split('\t');
+            if (fields.size() != 4) {
+                continue;
+            }
+            const auto it = m_entries.find(QFile::decodeName(fields.at(3)));
+            if (it == m_entries.end()) {
+                continue;
+            }
+            if (fields.at(0) == "uploaded") {
+                it->state = State::Uploaded;
+            } else if (fields.at(0) == "failed") {
+                it->state = State::Failed;
+            }
+            it->attempts = fields.at(1).toInt();
+            it->nextAttempt = fields.at(2).toLongLong();
+        }
+    }
+
+    void saveState()
+    {
+        QSaveFile file(stateFilePath());
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning().noquote() << "Failed to save the upload state" << stateFilePath();
+            return;
+        }
+        for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) {
+            if ((it->state == State::Pending) && (it->attempts == 0)) {
+                continue;
+            }
+            const QByteArray state = (it->state == State::Uploaded)
+                                         ? "uploaded"
+                                         : ((it->state == State::Failed) ? "failed" : "pending");
+            file.write(state + '\t' + QByteArray::number(it->attempts) + '\t'
+                       + QByteArray::number(it->nextAttempt) + '\t' + QFile::encodeName(it.key())
+                       + '\n');
+        }
+        if (!file.commit()) {
+            qWarning().noquote() << "Failed to save the upload state" << stateFilePath();
+        }
+    }
+
+    void schedule()
+    {
+        if (m_policy.url.isEmpty()) {
+            return;
+        }
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if (now < m_notBefore) {
+            m_timer.start(int(m_notBefore - now));
+            return;
+        }
+        while (m_replies.size() < std::max(1, m_policy.concurrency)) {
+            QList<QString> ready = {};
+            for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) {
+                if ((it->state == State::Pending) && !it->uploading && (it->nextAttempt <= now)) {
+                    ready.append(it.key());
+                }
+            }
+            if (ready.isEmpty()) {
+                break;
+            }
+            std::sort(ready.begin(), ready.end(), [this](const QString &lhs, const QString &rhs) {
+                return m_entries.value(lhs).modified < m_entries.value(rhs).modified;
+            });
+            QStringList batch = {};
+            qint64 batchBytes = 0;
+            for (const QString &fileName : std::as_const(ready)) {
+                const qint64 size = m_entries.value(fileName).size;
+                if ((batch.size() >= std::max(1, m_policy.batchSize))
+                    || (!batch.isEmpty() && ((batchBytes + size) > kMaxBatchBytes))) {
+                    break;
+                }
+                batch.append(fileName);
+                batchBytes += size;
+            }
+            upload(batch);
+        }
+        qint64 nextAttempt = LLONG_MAX;
+        for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) {
+            if ((it->state == State::Pending) && !it->uploading && (it->nextAttempt > now)) {
+                nextAttempt = std::min(nextAttempt, it->nextAttempt);
+            }
+        }
+        if (nextAttempt != LLONG_MAX) {
+            m_timer.start(int(std::min(nextAttempt - now, kMaxRetryDelay)));
+        }
+    }
+
+    void upload(const QStringList &fileNames)
+    {
+        QStringList filePaths = {};
+        for (const QString &fileName : fileNames) {
+            Entry &entry = m_entries[fileName];
+            if (!QFileInfo::exists(entry.filePath)) {
+                // Removed by the retention policy, or by the application.
+                m_entries.remove(fileName);
+                continue;
+            }
+            entry.uploading = true;
+            filePaths.append(entry.filePath);
+        }
+        if (filePaths.isEmpty()) {
+            return;
+        }
+        const QByteArray boundary = "qbreakpad-"
+                                    + QUuid::createUuid().toString(QUuid::Id128).toLatin1();
+        auto body = new MultipartBody(boundary, filePaths, &m_bucket);
+        body->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        QNetworkRequest request(m_policy.url);
+        request.setHeader(QNetworkRequest::ContentTypeHeader,
+                          QByteArray("multipart/form-data; boundary=") + boundary);
+        request.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 15, 0))
+        request.setTransferTimeout(kTransferTimeout);
+#endif
+        QNetworkReply *reply = m_network.post(request, body);
+        body->setParent(reply);
+        m_replies.append(reply);
+        connect(reply, &QNetworkReply::finished, this, [this, reply, fileNames]() {
+            finishUpload(reply, fileNames);
+        });
+    }
+
+    void finishUpload(QNetworkReply *reply, const QStringList &fileNames)
+    {
+        m_replies.removeAll(reply);
+        reply->deleteLater();
+        const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        const bool uploaded = (reply->error() == QNetworkReply::NoError) && (status >= 200)
+                              && (status < 300);
+        // Anything but a client error may go away by itself.
+        const bool retryable = (status == 0) || (status == 408) || (status == 429)
+                               || (status >= 500);
+        const qint64 retryAfter = reply->rawHeader("Retry-After").toLongLong() * 1000;
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (const QString &fileName : fileNames) {
+            const auto it = m_entries.find(fileName);
+            if (it == m_entries.end()) {
+                continue;
+            }
+            it->uploading = false;
+            if (uploaded) {
+                it->state = State::Uploaded;
+#ifdef Q_OS_LINUX
+                m_index.setUploadState(fileName, DumpIndex::Uploaded);
+#endif
+                continue;
+            }
+            ++it->attempts;
+            if (!retryable || (it->attempts >= m_policy.maxAttempts)) {
+                it->state = State::Failed;
+#ifdef Q_OS_LINUX
+                m_index.setUploadState(fileName, DumpIndex::UploadFailed);
+#endif
+                qWarning().noquote() << "Giving up uploading" << it->filePath << ":"
+                                     << reply->errorString();
+            } else {
+                it->nextAttempt = now + std::max(retryAfter, retryDelay(it->attempts));
+            }
+        }
+        saveState();
+        schedule();
+    }
+
+    qint64 retryDelay(int attempts) const
+    {
+        const qint64 delay = std::min(kMaxRetryDelay,
+                                      qint64(std::max(1, m_policy.retryDelay))
+                                          << std::min(attempts - 1, 20));
+        return (delay / 2) + qint64(QRandomGenerator::global()->bounded(int(delay / 2) + 1));
+    }
+
+    DumpUploader *const m_uploader;
+    UploadPolicy m_policy = {};
+    QNetworkAccessManager m_network;
+    QTimer m_timer;
+    TokenBucket m_bucket;
+    QHash<QString, Entry> m_entries = {};
+    QList<QNetworkReply *> m_replies = {};
+    qint64 m_notBefore = 0;
+#ifdef Q_OS_LINUX
+    DumpIndex m_index;
+#endif
+};
+
+DumpUploader::DumpUploader(const QString &dirPath, const QStringList &nameFilters)
+    : m_dirPath(dirPath)
+    , m_nameFilters(nameFilters)
+{
+    setObjectName(QStringLiteral("QBreakpad dump uploader"));
+}
+
+DumpUploader::~DumpUploader()
+{
+    quit();
+    wait();
+}
+
+void DumpUploader::setPolicy(const UploadPolicy &policy)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_policy = policy;
+    notifyWorker();
+}
+
+void DumpUploader::addDump(const QString &filePath)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_pendingFiles.append(filePath);
+    notifyWorker();
+}
+
+void DumpUploader::notifyWorker()
+{
+    if (m_worker) {
+        Worker *worker = m_worker;
+        QMetaObject::invokeMethod(worker, [worker]() { worker->sync(); }, Qt::QueuedConnection);
+    }
+}
+
+void DumpUploader::run()
+{
+    Worker worker(this);
+    m_mutex.lock();
+    m_worker = &worker;
+    m_mutex.unlock();
+    worker.start();
+    exec();
+    m_mutex.lock();
+    m_worker = nullptr;
+    m_mutex.unlock();
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QUrl>
+
+namespace qbreakpad {
+
+struct UploadPolicy
+{
+    QUrl url = {};
+    int batchSize = 4;
+    int concurrency = 2;
+    // Bytes per second over all uploads together, 0 is unlimited.
+    qint64 bandwidthLimit = 0;
+    // Milliseconds. Doubled for every failed attempt, with random jitter so that a
+    // fleet which crashed at the same time does not retry in lockstep.
+    int retryDelay = 30 * 1000;
+    int maxAttempts = 8;
+};
+
+// Uploads the dumps of a directory as multipart/form-data POST requests, several
+// dumps per request. What has been uploaded, and when a failed dump may be tried
+// again, is kept in a state file next to the dumps, so an upload that was cut
+// short by the process exiting is picked up again by the next start. The network
+// work runs on the worker thread's own event loop; setPolicy() and addDump() may
+// be called from any thread.
+class DumpUploader : public QThread
+{
+public:
+    explicit DumpUploader(const QString &dirPath, const QStringList &nameFilters);
+    ~DumpUploader() override;
+
+    void setPolicy(const UploadPolicy &policy);
+    void addDump(const QString &filePath);
+
+protected:
+    void run() override;
+
+private:
+    class Worker;
+
+    void notifyWorker();
+
+    const QString m_dirPath;
+    const QStringList m_nameFilters;
+
+    QMutex m_mutex;
+    UploadPolicy m_policy = {};
+    QStringList m_pendingFiles = {};
+    Worker *m_worker = nullptr;
+};
+
+} // namespace qbreakpad
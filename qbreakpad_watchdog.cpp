@@ -0,0 +1,265 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "qbreakpad_watchdog_p.h"
+
+#include "qbreakpad_annotations_p.h"
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMetaObject>
+#include <algorithm>
+#include <utility>
+
+namespace qbreakpad {
+
+namespace {
+
+// Runs in the monitored thread.
+void detachHeartbeat(QObject *anchor, Heartbeat *heartbeat)
+{
+    heartbeat->mutex.lock();
+    heartbeat->dispatcher = nullptr;
+    heartbeat->mutex.unlock();
+    anchor->deleteLater();
+}
+
+// The connections are made and dropped by an anchor object that lives in the
+// monitored thread, so they never go away while the thread is inside one of them.
+// The anchor goes with the event loop, or on the first pass after an unwatch.
+void attachHeartbeat(QThread *thread, const std::shared_ptr<Heartbeat> &heartbeat)
+{
+    const auto anchor = new QObject;
+    anchor->moveToThread(thread);
+    QMetaObject::invokeMethod(
+        anchor,
+        [anchor, heartbeat]() {
+            QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+            if (!dispatcher || !heartbeat->watched.load(std::memory_order_relaxed)) {
+                anchor->deleteLater();
+                return;
+            }
+            QObject::connect(
+                dispatcher,
+                &QAbstractEventDispatcher::awake,
+                anchor,
+                [anchor, heartbeat]() {
+                    const quint64 beats = heartbeat->beats.load(std::memory_order_relaxed);
+                    heartbeat->beats.store(beats + 1, std::memory_order_relaxed);
+                    if (!heartbeat->watched.load(std::memory_order_relaxed)) {
+                        detachHeartbeat(anchor, heartbeat.get());
+                    }
+                },
+                Qt::DirectConnection);
+            // Emitted before the thread drops its dispatcher.
+            QObject::connect(
+                QThread::currentThread(),
+                &QThread::finished,
+                anchor,
+                [anchor, heartbeat]() { detachHeartbeat(anchor, heartbeat.get()); },
+                Qt::DirectConnection);
+            // The main thread never emits finished(), and ~QCoreApplication() deletes
+            // its dispatcher. Its loop is over once aboutToQuit() is; what runs after
+            // exec() is shutdown, not a hang.
+            const QCoreApplication *app = QCoreApplication::instance();
+            if (app && (app->thread() == QThread::currentThread())) {
+                QObject::connect(
+                    app,
+                    &QCoreApplication::aboutToQuit,
+                    anchor,
+                    [anchor, heartbeat]() {
+                        heartbeat->watched.store(false, std::memory_order_relaxed);
+                        detachHeartbeat(anchor, heartbeat.get());
+                    },
+                    Qt::DirectConnection);
+            }
+            // For a dispatcher that goes away some other way.
+            QObject::connect(
+                dispatcher,
+                &QObject::destroyed,
+                anchor,
+                [anchor, heartbeat]() { detachHeartbeat(anchor, heartbeat.get()); },
+                Qt::DirectConnection);
+            heartbeat->mutex.lock();
+            heartbeat->dispatcher = dispatcher;
+            heartbeat->mutex.unlock();
+        },
+        Qt::QueuedConnection);
+}
+
+// Returns false when the thread has no event loop to wake.
+bool wakeUp(Heartbeat *heartbeat)
+{
+    const QMutexLocker locker(&heartbeat->mutex);
+    if (!heartbeat->dispatcher) {
+        return false;
+    }
+    heartbeat->dispatcher->wakeUp();
+    return true;
+}
+
+} // namespace
+
+HangWatchdog::HangWatchdog(const WriteFunction &write)
+    : m_write(write)
+{
+    setObjectName(QStringLiteral("QBreakpad hang watchdog"));
+}
+
+HangWatchdog::~HangWatchdog()
+{
+    m_mutex.lock();
+    m_stopRequested = true;
+    for (const Watch &watch : std::as_const(m_watches)) {
+        watch.heartbeat->watched.store(false, std::memory_order_relaxed);
+    }
+    m_condition.wakeAll();
+    m_mutex.unlock();
+    wait();
+}
+
+void HangWatchdog::watch(QThread *thread, int threshold)
+{
+    const QMutexLocker locker(&m_mutex);
+    for (int i = 0; i != m_watches.size(); ++i) {
+        if (m_watches.at(i).thread == thread) {
+            m_watches.at(i).heartbeat->watched.store(false, std::memory_order_relaxed);
+            wakeUp(m_watches.at(i).heartbeat.get());
+            m_watches.removeAt(i);
+            break;
+        }
+    }
+    Watch watch = {};
+    watch.thread = thread;
+    watch.name = thread->objectName();
+    if (watch.name.isEmpty()) {
+        watch.name = QStringLiteral("0x") + QString::number(quintptr(thread), 16);
+    }
+    watch.threshold = threshold;
+    watch.heartbeat = std::make_shared<Heartbeat>();
+    attachHeartbeat(thread, watch.heartbeat);
+    m_watches.append(watch);
+    m_condition.wakeAll();
+}
+
+void HangWatchdog::unwatch(QThread *thread)
+{
+    const QMutexLocker locker(&m_mutex);
+    for (int i = 0; i != m_watches.size(); ++i) {
+        if (m_watches.at(i).thread == thread) {
+            m_watches.at(i).heartbeat->watched.store(false, std::memory_order_relaxed);
+            // So the anchor goes now rather than on the next event.
+            wakeUp(m_watches.at(i).heartbeat.get());
+            m_watches.removeAt(i);
+            return;
+        }
+    }
+}
+
+void HangWatchdog::setDumpInterval(int value)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_dumpInterval = value;
+}
+
+void HangWatchdog::run()
+{
+    m_mutex.lock();
+    while (!m_stopRequested) {
+        if (m_watches.isEmpty()) {
+            m_condition.wait(&m_mutex);
+            continue;
+        }
+        m_condition.wait(&m_mutex, (unsigned long)checkInterval());
+        const int index = m_stopRequested ? -1 : findStall();
+        if (index == -1) {
+            continue;
+        }
+        const QString name = m_watches.at(index).name;
+        const qint64 stalled = m_watches.at(index).stalledSince.elapsed();
+        m_mutex.unlock();
+        writeHangDump(name, stalled);
+        m_mutex.lock();
+    }
+    m_mutex.unlock();
+}
+
+// Called with m_mutex held. A stall is noticed at most one interval late.
+int HangWatchdog::checkInterval() const
+{
+    int threshold = m_watches.first().threshold;
+    for (const Watch &watch : m_watches) {
+        threshold = std::min(threshold, watch.threshold);
+    }
+    return std::max(10, threshold / 4);
+}
+
+// Called with m_mutex held. Returns the index of a thread to dump, or -1.
+int HangWatchdog::findStall()
+{
+    for (int i = 0; i != m_watches.size(); ++i) {
+        Watch &watch = m_watches[i];
+        const quint64 beats = watch.heartbeat->beats.load(std::memory_order_relaxed);
+        if (beats != watch.beats) {
+            watch.beats = beats;
+            watch.stalledSince.invalidate();
+            watch.dumped = false;
+            continue;
+        }
+        if (!wakeUp(watch.heartbeat.get())) {
+            // Not started yet, or finished.
+            watch.stalledSince.invalidate();
+            continue;
+        }
+        if (!watch.stalledSince.isValid()) {
+            watch.stalledSince.start();
+            continue;
+        }
+        if (watch.dumped || (watch.stalledSince.elapsed() < watch.threshold)) {
+            continue;
+        }
+        if (watch.lastDump.isValid() && (watch.lastDump.elapsed() < (m_dumpInterval * 1000LL))) {
+            continue;
+        }
+        watch.dumped = true;
+        watch.lastDump.start();
+        return i;
+    }
+    return -1;
+}
+
+void HangWatchdog::writeHangDump(const QString &name, qint64 stalled)
+{
+    qWarning().noquote() << "Thread" << name << "has not returned to its event loop for" << stalled
+                         << "ms, writing a hang dump.";
+    // Tells a hang dump from a requested one; cleared so a later crash dump does
+    // not carry it.
+    const QByteArray value = name.toUtf8() + ' ' + QByteArray::number(stalled) + "ms";
+    setAnnotation("qbreakpad.hang", value.constData());
+    QString filePath = {};
+    m_write(&filePath);
+    setAnnotation("qbreakpad.hang", "");
+}
+
+} // namespace qbreakpad
@@ -0,0 +1,105 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+QT_FORWARD_DECLARE_CLASS(QAbstractEventDispatcher)
+
+namespace qbreakpad {
+
+// Shared between a monitored thread and the watchdog. The monitored thread counts
+// the passes of its event loop from QAbstractEventDispatcher::awake(); it is the
+// only writer of beats, so a pass costs one relaxed load and store.
+struct Heartbeat
+{
+    std::atomic<quint64> beats = 0;
+    std::atomic<bool> watched = true;
+    // Set by the monitored thread while its event loop runs, cleared before the
+    // dispatcher is destroyed; the watchdog wakes the loop through it.
+    QMutex mutex;
+    QAbstractEventDispatcher *dispatcher = nullptr;
+};
+
+// Writes a dump when a monitored thread does not get back to its event loop for
+// longer than its threshold. A thread whose loop has not moved since the last
+// check is woken up through its event dispatcher: an idle loop answers with a new
+// pass, a stalled one does not. Busy threads are never woken, so the steady-state
+// cost is the beat counter alone. Each thread gets one dump per stall, and no
+// more than one per dump interval. The main thread is let go once the application
+// is about to quit.
+class HangWatchdog : public QThread
+{
+public:
+    using WriteFunction = std::function<bool(QString *filePath)>;
+
+    explicit HangWatchdog(const WriteFunction &write);
+    ~HangWatchdog() override;
+
+    // Watching a thread again replaces its threshold and restarts monitoring, which
+    // a thread that finished and was started again needs.
+    void watch(QThread *thread, int threshold);
+    void unwatch(QThread *thread);
+    void setDumpInterval(int value);
+
+protected:
+    void run() override;
+
+private:
+    struct Watch
+    {
+        // Only compared, never dereferenced: the thread may be gone.
+        QThread *thread = nullptr;
+        QString name = {};
+        int threshold = 0;
+        std::shared_ptr<Heartbeat> heartbeat = {};
+        quint64 beats = 0;
+        QElapsedTimer stalledSince;
+        bool dumped = false;
+        QElapsedTimer lastDump;
+    };
+
+    int checkInterval() const;
+    int findStall();
+    void writeHangDump(const QString &name, qint64 stalled);
+
+    const WriteFunction m_write;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QList<Watch> m_watches = {};
+    int m_dumpInterval = 0;
+    bool m_stopRequested = false;
+};
+
+} // namespace qbreakpad
@@ -0,0 +1,271 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2020 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Decodes the custom streams QBreakpad adds to minidumps. Standard streams are
+// only listed; everything QBreakpad writes itself is printed in a readable form.
+// Compressed dumps have to be decompressed with zstd first.
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr quint32 kMinidumpSignature = 0x504d444d;
+constexpr quint32 kBreadcrumbStreamType = 0x51425001;
+constexpr quint32 kLogTailStreamType = 0x51425002;
+constexpr quint32 kAnnotationStreamType = 0x51425003;
+
+template<typename T>
+bool readValue(const QByteArray &data, qint64 offset, T *value)
+{
+    if ((offset < 0) || (offset + qint64(sizeof(T)) > data.size())) {
+        return false;
+    }
+    memcpy(value, data.constData() + offset, sizeof(T));
+    return true;
+}
+
+QByteArray readString(const QByteArray &data, qint64 offset, quint32 size)
+{
+    if ((offset < 0) || (offset + qint64(size) > data.size())) {
+        return QByteArray();
+    }
+    const char *label = data.constData() + offset;
+    return QByteArray(label, int(strnlen(label, size)));
+}
+
+QString formatTime(quint64 eventNs, quint64 monotonicNs, quint64 realtimeNs)
+{
+    // Events are stamped with the monotonic clock; the stream header carries both
+    // clocks as of the dump, so the offset turns them back into wall time.
+    const qint64 relativeMs = (qint64(eventNs) - qint64(monotonicNs)) / 1000000;
+    const qint64 wallMs = qint64(realtimeNs / 1000000) + relativeMs;
+    return QStringLiteral("%1 (%2 ms)").arg(wallMs).arg(relativeMs);
+}
+
+bool printBreadcrumbs(const QByteArray &data, qint64 offset, quint32 size)
+{
+    const qint64 end = offset + size;
+    quint32 version = 0;
+    quint32 ringCount = 0;
+    quint32 ringCapacity = 0;
+    quint32 labelSize = 0;
+    quint64 monotonicNs = 0;
+    quint64 realtimeNs = 0;
+    quint64 dropped = 0;
+    if (!readValue(data, offset, &version) || !readValue(data, offset + 4, &ringCount)
+        || !readValue(data, offset + 8, &ringCapacity) || !readValue(data, offset + 12, &labelSize)
+        || !readValue(data, offset + 16, &monotonicNs) || !readValue(data, offset + 24, &realtimeNs)
+        || !readValue(data, offset + 32, &dropped)) {
+        return false;
+    }
+    if (version != 1) {
+        printf("  unsupported breadcrumb stream version %u\n", version);
+        return true;
+    }
+    printf("  rings=%u capacity=%u dropped=%llu\n", ringCount, ringCapacity,
+           static_cast<unsigned long long>(dropped));
+
+    const qint64 recordSize = 16 + labelSize;
+    qint64 position = offset + 40;
+    for (quint32 ring = 0; ring < ringCount; ++ring) {
+        quint32 threadId = 0;
+        quint32 eventCount = 0;
+        quint64 head = 0;
+        if (!readValue(data, position, &threadId) || !readValue(data, position + 4, &eventCount)
+            || !readValue(data, position + 8, &head)) {
+            return false;
+        }
+        position += 16;
+        printf("  thread %u: %u of %llu events\n", threadId, eventCount,
+               static_cast<unsigned long long>(head));
+        for (quint32 i = 0; i < eventCount; ++i) {
+            quint64 eventNs = 0;
+            quint64 value = 0;
+            if ((position + recordSize > end) || !readValue(data, position, &eventNs)
+                || !readValue(data, position + 8, &value)) {
+                return false;
+            }
+            printf("    %s %s %llu\n",
+                   qPrintable(formatTime(eventNs, monotonicNs, realtimeNs)),
+                   readString(data, position + 16, labelSize).constData(),
+                   static_cast<unsigned long long>(value));
+            position += recordSize;
+        }
+    }
+    return true;
+}
+
+bool printLogTail(const QByteArray &data, qint64 offset, quint32 size)
+{
+    quint32 version = 0;
+    quint32 textSize = 0;
+    quint64 written = 0;
+    quint64 pending = 0;
+    if (!readValue(data, offset, &version) || !readValue(data, offset + 4, &textSize)
+        || !readValue(data, offset + 8, &written) || !readValue(data, offset + 16, &pending)) {
+        return false;
+    }
+    if (version != 1) {
+        printf("  unsupported log tail stream version %u\n", version);
+        return true;
+    }
+    if (24 + qint64(textSize) > size) {
+        return false;
+    }
+    QByteArray text = data.mid(int(offset + 24), int(textSize));
+    // The oldest line was overwritten in part once the ring wrapped.
+    if (written > textSize) {
+        const int newline = text.indexOf('\n');
+        text.remove(0, newline + 1);
+    }
+    printf("  %u of %llu bytes, %llu still being written\n", textSize,
+           static_cast<unsigned long long>(written), static_cast<unsigned long long>(pending));
+    fwrite(text.constData(), 1, size_t(text.size()), stdout);
+    return true;
+}
+
+bool printAnnotations(const QByteArray &data, qint64 offset, quint32 size)
+{
+    quint32 version = 0;
+    quint32 count = 0;
+    quint32 keySize = 0;
+    quint32 valueSize = 0;
+    quint32 torn = 0;
+    if (!readValue(data, offset, &version) || !readValue(data, offset + 4, &count)
+        || !readValue(data, offset + 8, &keySize) || !readValue(data, offset + 12, &valueSize)
+        || !readValue(data, offset + 16, &torn)) {
+        return false;
+    }
+    if (version != 1) {
+        printf("  unsupported annotation stream version %u\n", version);
+        return true;
+    }
+    const qint64 recordSize = qint64(keySize) + valueSize;
+    if (24 + (qint64(count) * recordSize) > size) {
+        return false;
+    }
+    printf("  %u annotations, %u possibly torn\n", count, torn);
+    for (quint32 i = 0; i < count; ++i) {
+        const qint64 record = offset + 24 + (qint64(i) * recordSize);
+        printf("    %s=%s\n", readString(data, record, keySize).constData(),
+               readString(data, record + keySize, valueSize).constData());
+    }
+    return true;
+}
+
+struct StreamDecoder
+{
+    quint32 type;
+    const char *name;
+    bool (*print)(const QByteArray &data, qint64 offset, quint32 size);
+};
+
+const StreamDecoder m_decoders[] = {
+    {kBreadcrumbStreamType, "breadcrumbs", printBreadcrumbs},
+    {kLogTailStreamType, "log tail", printLogTail},
+    {kAnnotationStreamType, "annotations", printAnnotations},
+};
+
+const StreamDecoder *findDecoder(quint32 type)
+{
+    for (const StreamDecoder &decoder : m_decoders) {
+        if (decoder.type == type) {
+            return &decoder;
+        }
+    }
+    return nullptr;
+}
+
+bool printDump(const QString &filePath, bool listAll)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "Failed to open %s\n", qPrintable(filePath));
+        return false;
+    }
+    const QByteArray data = file.readAll();
+
+    quint32 signature = 0;
+    quint32 streamCount = 0;
+    quint32 directoryRva = 0;
+    if (!readValue(data, 0, &signature) || (signature != kMinidumpSignature)
+        || !readValue(data, 8, &streamCount) || !readValue(data, 12, &directoryRva)) {
+        fprintf(stderr, "%s is not an uncompressed minidump\n", qPrintable(filePath));
+        return false;
+    }
+
+    printf("%s: %u streams\n", qPrintable(filePath), streamCount);
+    bool ok = true;
+    for (quint32 i = 0; i < streamCount; ++i) {
+        const qint64 entry = qint64(directoryRva) + qint64(i) * 12;
+        quint32 type = 0;
+        quint32 size = 0;
+        quint32 rva = 0;
+        if (!readValue(data, entry, &type) || !readValue(data, entry + 4, &size)
+            || !readValue(data, entry + 8, &rva)) {
+            fprintf(stderr, "%s: truncated stream directory\n", qPrintable(filePath));
+            return false;
+        }
+        const StreamDecoder *decoder = findDecoder(type);
+        if (!decoder) {
+            if (listAll) {
+                printf("stream 0x%08x size=%u\n", type, size);
+            }
+            continue;
+        }
+        printf("stream 0x%08x %s size=%u\n", type, decoder->name, size);
+        if ((qint64(rva) + size > data.size()) || !decoder->print(data, rva, size)) {
+            fprintf(stderr, "%s: malformed %s stream\n", qPrintable(filePath), decoder->name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList filePaths = app.arguments().mid(1);
+    const bool listAll = filePaths.removeAll(QStringLiteral("--all")) > 0;
+    if (filePaths.isEmpty()) {
+        fprintf(stderr, "Usage: dumpstreams [--all] <minidump>...\n");
+        return 2;
+    }
+
+    bool ok = true;
+    for (const QString &filePath : std::as_const(filePaths)) {
+        ok = printDump(filePath, listAll) && ok;
+    }
+    return ok ? 0 : 1;
+}